@@ -0,0 +1,373 @@
+/*
+ * Micro-benchmarks of the core kernels of the solver.
+ *
+ * Each kernel is run on generated U-TPP instances of a few sizes. The number
+ * of iterations is calibrated so that a single repetition takes at least
+ * --min-time ms, then --reps repetitions are measured and the median, min
+ * and max time per operation are reported. The generator and the kernels
+ * use fixed seeds so the results of different builds can be compared.
+ *
+ * Results are printed (or saved with --out) in the JSON format.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+#include "docopt.h"
+#include "json.hpp"
+#include "logging.h"
+#include "rand.h"
+#include "tpp.h"
+#include "tpp_solution.h"
+#include "three_opt.h"
+#include "drop.h"
+#include "basic_pheromone.h"
+#include "ant.h"
+#include "aco.h"
+#include "instance_generator.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+
+static const char USAGE[] =
+R"(Micro-benchmarks of the U-TPP solver kernels.
+
+    Usage:
+      tpp-bench [--sizes=<list>] [--products=<n>] [--min-time=<ms>]
+                [--reps=<n>] [--filter=<s>] [--out=<path>]
+                [--threads=<n>]
+      tpp-bench (-h | --help)
+
+    Options:
+      --sizes=<list>     Comma separated numbers of markets of the generated
+                         instances [default: 100,500,1000,5000].
+      --products=<n>     Number of products in the generated instances [default: 100].
+      --min-time=<ms>    Min. duration of a single repetition [default: 50].
+      --reps=<n>         How many repetitions to measure [default: 5].
+      --filter=<s>       Run only the benchmarks with names containing s.
+      --out=<path>       Where to save the results, stdout if not given.
+      --threads=<n>      Threads of the parallel neighborhood scan of
+                         best_k_exchange [default: 1].
+      -h --help          Show this screen.
+)";
+
+
+using bench_clock = chrono::steady_clock;
+
+
+/*
+ * A body of a benchmark performs the given number of iterations of the
+ * measured operation and returns the time it took in ns. This way the body
+ * can exclude its setup from the measurement.
+ */
+using bench_body_t = function<double (uint64_t iterations)>;
+
+
+struct BenchConfig {
+    double min_time_ns_ = 50e6;
+    uint32_t repetitions_ = 5;
+    string filter_;
+    uint32_t threads_ = 1;
+};
+
+
+double get_elapsed_ns(bench_clock::time_point start) {
+    return chrono::duration<double, nano>(bench_clock::now() - start).count();
+}
+
+
+/*
+ * Makes the compiler assume that the value is used, so the computation of a
+ * result which is otherwise discarded is not optimized away. It emits no
+ * instructions (an empty asm statement).
+ */
+template<typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+json run_benchmark(const BenchConfig &config,
+                   const string &name,
+                   const TPP::Instance &instance,
+                   const bench_body_t &body) {
+    // Calibrate the number of iterations
+    uint64_t iterations = 1;
+    while (true) {
+        const auto elapsed = body(iterations);
+        if (elapsed >= config.min_time_ns_ || iterations >= (1ull << 40)) {
+            break ;
+        }
+        const auto scale = elapsed > 0 ? config.min_time_ns_ / elapsed : 100.0;
+        iterations = max(iterations + 1,
+                         static_cast<uint64_t>(iterations * min(scale * 1.2, 100.0)));
+    }
+    vector<double> ns_per_op;
+    for (auto rep = 0u; rep < config.repetitions_; ++rep) {
+        ns_per_op.push_back(body(iterations) / iterations);
+    }
+    sort(begin(ns_per_op), end(ns_per_op));
+    const auto median = ns_per_op[ns_per_op.size() / 2];
+
+    fprintf(stderr, "%-28s %6zu markets %14.1f ns/op\n",
+            name.c_str(), instance.dimension_, median);
+
+    return {
+        {"name", name},
+        {"markets", instance.dimension_},
+        {"products", instance.product_count_},
+        {"iterations", iterations},
+        {"repetitions", config.repetitions_},
+        {"ns_per_op_median", median},
+        {"ns_per_op_min", ns_per_op.front()},
+        {"ns_per_op_max", ns_per_op.back()},
+    };
+}
+
+
+TPP::Solution make_solution(const TPP::Instance &instance,
+                            const vector<uint32_t> &markets) {
+    TPP::Solution sol(instance);
+    for (auto m : markets) {
+        sol.push_back_market(m);
+    }
+    return sol;
+}
+
+
+/*
+ * Returns a valid solution built from all the markets visited in a random
+ * order and reduced with the drop heuristic, i.e. similar to the solutions
+ * constructed by the ants.
+ */
+TPP::Solution make_random_solution(const TPP::Instance &instance, mt19937 &rng) {
+    vector<uint32_t> markets;
+    for (auto m = 1u; m < instance.dimension_; ++m) {
+        markets.push_back(m);
+    }
+    shuffle(begin(markets), end(markets), rng);
+    auto sol = make_solution(instance, markets);
+    drop_heuristic(instance, sol);
+    return sol;
+}
+
+
+void run_instance_benchmarks(const BenchConfig &config,
+                             TPP::Instance &instance,
+                             const string &instance_path,
+                             json &results) {
+    const auto n = static_cast<uint32_t>(instance.dimension_);
+    auto enabled = [&](const string &name) {
+        return name.find(config.filter_) != string::npos;
+    };
+    auto add = [&](const string &name, const bench_body_t &body) {
+        if (enabled(name)) {
+            results.push_back(run_benchmark(config, name, instance, body));
+        }
+    };
+    mt19937 rng(12345);
+    const auto base_sol = make_random_solution(instance, rng);
+
+    add("get_travel_cost", [&](uint64_t iterations) {
+        vector<uint32_t> markets(1024);
+        for (auto &m : markets) {
+            m = rng() % n;
+        }
+        int64_t total = 0;
+        const auto start = bench_clock::now();
+        for (auto i = 0ull; i < iterations; ++i) {
+            const auto a = markets[i & 1023];
+            const auto b = markets[(i * 7 + 1) & 1023];
+            total += instance.get_travel_cost(a, b);
+        }
+        do_not_optimize(total);
+        return get_elapsed_ns(start);
+    });
+
+    add("calc_market_add_cost", [&](uint64_t iterations) {
+        const auto &unselected = base_sol.unselected_markets_;
+        int64_t total = 0;
+        const auto start = bench_clock::now();
+        for (auto i = 0ull; i < iterations; ++i) {
+            const auto m = unselected[i % unselected.size()];
+            total += base_sol.calc_market_add_cost(m).cost_change_;
+        }
+        do_not_optimize(total);
+        return get_elapsed_ns(start);
+    });
+
+    add("insert_remove_market", [&](uint64_t iterations) {
+        auto sol = base_sol;
+        const auto unselected = sol.unselected_markets_;
+        const auto start = bench_clock::now();
+        for (auto i = 0ull; i < iterations; ++i) {
+            const auto m = unselected[i % unselected.size()];
+            const auto pos = 1 + static_cast<uint32_t>(i % (sol.route_.size() - 1));
+            sol.insert_market_at_pos(m, pos);
+            sol.remove_market_at_pos(pos);
+        }
+        const auto elapsed = get_elapsed_ns(start);
+        CHECK_F(sol.cost_ == base_sol.cost_);
+        return elapsed;
+    });
+
+    add("three_opt_nn", [&](uint64_t iterations) {
+        double elapsed = 0;
+        for (auto i = 0ull; i < iterations; ++i) {
+            auto markets = vector<uint32_t>(base_sol.route_.begin() + 1,
+                                            base_sol.route_.end());
+            shuffle(begin(markets), end(markets), rng);
+            auto sol = make_solution(instance, markets);
+            const auto start = bench_clock::now();
+            three_opt_nn(instance, sol);
+            elapsed += get_elapsed_ns(start);
+        }
+        return elapsed;
+    });
+
+    add("drop_heuristic", [&](uint64_t iterations) {
+        vector<uint32_t> markets;
+        for (auto m = 1u; m < n; ++m) {
+            markets.push_back(m);
+        }
+        double elapsed = 0;
+        for (auto i = 0ull; i < iterations; ++i) {
+            shuffle(begin(markets), end(markets), rng);
+            auto sol = make_solution(instance, markets);
+            const auto start = bench_clock::now();
+            drop_heuristic(instance, sol);
+            elapsed += get_elapsed_ns(start);
+        }
+        return elapsed;
+    });
+
+    if (enabled("best_k_exchange")) {
+        // The pool is created once as by the ACO
+        unique_ptr<WorkerPool> pool;
+        if (config.threads_ > 1) {
+            pool = make_unique<WorkerPool>(config.threads_);
+        }
+        add("best_k_exchange", [&](uint64_t iterations) {
+            double elapsed = 0;
+            for (auto i = 0ull; i < iterations; ++i) {
+                auto sol = base_sol;
+                const auto start = bench_clock::now();
+                best_k_exchange_heuristic(instance, sol, 1, pool.get());
+                elapsed += get_elapsed_ns(start);
+            }
+            return elapsed;
+        });
+    }
+
+    if (enabled("move_ant")) {
+        // Creating the ACO is costly (pheromone memory, greedy solution) so
+        // it is done once, the benchmark measures a complete construction
+        // of a single ant's solution
+        ACO aco(instance);
+        aco.run_init();
+        add("move_ant", [&](uint64_t iterations) {
+            double elapsed = 0;
+            for (auto i = 0ull; i < iterations; ++i) {
+                Ant ant(instance);
+                const auto start = bench_clock::now();
+                for (auto j = 1u; j < n; ++j) {
+                    aco.move_ant(ant);
+                }
+                elapsed += get_elapsed_ns(start);
+            }
+            return elapsed;
+        });
+    }
+
+    if (enabled("evaporate")) {
+        BasicPheromone pheromone(n, instance.is_symmetric_, 1e-6, 1.0);
+        add("evaporate", [&](uint64_t iterations) {
+            const auto start = bench_clock::now();
+            for (auto i = 0ull; i < iterations; ++i) {
+                pheromone.evaporate(0.99);
+            }
+            return get_elapsed_ns(start);
+        });
+    }
+
+    add("load_from_file", [&](uint64_t iterations) {
+        const auto start = bench_clock::now();
+        for (auto i = 0ull; i < iterations; ++i) {
+            const auto loaded = TPP::load_from_file(instance_path);
+            CHECK_F(loaded.dimension_ == n);
+        }
+        return get_elapsed_ns(start);
+    });
+}
+
+
+vector<uint32_t> parse_sizes(const string &list) {
+    vector<uint32_t> sizes;
+    istringstream in(list);
+    string item;
+    while (getline(in, item, ',')) {
+        const auto size = stoi(item);
+        CHECK_F(size >= 2, "Instance should have at least 2 markets");
+        sizes.push_back(static_cast<uint32_t>(size));
+    }
+    return sizes;
+}
+
+
+int main(int argc, char *argv[]) {
+    auto args = docopt::docopt(USAGE, { argv + 1, argv + argc }, true);
+
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+    set_initial_seed(1);
+
+    BenchConfig config;
+    config.min_time_ns_ = args["--min-time"].asLong() * 1e6;
+    config.repetitions_ = static_cast<uint32_t>(args["--reps"].asLong());
+    config.threads_ = static_cast<uint32_t>(max(1l, args["--threads"].asLong()));
+    if (args["--filter"]) {
+        config.filter_ = args["--filter"].asString();
+    }
+    const auto sizes = parse_sizes(args["--sizes"].asString());
+    const auto products = static_cast<uint32_t>(args["--products"].asLong());
+
+    json results = json::array();
+    for (auto size : sizes) {
+        const auto path = "/tmp/tpp-bench-" + to_string(getpid())
+                        + "-" + to_string(size) + ".tpp";
+        TPP::GeneratorConfig gen_config;
+        gen_config.markets_ = size;
+        gen_config.products_ = products;
+        gen_config.seed_ = size;
+        gen_config.offer_density_ = 0.5;
+        {
+            ofstream out(path);
+            CHECK_F(out.is_open(), "Cannot create instance file: %s", path.c_str());
+            TPP::write_random_instance(out, gen_config);
+        }
+        auto instance = TPP::load_from_file(path);
+        run_instance_benchmarks(config, instance, path, results);
+        remove(path.c_str());
+    }
+
+    json record = {
+        {"suite", "micro"},
+        {"min_time_ms", config.min_time_ns_ / 1e6},
+        {"repetitions", config.repetitions_},
+        {"products", products},
+        {"results", results},
+    };
+    if (args["--out"]) {
+        ofstream out(args["--out"].asString());
+        CHECK_F(out.is_open(), "Cannot create the output file");
+        out << record.dump(2) << endl;
+    } else {
+        cout << record.dump(2) << endl;
+    }
+    return EXIT_SUCCESS;
+}
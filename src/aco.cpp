@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <chrono>
 
 #include "aco.h"
 #include "cah.h"
@@ -9,41 +10,161 @@
 #include "drop.h"
 #include "three_opt.h"
 #include "two_opt.h"
+#include "or_opt.h"
+#include "lin_kernighan.h"
+#include "profiler.h"
 
 
 using namespace std;
 
 
-void local_search(const TPP::Instance &instance,
+int optimize_route(const TPP::Instance &instance, TPP::Solution &sol,
+                   RouteOptimizer route_optimizer) {
+    switch (route_optimizer) {
+    case RouteOptimizer::TwoOptOrOpt:
+        return two_opt_or_opt_nn(instance, sol, /*don't look bits=*/true, /*nn_count=*/25);
+    case RouteOptimizer::LinKernighan:
+        return lin_kernighan(instance, sol, /*don't look bits=*/true, /*nn_count=*/10);
+    case RouteOptimizer::ThreeOpt:
+    default:
+        return three_opt_nn(instance, sol, /*don't look bits=*/true, /*nn_count=*/25);
+    }
+}
+
+
+/*
+ * The operators used by the local search, in the default order. The route
+ * optimizer is not scheduled, it is run whenever the set of markets changes.
+ */
+enum LocalSearchOperator : uint32_t {
+    DropOp = 0,
+    InsertionOp,
+    KExchangeOp,
+    DoubleExchangeOp,
+    ExchangeOp,
+    RouteOptOp
+};
+
+
+vector<string> get_local_search_operator_names() {
+    return { "drop", "insertion", "k_exchange", "double_exchange", "exchange",
+             "route_opt" };
+}
+
+
+double get_elapsed_us(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+
+/*
+ * Applies the local search operators to the solution. The number of passes
+ * depends on how the cost compares to the global_best_cost. Returns false if
+ * the search was interrupted by the stop condition, the solution is valid
+ * but not a local optimum then. The first-improvement heuristics use the
+ * don't look bits with dlb_nn_count candidates unless it is 0.
+ */
+bool local_search(const TPP::Instance &instance,
                  TPP::Solution &sol,
-                 int global_best_cost) {
+                 int global_best_cost,
+                 RouteOptimizer route_optimizer,
+                 bool best_improvement,
+                 size_t dlb_nn_count,
+                 WorkerPool *pool,
+                 LocalSearchScheduler &scheduler,
+                 const StopCondition *stop_condition) {
     auto improvement_found = false;
     auto pass = 0;
     constexpr auto MaxPasses = 2;
     bool global_best_improved = false;
 
-    three_opt_nn(instance, sol, /*don't look bits=*/true, /*nn_count=*/25);
+    auto run_route_optimizer = [&]() {
+        const auto start_time = chrono::steady_clock::now();
+        const auto delta = optimize_route(instance, sol, route_optimizer);
+        scheduler.record(RouteOptOp, -delta, get_elapsed_us(start_time));
+    };
+    run_route_optimizer();
+
+    // The don't look bits are kept between the passes so that the markets
+    // which could not be removed / exchanged are not checked again unless
+    // their neighborhood changed
+    MarketDontLookBits drop_dlb(instance, dlb_nn_count);
+    MarketDontLookBits k_exchange_dlb(instance, dlb_nn_count);
+    MarketDontLookBits double_exchange_dlb(instance, dlb_nn_count);
+    MarketDontLookBits exchange_dlb(instance, dlb_nn_count);
+    auto use_dlb = [&](MarketDontLookBits &dlb) {
+        return dlb_nn_count > 0 ? &dlb : nullptr;
+    };
+
+    auto run_operator = [&](uint32_t op) {
+        switch (op) {
+        case DropOp:
+            drop_heuristic(instance, sol, use_dlb(drop_dlb));
+            break ;
+        case InsertionOp:
+            insertion_heuristic(instance, sol);
+            break ;
+        case KExchangeOp:
+            if (best_improvement) {
+                best_k_exchange_heuristic(instance, sol, 3, pool);
+            } else {
+                k_exchange_heuristic(instance, sol, 3, use_dlb(k_exchange_dlb));
+            }
+            break ;
+        case DoubleExchangeOp:
+            if (best_improvement) {
+                best_k_exchange_heuristic(instance, sol, 2, pool);
+            } else {
+                double_exchange_heuristic(instance, sol, use_dlb(double_exchange_dlb));
+            }
+            break ;
+        case ExchangeOp:
+            if (best_improvement) {
+                best_k_exchange_heuristic(instance, sol, 1, pool);
+            } else {
+                exchange_heuristic(instance, sol, use_dlb(exchange_dlb));
+            }
+            break ;
+        }
+    };
 
+    auto is_interrupted = [&] {
+        return stop_condition != nullptr && stop_condition->should_interrupt();
+    };
+    bool interrupted = false;
     do {
         improvement_found = false;
         const auto start_cost = sol.cost_;
 
-        drop_heuristic(instance, sol);
-        insertion_heuristic(instance, sol);
-        k_exchange_heuristic(instance, sol, 3);
-        double_exchange_heuristic(instance, sol);
-        exchange_heuristic(instance, sol);
+        for (auto op : scheduler.get_order()) {
+            if (is_interrupted()) {
+                interrupted = true;
+                break ;  // The solution is valid after each operator
+            }
+            if (op == RouteOptOp || !scheduler.should_run(op)) {
+                continue ;
+            }
+            const auto op_start_cost = sol.cost_;
+            const auto start_time = chrono::steady_clock::now();
+            run_operator(op);
+            scheduler.record(op, op_start_cost - sol.cost_, get_elapsed_us(start_time));
+        }
 
         if (sol.cost_ != start_cost) {
-            three_opt_nn(instance, sol, /*don't look bits=*/true, /*nn_count=*/25);
+            run_route_optimizer();
         }
         improvement_found = (sol.cost_ < start_cost);
         ++pass;
         if (improvement_found && sol.cost_ < (global_best_cost * (1. + 0.08/(pass * pass)))) {
             global_best_improved = true;
         }
+        if (interrupted || is_interrupted()) {
+            interrupted = true;
+            break ;
+        }
     } while(improvement_found && (pass < MaxPasses || global_best_improved));
-    CHECK_F(is_solution_valid(instance, sol.route_), "Sol should be valid");
+    DEBUG_CHECK_F(is_solution_valid(instance, sol.route_), "Sol should be valid");
+    return !interrupted;
 }
 
 
@@ -58,6 +179,7 @@ double node_branching(double lambda,
                       size_t cand_list_size,
                       const pheromone_t &pheromone,
                       const TPP::Instance &problem) {
+    PROFILE_SCOPE("node_branching");
     const auto n = problem.dimension_;
     vector<int> num_branches(n);
     const auto nn_ants = cand_list_size;
@@ -98,8 +220,9 @@ double node_branching(double lambda,
 }
 
 
-ACO::ACO(TPP::Instance &instance)
-    : instance_(instance)
+ACO::ACO(const TPP::Instance &instance)
+    : instance_(instance),
+      ls_scheduler_(get_local_search_operator_names())
 {}
 
 
@@ -110,14 +233,44 @@ void ACO::run(StopCondition *stop_condition) {
     LOG_SCOPE_F(INFO, "run");
 
     stop_condition->start();
-
+    stop_condition_ = stop_condition;
+    run_start_time_ = chrono::steady_clock::now();
+
+    if (resume_state_) {
+        // Avoids recomputing the greedy solution in run_init
+        initial_pheromone_ = resume_state_->initial_pheromone_;
+        greedy_solution_value_ = resume_state_->greedy_solution_value_;
+        min_pheromone_ = resume_state_->min_pheromone_;
+        max_pheromone_ = resume_state_->max_pheromone_;
+    }
     run_init();
+    if (resume_state_) {
+        restore_state(*resume_state_, stop_condition);
+        resume_state_ = nullptr;
+        if (global_best_) {
+            publish_global_best();
+        }
+    } else if (global_best_) {  // A warm start from initial_route_
+        stop_condition->update_best_cost(global_best_->cost());
+        publish_global_best();
+        if (new_best_found_callback_) {
+            new_best_found_callback_(*this);
+        }
+    }
 
     // For sorting ants according to the cost of a solution
     auto cmp = [](auto l, auto r) { return l->cost() < r->cost(); };
 
     for ( ; !stop_condition->is_reached(); stop_condition->next_iteration()) {
-        build_ant_solutions();
+        const auto iteration_start_time = chrono::steady_clock::now();
+        iteration_stats_ = IterationStats();
+        iteration_stats_.iteration_ = current_iteration_;
+
+        {
+            PROFILE_SCOPE("construction");
+            build_ant_solutions();
+        }
+        iteration_stats_.construction_time_us_ = get_elapsed_us(iteration_start_time);
 
         iteration_best_ = *min_element(begin(ants_), end(ants_), cmp);
 
@@ -127,16 +280,26 @@ void ACO::run(StopCondition *stop_condition) {
             global_best_values_no_ls_.push_back(cost);
         }
 
-        apply_local_search();
+        const auto ls_start_time = chrono::steady_clock::now();
+        {
+            PROFILE_SCOPE("local_search");
+            apply_local_search();
+        }
+        iteration_stats_.ls_time_us_ = get_elapsed_us(ls_start_time);
 
         iteration_best_ = *min_element(begin(ants_), end(ants_), cmp);
 
         if (!global_best_ || global_best_->cost() > iteration_best_->cost()) {
             global_best_ = make_shared<Ant>(*iteration_best_);
+            global_best_found_iteration_ = current_iteration_;
+            stop_condition->update_best_cost(global_best_->cost());
+            // The local search results depend on the global best cost
+            ls_cache_.clear();
 
             //pheromone_->add_solution(global_best_->solution_.route_,
                                     //global_best_->cost());
 
+            publish_global_best();
             if (new_best_found_callback_) {
                 new_best_found_callback_(*this);
             }
@@ -161,9 +324,11 @@ void ACO::run(StopCondition *stop_condition) {
         min_pheromone_ = max_pheromone_ / (2 * instance_.dimension_);
 
         // Evaporate & update pheromone
-        pheromone_->set_trail_limits(min_pheromone_, max_pheromone_);
-
-        pheromone_->evaporate(evaporation_rate_);
+        {
+            PROFILE_SCOPE("evaporation");
+            pheromone_->set_trail_limits(min_pheromone_, max_pheromone_);
+            pheromone_->evaporate(evaporation_rate_);
+        }
 
         Ant* update_ant = nullptr;
 
@@ -178,11 +343,14 @@ void ACO::run(StopCondition *stop_condition) {
             }
         }
 
-        double deposit = 1. / update_ant->cost();
-        auto prev = update_ant->get_route().back();
-        for (auto market : update_ant->get_route()) {
-            pheromone_->increase(prev, market, deposit);
-            prev = market;
+        {
+            PROFILE_SCOPE("pheromone_deposit");
+            double deposit = 1. / update_ant->cost();
+            auto prev = update_ant->get_route().back();
+            for (auto market : update_ant->get_route()) {
+                pheromone_->increase(prev, market, deposit);
+                prev = market;
+            }
         }
 
         if ((current_iteration_ + 1) % 100 == 0) {
@@ -192,6 +360,7 @@ void ACO::run(StopCondition *stop_condition) {
                                                          *pheromone_, instance_);
 
             LOG_F(WARNING, "Branching factor: %lf", branching_factor);
+            iteration_stats_.branching_factor_ = branching_factor;
 
             if ((current_iteration_ - restart_best_found_iteration_ > 250)
                 && branching_factor < branching_factor_threshold) {
@@ -202,19 +371,217 @@ void ACO::run(StopCondition *stop_condition) {
                 pheromone_->set_all_trails(max_pheromone_);
                 restart_best_ = nullptr;
                 pheromone_reset_iteration_ = current_iteration_;
+                iteration_stats_.pheromone_reset_ = true;
 
                 global_best_cost_no_ls_ = numeric_limits<int>::max();
                 global_best_values_no_ls_.clear();
             }
         }
+        iteration_stats_.iteration_best_cost_ = iteration_best_->cost();
+        iteration_stats_.global_best_cost_ = global_best_->cost();
+        iteration_stats_.iteration_time_us_ = get_elapsed_us(iteration_start_time);
+        // The interruption is permanent (time limit or cancel flag), hence if
+        // it is not signalled now it was not signalled during the iteration
+        iteration_stats_.interrupted_ = stop_condition->should_interrupt();
+
         ++current_iteration_;
         update_u_gb();
+
+        if (iteration_done_callback_) {
+            iteration_done_callback_(*this);
+        }
+    }
+
+    if (global_best_) {  // Not if stopped before the first iteration
+        LOG_F(INFO, "Final best value: %d", global_best_->cost());
+        LOG_F(INFO, "Best ant affinity: %lf", global_best_->affinity_);
+        LOG_F(INFO, "Best ant laziness_: %lf", global_best_->laziness_);
+        LOG_F(INFO, "Best ant avidity_: %lf", global_best_->avidity_);
+    }
+}
+
+
+void ACO::publish_global_best() {
+    const auto time = chrono::duration<double>(
+            chrono::steady_clock::now() - run_start_time_).count();
+    anytime_best_.publish(global_best_->cost(), global_best_->solution_.route_,
+                          current_iteration_, time);
+}
+
+
+AcoState ACO::get_state() const {
+    AcoState state;
+    state.current_iteration_ = current_iteration_;
+    state.u_gb_ = u_gb_;
+    state.restart_best_found_iteration_ = restart_best_found_iteration_;
+    state.global_best_found_iteration_ = global_best_found_iteration_;
+    state.pheromone_reset_iteration_ = pheromone_reset_iteration_;
+    state.greedy_solution_value_ = greedy_solution_value_;
+    state.global_best_cost_no_ls_ = global_best_cost_no_ls_;
+    state.global_best_values_no_ls_ = global_best_values_no_ls_;
+    state.initial_pheromone_ = initial_pheromone_;
+    state.min_pheromone_ = min_pheromone_;
+    state.max_pheromone_ = max_pheromone_;
+    if (pheromone_) {
+        for (const auto &row : pheromone_->trails_) {
+            state.pheromone_trails_.insert(end(state.pheromone_trails_),
+                                           begin(row), end(row));
+        }
+    }
+    for (const auto &row : heuristic_) {
+        state.heuristic_.insert(end(state.heuristic_), begin(row), end(row));
+    }
+    if (global_best_) {
+        state.global_best_route_ = global_best_->solution_.route_;
     }
+    if (restart_best_) {
+        state.restart_best_route_ = restart_best_->solution_.route_;
+    }
+    state.ls_cache_entries_ = ls_cache_.get_entries();
+    state.ls_cache_lookups_ = ls_cache_.lookups_;
+    state.ls_cache_hits_ = ls_cache_.hits_;
+    const auto &engine = get_random_engine();
+    state.rng_state_ = {{ engine.state_[0], engine.state_[1] }};
+    return state;
+}
+
+
+void ACO::resume_from(AcoState state, bool count_previous_iterations) {
+    const auto n = instance_.dimension_;
+    CHECK_F(state.pheromone_trails_.size() == n * n
+            && state.heuristic_.size() == n * (instance_.product_count_ + 1),
+            "The state does not match the instance");
+    resume_state_ = make_unique<AcoState>(move(state));
+    resume_counts_iterations_ = count_previous_iterations;
+}
+
+
+shared_ptr<Ant> ACO::make_ant(const vector<uint32_t> &route) {
+    auto ant = make_shared<Ant>(instance_);
+    for (auto market : route) {
+        if (market != 0) {
+            ant->move_to(market);
+        }
+    }
+    return ant;
+}
+
+
+/*
+ * Returns an ant with a feasible solution built from the route. The markets
+ * which are not in the instance are skipped and the solution is repaired if
+ * it is not feasible, then it is improved with the drop and insertion
+ * heuristics.
+ */
+shared_ptr<Ant> ACO::make_feasible_ant(const vector<uint32_t> &route) {
+    auto ant = make_shared<Ant>(instance_);
+    auto &solution = ant->solution_;
+    for (auto market : route) {
+        if (market != 0 && market < instance_.dimension_
+                && !solution.is_market_used(market)) {
+            ant->move_to(market);
+        }
+    }
+    const auto inserted = repair_solution(instance_, solution);
+    drop_heuristic(instance_, solution);
+    insertion_heuristic(instance_, solution);
+    CHECK_F(solution.cost_ == calc_solution_cost(instance_, solution.route_),
+            "Sol. cost should be valid");
+    LOG_F(INFO, "Feasible solution cost: %d, markets inserted: %u",
+          solution.cost_, inserted);
+    return ant;
+}
+
+
+int ACO::on_instance_changed(const vector<uint32_t> &changed_markets) {
+    CHECK_F(pheromone_ != nullptr && global_best_ != nullptr,
+            "run() should be called first");
+    LOG_SCOPE_F(INFO, "on_instance_changed");
 
-    LOG_F(INFO, "Final best value: %d", global_best_->cost());
-    LOG_F(INFO, "Best ant affinity: %lf", global_best_->affinity_);
-    LOG_F(INFO, "Best ant laziness_: %lf", global_best_->laziness_);
-    LOG_F(INFO, "Best ant avidity_: %lf", global_best_->avidity_);
+    global_best_ = make_feasible_ant(global_best_->solution_.route_);
+    if (restart_best_) {
+        restart_best_ = make_feasible_ant(restart_best_->solution_.route_);
+        if (restart_best_->cost() < global_best_->cost()) {
+            global_best_ = restart_best_;
+        }
+    }
+    // Computing the heuristic info from scratch takes much longer than the
+    // rest of the update, so only the rows of the changed markets are
+    // recomputed and with fewer random solutions. Their values are noisier
+    // and the rows of the other markets are not adjusted although their
+    // shares of the purchase costs changed too, the pheromone trails make up
+    // for it as the run continues.
+    sample_heuristic_info(changed_markets, ChangedMarketsHeuristicTrials);
+
+    auto state = get_state();
+    // The stored results are no longer valid
+    state.ls_cache_entries_.clear();
+    // The threshold of the local search is based on the costs for the old
+    // data, e.g. after a price increase it would exclude all the ants
+    state.global_best_cost_no_ls_ = 0;
+    state.global_best_values_no_ls_.clear();
+    resume_from(move(state), /*count_previous_iterations=*/false);
+    return global_best_->cost();
+}
+
+
+/*
+ * Restores the state saved with get_state. The stop_condition is moved
+ * forward by the number of iterations already performed, and is notified
+ * about the best solutions, so e.g. the iterations limit applies to the
+ * whole (resumed) run.
+ */
+void ACO::restore_state(const AcoState &state, StopCondition *stop_condition) {
+    current_iteration_ = state.current_iteration_;
+    u_gb_ = state.u_gb_;
+    restart_best_found_iteration_ = state.restart_best_found_iteration_;
+    global_best_found_iteration_ = state.global_best_found_iteration_;
+    pheromone_reset_iteration_ = state.pheromone_reset_iteration_;
+    global_best_cost_no_ls_ = state.global_best_cost_no_ls_;
+    global_best_values_no_ls_ = state.global_best_values_no_ls_;
+    min_pheromone_ = state.min_pheromone_;
+    max_pheromone_ = state.max_pheromone_;
+
+    pheromone_->set_trail_limits(min_pheromone_, max_pheromone_);
+    const auto n = instance_.dimension_;
+    for (auto i = 0u; i < n; ++i) {
+        auto &row = pheromone_->trails_[i];
+        copy_n(begin(state.pheromone_trails_) + i * n, n, begin(row));
+    }
+    const auto row_size = instance_.product_count_ + 1;
+    heuristic_.resize(n);
+    for (auto i = 0u; i < n; ++i) {
+        const auto first = begin(state.heuristic_) + i * row_size;
+        heuristic_[i].assign(first, first + row_size);
+    }
+
+    global_best_ = state.global_best_route_.empty()
+                 ? nullptr : make_ant(state.global_best_route_);
+    restart_best_ = state.restart_best_route_.empty()
+                  ? nullptr : make_ant(state.restart_best_route_);
+
+    ls_cache_.set_entries(instance_, state.ls_cache_entries_);
+    ls_cache_.lookups_ = state.ls_cache_lookups_;
+    ls_cache_.hits_ = state.ls_cache_hits_;
+
+    if (resume_counts_iterations_) {
+        for (auto i = 0; i < current_iteration_; ++i) {
+            if (global_best_ && i == global_best_found_iteration_) {
+                stop_condition->update_best_cost(global_best_->cost());
+            }
+            stop_condition->next_iteration();
+        }
+    } else if (global_best_) {
+        stop_condition->update_best_cost(global_best_->cost());
+    }
+
+    // The ants created above use the generator so it is restored last
+    auto &engine = get_random_engine();
+    engine.state_[0] = state.rng_state_[0];
+    engine.state_[1] = state.rng_state_[1];
+
+    LOG_F(WARNING, "Resumed at iteration: %d, global best: %d",
+          current_iteration_, global_best_ ? global_best_->cost() : 0);
 }
 
 
@@ -225,6 +592,22 @@ void ACO::run_init() {
 
     restart_best_ = nullptr;
     restart_best_found_iteration_ = 0;
+    global_best_found_iteration_ = 0;
+
+    if (ls_best_improvement_ && ls_threads_count_ > 1
+            && (!ls_pool_ || ls_pool_->size() != ls_threads_count_)) {
+        ls_pool_ = make_unique<WorkerPool>(ls_threads_count_);
+    }
+
+    if (!initial_route_.empty() && !resume_state_) {
+        global_best_ = make_feasible_ant(initial_route_);
+        LOG_F(WARNING, "Initial solution cost: %d", global_best_->cost());
+        restart_best_ = global_best_;
+        // The pheromone limits are based on this instead of the CAH solution
+        if (greedy_solution_value_ == 0) {
+            greedy_solution_value_ = global_best_->cost();
+        }
+    }
 
     if (initial_pheromone_ == 0) {
         calc_initial_pheromone();
@@ -234,7 +617,22 @@ void ACO::run_init() {
                                              instance_.is_symmetric_,
                                              min_pheromone_,
                                              max_pheromone_);
-    init_heuristic_info();
+    if (!initial_trails_.empty() && !resume_state_) {
+        const auto n = instance_.dimension_;
+        CHECK_F(initial_trails_.size() == n * n,
+                "The initial pheromone does not match the instance");
+        for (auto i = 0u; i < n; ++i) {
+            for (auto j = 0u; j < n; ++j) {
+                const auto value = initial_trails_[i * n + j];
+                pheromone_->trails_[i][j] = min(max_pheromone_,
+                                                max(min_pheromone_, value));
+            }
+        }
+    }
+    if (!resume_state_) {  // Otherwise it is restored with the state
+        init_heuristic_info();
+    }
+    ant_phmem_samples_.resize(ants_count_);
 
     current_iteration_ = 0;
 }
@@ -243,6 +641,12 @@ void ACO::run_init() {
 void ACO::calc_initial_pheromone() {
     LOG_SCOPE_F(INFO, "calc_initial_pheromone");
     if (greedy_solution_value_ == 0) {
+        // The CAH draws from a separate generator with a fixed seed, so the
+        // value depends only on the instance and can be reused for other
+        // runs (e.g. by the server) without changing their random numbers
+        constexpr uint32_t CahSeed = 1;
+        xoroshiro128plus cah_rng(CahSeed);
+        ScopedRandomEngine rng_scope(cah_rng);
         auto sol = commodity_adding_heuristic(instance_);
         greedy_solution_value_ = sol.cost_;
         /*restart_best_ = make_shared<Ant>(instance_);
@@ -267,7 +671,6 @@ void ACO::build_ant_solutions() {
     LOG_SCOPE_F(INFO, "build_ant_solutions");
     ants_.clear();
 
-    ant_phmem_samples_.resize(ants_count_);
     for (auto i = 0u; i < ants_count_; ++i) {
         ants_.push_back(make_shared<Ant>(instance_));
         ants_.back()->id_ = i;
@@ -280,12 +683,13 @@ void ACO::build_ant_solutions() {
         }
     }
     for (auto &ant : ants_) {
-        CHECK_F(ant->solution_.is_valid(), "Ant solution should be valid");
-        CHECK_F(ant->solution_.cost_ == calc_solution_cost(instance_, ant->solution_.route_),
+        DEBUG_CHECK_F(ant->solution_.is_valid(), "Ant solution should be valid");
+        DEBUG_CHECK_F(ant->solution_.cost_ == calc_solution_cost(instance_, ant->solution_.route_),
                 "Sol. cost should be valid (%d != %d)",
                 ant->solution_.cost_,
                 calc_solution_cost(instance_, ant->solution_.route_));
         // Remove unnecessary markets from the solution:
+        PROFILE_SCOPE("construction_drop");
         drop_heuristic(instance_, ant->solution_);
     }
 }
@@ -301,11 +705,12 @@ void ACO::move_ant(Ant &ant) {
             return ;
         }
     }
-    const auto &cand = ant.get_candidate_markets(cand_list_size_);
+    auto &cand = cand_markets_;
+    ant.get_candidate_markets(cand_list_size_, cand);
 
-    CHECK_F( !cand.empty(), "At least one market should be unvisited");
+    DEBUG_CHECK_F( !cand.empty(), "At least one market should be unvisited");
 
-    static vector<double> cand_values(instance_.dimension_);
+    auto &cand_values = cand_values_;
     cand_values.clear();
     auto total = 0.0;
     for (auto m : cand) {
@@ -316,23 +721,23 @@ void ACO::move_ant(Ant &ant) {
     const auto threshold = get_random_value() * total;
     auto partial_sum = 0.0;
     auto chosen = cand.back();
-    CHECK_F(chosen != 0, "back() should not be a depot!");
+    DEBUG_CHECK_F(chosen != 0, "back() should not be a depot!");
     for (auto i = 0ul, n = cand_values.size(); i < n; ++i) {
         partial_sum += cand_values[i];
         if (partial_sum >= threshold) {
-            chosen = cand.at(i);
-            CHECK_F(chosen != 0, "No depot");
+            chosen = DEBUG_AT(cand, i);
+            DEBUG_CHECK_F(chosen != 0, "No depot");
             break ;
         }
     }
-    CHECK_F(chosen != 0, "Cannot move to depot!");
+    DEBUG_CHECK_F(chosen != 0, "Cannot move to depot!");
     ant.move_to(chosen);
 }
 
 
 double ACO::calc_attractiveness(Ant &ant, size_t to_market) {
     const auto from_market = ant.get_position();
-    const auto &phmem_indices = ant_phmem_samples_.at(ant.id_);
+    const auto &phmem_indices = DEBUG_AT(ant_phmem_samples_, ant.id_);
     // const auto trail = pheromone_->get_trail_sample(from_market, to_market, phmem_indices);
     const auto trail = pheromone_->get_trail(from_market, to_market);
 
@@ -341,7 +746,7 @@ double ACO::calc_attractiveness(Ant &ant, size_t to_market) {
     const auto travel_cost = instance_.get_travel_cost(from_market, to_market);
     product *= std::pow(1./travel_cost, static_cast<int>(ant.laziness_));
 
-    auto h = heuristic_.at(to_market).at(instance_.product_count_);
+    auto h = DEBUG_AT(DEBUG_AT(heuristic_, to_market), instance_.product_count_);
     product *= std::pow(max(1.e-10, h), static_cast<int>(ant.avidity_));
 
     // ucc = updated commodity cost
@@ -376,6 +781,17 @@ void ACO::init_heuristic_info() {
     for (auto &vec : heuristic_) {
         vec.resize(instance_.product_count_ + 1, 0);
     }
+    vector<uint32_t> markets(instance_.dimension_);
+    iota(begin(markets), end(markets), 0u);
+    sample_heuristic_info(markets, HeuristicTrials);
+}
+
+
+void ACO::sample_heuristic_info(const vector<uint32_t> &markets, int trials) {
+    vector<uint8_t> is_sampled(instance_.dimension_, false);
+    for (auto m : markets) {
+        is_sampled.at(m) = true;
+    }
 
     // [i][j] = how many units of a product j were bought at market i
     vector<vector<double>> bought_at_markets(instance_.dimension_);
@@ -384,7 +800,6 @@ void ACO::init_heuristic_info() {
 
     }
 
-    const auto trials = 200;
     for (auto i = 0; i < trials; ++i) {
         auto sol = create_random_solution(instance_);
         double purchases_cost = accumulate(begin(sol.purchase_costs_),
@@ -398,8 +813,10 @@ void ACO::init_heuristic_info() {
             int total_bought = 0;
             for (const auto &offer : offers) {
                 const auto bought = min(offer.quantity_, needed - total_bought);
-                bought_at_markets.at(offer.market_id_).at(product_id) +=
-                    (bought * offer.price_) / purchases_cost;
+                if (is_sampled[offer.market_id_]) {
+                    bought_at_markets.at(offer.market_id_).at(product_id) +=
+                        (bought * offer.price_) / purchases_cost;
+                }
 
                 total_bought -= bought;
                 if (bought == 0) {
@@ -409,7 +826,7 @@ void ACO::init_heuristic_info() {
             }
         }
     }
-    for (auto m = 0u; m < instance_.dimension_; ++m) {
+    for (auto m : markets) {
         double sum = 0;
         for (auto p = 0u; p < instance_.product_count_; ++p) {
             const double bought = bought_at_markets.at(m).at(p);
@@ -462,8 +879,34 @@ void ACO::apply_local_search() {
         //const auto threshold = max(crude_threshold,
                                    //static_cast<double>(track_threshold));
         for (auto &ant : ants_) {
-            if (ant->cost() <= track_threshold) {
-                local_search(instance_, ant->solution_, global_best_->cost());
+            if (stop_condition_ != nullptr && stop_condition_->should_interrupt()) {
+                break ;
+            }
+            if (ant->cost() > track_threshold) {
+                continue ;
+            }
+            auto &sol = ant->solution_;
+            if (ls_cache_.capacity_ == 0) {
+                local_search(instance_, sol, global_best_->cost(),
+                             route_optimizer_, ls_best_improvement_,
+                             ls_dlb_nn_count_, ls_pool_.get(), ls_scheduler_,
+                             stop_condition_);
+                continue ;
+            }
+            const auto *cached = ls_cache_.find(instance_, sol.route_);
+            PROFILE_COUNT("ls_cache_lookups", 1);
+            if (cached != nullptr) {
+                PROFILE_COUNT("ls_cache_hits", 1);
+                sol = *cached;
+            } else {
+                const auto route_before = sol.route_;
+                const auto completed = local_search(instance_, sol, global_best_->cost(),
+                                                    route_optimizer_, ls_best_improvement_,
+                                                    ls_dlb_nn_count_, ls_pool_.get(),
+                                                    ls_scheduler_, stop_condition_);
+                if (completed) {  // Otherwise it is not a local optimum
+                    ls_cache_.insert(instance_, route_before, sol);
+                }
             }
         }
     }
@@ -7,12 +7,78 @@
 
 #include <memory>
 #include <array>
+#include <chrono>
 #include <functional>
 
 #include "tpp_solution.h"
 #include "ant.h"
 #include "stopcondition.h"
 #include "basic_pheromone.h"
+#include "ls_scheduler.h"
+#include "ls_cache.h"
+#include "best_solution_buffer.h"
+#include "worker_pool.h"
+
+
+/*
+ * Heuristics available for optimizing the order of markets (travel cost)
+ * in the local search.
+ */
+enum class RouteOptimizer {
+    ThreeOpt,       // three_opt_nn
+    TwoOptOrOpt,    // two_opt_or_opt_nn
+    LinKernighan    // lin_kernighan
+};
+
+
+/*
+ * Timings and results of a single iteration of the ACO.
+ */
+struct IterationStats {
+    int iteration_ = 0;
+    double iteration_time_us_ = 0;
+    double construction_time_us_ = 0;
+    double ls_time_us_ = 0;
+    int iteration_best_cost_ = 0;
+    int global_best_cost_ = 0;
+    // The branching factor is calculated every 100 iterations, otherwise
+    // it is < 0
+    double branching_factor_ = -1;
+    bool pheromone_reset_ = false;
+    // True if the stop condition asked to interrupt the iteration, i.e. the
+    // local search may have been cut short
+    bool interrupted_ = false;
+};
+
+
+/*
+ * The state of the ACO between two iterations, i.e. everything what is
+ * needed to continue the computations with the same result as if they were
+ * not interrupted (see checkpoint.h).
+ */
+struct AcoState {
+    int current_iteration_ = 0;  // The next iteration to perform
+    int u_gb_ = 25;
+    int restart_best_found_iteration_ = 0;
+    int global_best_found_iteration_ = 0;
+    int pheromone_reset_iteration_ = 0;
+    int greedy_solution_value_ = 0;
+    int global_best_cost_no_ls_ = 0;
+    std::vector<int> global_best_values_no_ls_;
+    double initial_pheromone_ = 0;
+    double min_pheromone_ = 0;
+    double max_pheromone_ = 0;
+    std::vector<double> pheromone_trails_;  // dimension x dimension
+    // dimension x (products + 1), it is computed from random solutions so
+    // it is saved too
+    std::vector<double> heuristic_;
+    std::vector<uint32_t> global_best_route_;  // Empty if not found yet
+    std::vector<uint32_t> restart_best_route_;
+    std::vector<LocalSearchCache::EntryRoutes> ls_cache_entries_;
+    uint64_t ls_cache_lookups_ = 0;
+    uint64_t ls_cache_hits_ = 0;
+    std::array<uint64_t, 2> rng_state_ {{ 0, 0 }};
+};
 
 
 struct ACO {
@@ -27,6 +93,33 @@ struct ACO {
     double evaporation_rate_ = 0.99;
     size_t cand_list_size_ = 25;
     bool use_local_search_ = true;
+    RouteOptimizer route_optimizer_ = RouteOptimizer::ThreeOpt;
+    // If true the local search uses the best-improvement exchange heuristics
+    // scanning the neighborhood in parallel with ls_threads_count_ threads
+    bool ls_best_improvement_ = false;
+    // How many nearest neighbors of a market are checked by the
+    // first-improvement drop / exchange heuristics, which also skip the
+    // markets with the don't look bits set; 0 disables both, i.e. all the
+    // markets are checked (see MarketDontLookBits)
+    size_t ls_dlb_nn_count_ = 50;
+    uint32_t ls_threads_count_ = 1;
+    // The threads of the parallel scans, created by run_init() and kept for
+    // the lifetime of the ACO, nullptr if a single thread is used
+    std::unique_ptr<WorkerPool> ls_pool_;
+    // Times the local search operators and, if adaptive, decides about their
+    // order, the statistics are kept for the whole run
+    LocalSearchScheduler ls_scheduler_;
+    // Results of the local search for the recently seen solutions, the
+    // capacity 0 disables the cache. It is cleared when the global best
+    // solution changes, as the local search depends on its cost
+    LocalSearchCache ls_cache_{ 0 };
+    // Warm start: if not empty the run starts from this solution, e.g. the
+    // best one found for a previous version of the instance. It is repaired
+    // if not feasible for the current instance
+    std::vector<uint32_t> initial_route_;
+    // If not empty the initial pheromone trails (dimension x dimension),
+    // e.g. from a checkpoint of a previous run
+    std::vector<double> initial_trails_;
 
     double initial_pheromone_ = 0;
     double min_pheromone_ = 0;
@@ -38,40 +131,117 @@ struct ACO {
     // restart_best_ -> the best ant since the last restart
     std::shared_ptr<Ant> restart_best_{ nullptr };
     int restart_best_found_iteration_ = 0;
+    int global_best_found_iteration_ = 0;
     int pheromone_reset_iteration_ = 0;
     int u_gb_ = 25;
 
     std::shared_ptr<Ant> iteration_best_{ nullptr };
+    // Stats of the last finished iteration
+    IterationStats iteration_stats_;
 
     // [m][p] = value of a heuristic for product p at market m
     std::vector<std::vector<double>> heuristic_;
+    // Random solutions used to compute the heuristic info, at the start and
+    // for the markets changed by an instance update
+    static constexpr int HeuristicTrials = 200;
+    static constexpr int ChangedMarketsHeuristicTrials = 50;
     std::vector<std::vector<uint32_t>> ant_phmem_samples_;
 
     // Callbacks
     std::function<callback_t> new_best_found_callback_{ nullptr };
+    std::function<callback_t> iteration_done_callback_{ nullptr };
+
+    // Each new global best solution is published here, so that another
+    // thread can read the current best one at any time without stopping
+    // (or blocking) the solver
+    BestSolutionBuffer anytime_best_;
 
 
-    ACO(TPP::Instance &instance);
+    ACO(const TPP::Instance &instance);
 
     /**
      * Runs the algorithm until stop_condition is reached.
      */
     void run(StopCondition *stop_condition);
 
-private:
+    /**
+     * Returns the current state, this should be called between the
+     * iterations, e.g. in the iteration_done_callback_.
+     */
+    AcoState get_state() const;
 
+    /**
+     * The next call to run() will continue from the given state instead of
+     * starting from scratch. If count_previous_iterations is true the stop
+     * condition includes the iterations performed before the state was
+     * saved.
+     */
+    void resume_from(AcoState state, bool count_previous_iterations = true);
+
+    /**
+     * Should be called after the instance was changed (see TPP::apply_delta)
+     * when the run is finished. The best solutions are rebuilt for the new
+     * data and repaired if needed, and the next call to run() continues with
+     * the current pheromone trails instead of starting from scratch. The
+     * stop condition of that run counts only its own iterations.
+     *
+     * The heuristic info is recomputed only for the changed_markets (as
+     * returned by TPP::apply_delta) and from fewer random solutions
+     * (ChangedMarketsHeuristicTrials) than at the start of the run.
+     *
+     * Returns the cost of the repaired global best solution.
+     */
+    int on_instance_changed(const std::vector<uint32_t> &changed_markets);
+
+    /**
+     * Initializes the pheromone memory and the heuristic info, this is
+     * called by run() but is also needed to use move_ant separately, e.g.
+     * in the benchmarks.
+     */
     void run_init();
 
+    /**
+     * Moves the ant to the next market selected according to the
+     * pheromone and the heuristic info.
+     */
+    void move_ant(Ant &ant);
+
+private:
+
+    // Polled by the local search to interrupt an iteration if the time is
+    // up or the computations were cancelled
+    const StopCondition *stop_condition_ = nullptr;
+    std::unique_ptr<AcoState> resume_state_;
+    std::chrono::steady_clock::time_point run_start_time_;
+    // If true the stop condition is moved forward by the iterations already
+    // performed, i.e. when resuming from a checkpoint
+    bool resume_counts_iterations_ = true;
+    // Buffers reused by move_ant
+    std::vector<uint32_t> cand_markets_;
+    std::vector<double> cand_values_;
+
+    void restore_state(const AcoState &state, StopCondition *stop_condition);
+
+    std::shared_ptr<Ant> make_ant(const std::vector<uint32_t> &route);
+
+    std::shared_ptr<Ant> make_feasible_ant(const std::vector<uint32_t> &route);
+
+    void publish_global_best();
+
     void calc_initial_pheromone();
 
     void build_ant_solutions();
 
-    void move_ant(Ant &ant);
-
     double calc_attractiveness(Ant &ant, size_t market);
 
     void init_heuristic_info();
 
+    /*
+     * Sets the rows of heuristic_ for the given markets to the average
+     * shares of the purchase costs of the random solutions spent at them.
+     */
+    void sample_heuristic_info(const std::vector<uint32_t> &markets, int trials);
+
     void update_u_gb() noexcept;
 
     /**
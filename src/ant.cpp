@@ -15,7 +15,7 @@ Ant::Ant(const TPP::Instance &instance)
 
 
 void Ant::move_to(size_t market) {
-    CHECK_F(market != 0, "Cannot move to depot");
+    DEBUG_CHECK_F(market != 0, "Cannot move to depot");
     solution_.push_back_market(market);
 
     if (solution_.is_valid()) {
@@ -30,21 +30,20 @@ int Ant::cost() const {
 
 
 /*
- * Returns a list of markets that are candidates for the next move. First it
- * tries to return only unvisited nearest neighbors but if at least 2 of them
- * are still remaining. Otherwise, it returns all the remaining unselected
- * markets.
+ * Sets cand to a list of markets that are candidates for the next move.
+ * First it tries to return only unvisited nearest neighbors but if at least
+ * 2 of them are still remaining. Otherwise, it returns all the remaining
+ * unselected markets.
  */
-const std::vector<uint32_t>&
-Ant::get_candidate_markets(size_t nn_count) noexcept {
+void Ant::get_candidate_markets(size_t nn_count,
+                                std::vector<uint32_t> &cand) noexcept {
     const auto current_market = solution_.route_.back();
 
-    static vector<uint32_t> cand;
     cand.reserve(nn_count);
     cand.clear();
-    const auto &all_nn = solution_.instance_.nn_lists_.at(current_market);
+    const auto &all_nn = DEBUG_AT(solution_.instance_.nn_lists_, current_market);
     for (auto i = 0u; i < nn_count; ++i) {
-        const auto market = all_nn.at(i);
+        const auto market = DEBUG_AT(all_nn, i);
         if (market != 0  // We do not want to add depot
             && !solution_.is_market_used(market)) {
             cand.push_back(market);
@@ -52,10 +51,9 @@ Ant::get_candidate_markets(size_t nn_count) noexcept {
     }
     // cand should contain at least 2 markets to allow some choice
     if (cand.size() > 1) {
-        return cand;
+        return ;
     }
     const auto unselected = solution_.get_unselected_markets();
     cand.resize(unselected.size());
     copy(begin(unselected), end(unselected), begin(cand));
-    return cand;
 }
@@ -27,12 +27,13 @@ struct Ant {
     size_t get_position() const noexcept { return solution_.route_.back(); }
 
     /**
-    * Returns a list of markets that are candidates for the next move. First it
-    * tries to return only unvisited nearest neighbors but if at least 2 of them
-    * are still remaining. Otherwise, it returns all the remaining unselected
-    * markets.
+    * Sets cand to a list of markets that are candidates for the next move.
+    * First it tries to return only unvisited nearest neighbors but if at
+    * least 2 of them are still remaining. Otherwise, it returns all the
+    * remaining unselected markets.
     */
-    const std::vector<uint32_t>& get_candidate_markets(size_t nn_count) noexcept;
+    void get_candidate_markets(size_t nn_count,
+                               std::vector<uint32_t> &cand) noexcept;
 
     std::vector<uint32_t>& get_route() noexcept { return solution_.route_; }
 };
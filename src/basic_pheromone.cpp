@@ -1,4 +1,5 @@
 #include "basic_pheromone.h"
+#include "logging.h"
 
 
 using namespace std;
@@ -18,13 +19,13 @@ BasicPheromone::BasicPheromone(uint32_t size, bool is_symmetric,
 
 
 double BasicPheromone::get_trail(uint32_t a, uint32_t b) const noexcept {
-    return trails_.at(a).at(b);
+    return DEBUG_AT(DEBUG_AT(trails_, a), b);
 }
 
 
 void BasicPheromone::increase(uint32_t from, uint32_t to, double delta) {
 
-    auto &val = trails_.at(from).at(to);
+    auto &val = DEBUG_AT(DEBUG_AT(trails_, from), to);
     val = min(max_value_, val + delta);
     if (is_symmetric_) {
         trails_[to][from] = val;
@@ -0,0 +1,81 @@
+#ifndef BEST_SOLUTION_BUFFER_H
+#define BEST_SOLUTION_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+struct PublishedSolution {
+    uint64_t version_ = 0;  // 0 if nothing was published yet
+    int cost_ = 0;
+    std::vector<uint32_t> route_;
+    int iteration_ = 0;
+    double time_ = 0;  // Seconds since the start of the run
+};
+
+
+/*
+ * A lock-free single-slot buffer holding the most recent solution, for a
+ * single writer (the solver) and a single reader thread at a time.
+ *
+ * This is a triple buffer: the writer fills its own back buffer and swaps
+ * it with the middle one, the reader swaps the middle buffer with its own
+ * front buffer if a newer solution was published. Neither side ever waits
+ * for the other, so e.g. a client can take the current best solution at a
+ * deadline without stopping the solver.
+ */
+struct BestSolutionBuffer {
+
+    /*
+     * Should be called only by the writer thread.
+     */
+    void publish(int cost, const std::vector<uint32_t> &route,
+                 int iteration, double time) {
+        auto &solution = buffers_[back_];
+        solution.version_ = ++published_;
+        solution.cost_ = cost;
+        solution.route_ = route;  // Reuses the capacity of the buffer
+        solution.iteration_ = iteration;
+        solution.time_ = time;
+        const auto prev = middle_.exchange(back_ | NEW_BIT,
+                                           std::memory_order_acq_rel);
+        back_ = prev & INDEX_MASK;
+    }
+
+    /*
+     * Returns the most recent solution, version_ is 0 if nothing was
+     * published yet. The reference is valid until the next call to read().
+     */
+    const PublishedSolution& read() noexcept {
+        if (middle_.load(std::memory_order_relaxed) & NEW_BIT) {
+            const auto prev = middle_.exchange(front_,
+                                               std::memory_order_acq_rel);
+            front_ = prev & INDEX_MASK;
+        }
+        return buffers_[front_];
+    }
+
+private:
+
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t NEW_BIT = 4;
+
+    // The padding keeps the fields used by the writer and by the reader in
+    // separate cache lines, alignas(64) is not used as the buffer is a part
+    // of the heap allocated ACO and C++14 new ignores such alignment
+    PublishedSolution buffers_[3];
+    char pad0_[64];
+    // The index of the middle buffer and NEW_BIT if it was not read yet
+    std::atomic<uint8_t> middle_{ 1 };
+    char pad1_[64];
+    // Owned by the writer
+    uint8_t back_ = 0;
+    uint64_t published_ = 0;
+    char pad2_[64];
+    // Owned by the reader
+    uint8_t front_ = 2;
+};
+
+
+#endif
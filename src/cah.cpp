@@ -1,5 +1,8 @@
 #include <numeric>
 #include <cmath>
+#include <thread>
+#include <memory>
+#include <random>
 
 #include "cah.h"
 #include "drop.h"
@@ -14,23 +17,157 @@ using namespace std;
 
 
 /**
- * This is an attempt to implement commodity adding heuristic, i.e. CAH
- * as described in
- * Boctor, Fayez F., Gilbert Laporte, and Jacques Renaud. "Heuristics for the
- * traveling purchaser problem." Computers & Operations Research 30.4 (2003):
- * 491-504.
+ * Keeps the costs of adding each of the unselected markets to a solution,
+ * i.e. the same values as returned by Solution::calc_market_add_cost, and
+ * updates them incrementally after a market is inserted.
+ *
+ * After market h is inserted between (i, j) only the purchase costs of the
+ * products which became cheaper have to be updated (for the markets offering
+ * these products) and the travel costs related to the new edges (i, h) and
+ * (h, j).
  */
-TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance) {
-    LOG_SCOPE_F(INFO, "CAH");
+struct MarketAddCostCache {
+    const Instance &instance_;
+    // [p] = a list of offers for product p, sorted by market id
+    vector<vector<ProductOffer>> product_offers_;
+    // [m] = change of the purchase cost if market m is added
+    vector<int> purchase_change_;
+    // [m] = min. increase of the travel cost if market m is added
+    vector<int> travel_change_;
+    // [m] = market after which market m should be inserted
+    vector<uint32_t> insert_after_;
 
-    Solution sol(instance);
-    LOG_F(INFO, "Req. demand: %d, start sol: %d",
-          instance.demands_.at(1), sol.demand_remaining_.at(1));
 
-    vector<size_t> products(instance.product_count_);
-    iota(begin(products), end(products), 0);
+    MarketAddCostCache(const Instance &instance)
+        : instance_(instance),
+          product_offers_(instance.product_count_),
+          purchase_change_(instance.dimension_, 0),
+          travel_change_(instance.dimension_, 0),
+          insert_after_(instance.dimension_, 0) {
 
-    shuffle_vector(products);
+        for (const auto &offers : instance.market_offers_) {
+            for (const auto &offer : offers) {
+                product_offers_.at(offer.product_id_).push_back(offer);
+            }
+        }
+    }
+
+
+    /**
+     * Calculates add costs for all the unselected markets from scratch.
+     *
+     * Complexity is O(M * max(K, M))
+     */
+    void init(const Solution &sol) {
+        for (auto m : sol.unselected_markets_) {
+            purchase_change_[m] = 0;
+            for (const auto &offer : instance_.market_offers_[m]) {
+                purchase_change_[m] += sol.calc_product_offer_add_cost(offer).first;
+            }
+            update_travel_change(sol, m);
+        }
+    }
+
+
+    int get_cost(uint32_t market_id) const noexcept {
+        return purchase_change_[market_id] + travel_change_[market_id];
+    }
+
+
+    /**
+     * Inserts market into the solution and updates the add costs of the
+     * remaining unselected markets.
+     */
+    void insert_market(Solution &sol, uint32_t market_id) {
+        const auto prev = insert_after_[market_id];
+        const auto index = sol.get_market_pos_in_route(prev) + 1;
+        const auto next = sol.route_[index % sol.route_.size()];
+
+        // The solution state before the insertion is needed to calculate
+        // how the purchase costs change
+        struct PriceChange {
+            uint16_t product_id_;
+            bool had_offer_;
+            int prev_price_;
+        };
+        vector<PriceChange> changes;
+        for (const auto &offer : instance_.market_offers_[market_id]) {
+            const auto &sol_offers = sol.product_offers_[offer.product_id_];
+            if (sol_offers.empty() || sol_offers.front().price_ > offer.price_) {
+                changes.push_back({ offer.product_id_, !sol_offers.empty(),
+                                    sol.purchase_costs_[offer.product_id_] });
+            }
+        }
+
+        sol.insert_market_at_pos(market_id, index);
+
+        for (const auto &change : changes) {
+            const auto new_price = sol.purchase_costs_[change.product_id_];
+            for (const auto &offer : product_offers_[change.product_id_]) {
+                const auto m = offer.market_id_;
+                if (sol.is_market_used(m)) {
+                    continue ;
+                }
+                const auto old_delta = !change.had_offer_
+                                     ? offer.price_ - change.prev_price_
+                                     : min(0, offer.price_ - change.prev_price_);
+                const auto new_delta = min(0, offer.price_ - new_price);
+                purchase_change_[m] += new_delta - old_delta;
+            }
+        }
+
+        for (auto m : sol.unselected_markets_) {
+            if (insert_after_[m] == prev) {
+                update_travel_change(sol, m);  // The best edge is gone
+            } else {
+                const auto c_m = instance_.get_travel_cost(market_id, m);
+                const auto via_prev = instance_.get_travel_cost(prev, m) + c_m
+                                    - instance_.get_travel_cost(prev, market_id);
+                const auto via_next = c_m + instance_.get_travel_cost(m, next)
+                                    - instance_.get_travel_cost(market_id, next);
+                if (via_prev < travel_change_[m]) {
+                    travel_change_[m] = via_prev;
+                    insert_after_[m] = prev;
+                }
+                if (via_next < travel_change_[m]) {
+                    travel_change_[m] = via_next;
+                    insert_after_[m] = market_id;
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Complexity is O(route length)
+     */
+    void update_travel_change(const Solution &sol, uint32_t market_id) {
+        const auto &route = sol.route_;
+        int min_increase = numeric_limits<int>::max();
+        auto curr = route.back();
+        for (auto next : route) {
+            const auto increase = instance_.get_travel_cost(curr, market_id)
+                                + instance_.get_travel_cost(market_id, next)
+                                - instance_.get_travel_cost(curr, next);
+            if (increase < min_increase) {
+                min_increase = increase;
+                insert_after_[market_id] = curr;
+            }
+            curr = next;
+        }
+        travel_change_[market_id] = min_increase;
+    }
+};
+
+
+/**
+ * Runs the CAH for the given order of products.
+ */
+TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance,
+                                         const vector<size_t> &products) {
+    LOG_SCOPE_F(INFO, "CAH");
+
+    Solution sol(instance);
 
     auto h0 = products.front();
 
@@ -54,33 +191,31 @@ TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance) {
     CHECK_F(best_market != 0, "Best market should not be the depot");
     sol.push_back_market(best_market);
 
+    MarketAddCostCache add_costs(instance);
+    add_costs.init(sol);
+
     for (auto h : products) {
         while (sol.demand_remaining_.at(h) > 0) {
             int min_cost = numeric_limits<int>::max();
             best_market = 0u;
-            Solution::MarketAddVerdict verdict;
 
-            for (auto m = 1u; m < instance.dimension_; ++m) {
-                if (sol.market_selected_.at(m)
-                        || instance.market_product_offers_.at(m).at(h).quantity_ == 0) {
+            for (const auto &offer : add_costs.product_offers_.at(h)) {
+                const auto m = offer.market_id_;
+                if (m == 0 || sol.market_selected_[m]) {
                     continue ;
                 }
-
-                const auto res = sol.calc_market_add_cost(m);
-                if (res.cost_change_ < min_cost) {
-                    min_cost = res.cost_change_;
+                const auto cost = add_costs.get_cost(m);
+                if (cost < min_cost) {
+                    min_cost = cost;
                     best_market = m;
-                    verdict = res;
                 }
             }
             CHECK_F(best_market != 0, "Best market cannot be depot");
-            sol.insert_market_at_pos(best_market, verdict.index_);
+            add_costs.insert_market(sol, best_market);
         }
     }
     LOG_F(INFO, "Cost before LS: %d", sol.cost_);
     CHECK_F(is_solution_valid(instance, sol.route_), "Sol should be valid");
-    std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    auto &rng = get_random_engine();
     auto improvement_found = false;
     do {
         improvement_found = false;
@@ -102,3 +237,106 @@ TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance) {
 
     return sol;
 }
+
+
+/**
+ * This is an attempt to implement commodity adding heuristic, i.e. CAH
+ * as described in
+ * Boctor, Fayez F., Gilbert Laporte, and Jacques Renaud. "Heuristics for the
+ * traveling purchaser problem." Computers & Operations Research 30.4 (2003):
+ * 491-504.
+ */
+TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance) {
+    vector<size_t> products(instance.product_count_);
+    iota(begin(products), end(products), 0);
+
+    shuffle_vector(products);
+
+    return commodity_adding_heuristic(instance, products);
+}
+
+
+/**
+ * Runs the CAH for orders_count random orders of products using up to
+ * threads_count threads and returns the best solution found.
+ *
+ * The orders are generated upfront in the calling thread so that the result
+ * depends only on the state of the random engine, not on the number of
+ * threads.
+ */
+TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance,
+                                         uint32_t orders_count,
+                                         uint32_t threads_count) {
+    CHECK_F(orders_count > 0, "At least one order of products is required");
+
+    vector<vector<size_t>> orders(orders_count);
+    for (auto &products : orders) {
+        products.resize(instance.product_count_);
+        iota(begin(products), end(products), 0);
+        shuffle_vector(products);
+    }
+
+    vector<unique_ptr<Solution>> solutions(orders_count);
+    auto worker = [&](uint32_t first, uint32_t step) {
+        for (auto i = first; i < orders_count; i += step) {
+            solutions[i] = make_unique<Solution>(
+                    commodity_adding_heuristic(instance, orders[i]));
+        }
+    };
+
+    threads_count = max(1u, min(threads_count, orders_count));
+    vector<thread> threads;
+    for (auto t = 1u; t < threads_count; ++t) {
+        threads.emplace_back(worker, t, threads_count);
+    }
+    worker(0, threads_count);
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    auto best = min_element(begin(solutions), end(solutions),
+                            [](const auto &a, const auto &b) {
+                                return a->cost_ < b->cost_;
+                            });
+    return **best;
+}
+
+
+void cah_run_tests(const TPP::Instance &instance, uint32_t seed) {
+    LOG_SCOPE_F(INFO, "cah_run_tests");
+
+    std::mt19937 rng(seed);
+    Solution sol(instance);
+    MarketAddCostCache add_costs(instance);
+    add_costs.init(sol);
+
+    while (!sol.unselected_markets_.empty()) {
+        for (auto m : sol.unselected_markets_) {
+            int purchase_change = 0;
+            for (const auto &offer : instance.market_offers_[m]) {
+                purchase_change += sol.calc_product_offer_add_cost(offer).first;
+            }
+            const auto verdict = sol.calc_market_add_cost(m);
+            const auto travel_change = verdict.cost_change_ - purchase_change;
+
+            CHECK_F(add_costs.purchase_change_[m] == purchase_change,
+                    "Market %u purchase change: %d, expected: %d",
+                    m, add_costs.purchase_change_[m], purchase_change);
+            CHECK_F(add_costs.travel_change_[m] == travel_change,
+                    "Market %u travel change: %d, expected: %d",
+                    m, add_costs.travel_change_[m], travel_change);
+            CHECK_F(add_costs.get_cost(m) == verdict.cost_change_,
+                    "Market %u add cost: %d, expected: %d",
+                    m, add_costs.get_cost(m), verdict.cost_change_);
+
+            const auto prev = add_costs.insert_after_[m];
+            CHECK_F(sol.is_market_used(prev), "Market %u should follow a route market", m);
+            const auto next = sol.route_[(sol.get_market_pos_in_route(prev) + 1) % sol.route_.size()];
+            CHECK_F(instance.get_travel_cost(prev, m) + instance.get_travel_cost(m, next)
+                    - instance.get_travel_cost(prev, next) == travel_change,
+                    "Market %u should be inserted at the cheapest edge", m);
+        }
+        const auto &unselected = sol.unselected_markets_;
+        add_costs.insert_market(sol, unselected[rng() % unselected.size()]);
+    }
+}
@@ -13,4 +13,19 @@
  */
 TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance);
 
+/**
+ * Runs the CAH for orders_count random orders of products using up to
+ * threads_count threads and returns the best solution found.
+ */
+TPP::Solution commodity_adding_heuristic(const TPP::Instance &instance,
+                                         uint32_t orders_count,
+                                         uint32_t threads_count);
+
+/**
+ * Checks if the incrementally updated add costs of the markets used by the
+ * CAH agree with Solution::calc_market_add_cost, while random markets are
+ * inserted into a solution for the instance.
+ */
+void cah_run_tests(const TPP::Instance &instance, uint32_t seed);
+
 #endif
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "checkpoint.h"
+#include "logging.h"
+
+using namespace std;
+
+
+static const char CHECKPOINT_MAGIC[8] = { 'T', 'P', 'P', 'C', 'K', 'P', 'T', '2' };
+
+
+/*
+ * Helpers for reading & writing the POD values and vectors of them, the
+ * vectors are prefixed with the number of elements. The native byte order
+ * is used as the checkpoints are meant to be resumed on the same machine.
+ */
+template<typename T>
+void write_value(FILE *out, const T &value) {
+    static_assert(is_trivially_copyable<T>::value, "POD value expected");
+    CHECK_F(fwrite(&value, sizeof(T), 1, out) == 1, "Cannot write checkpoint");
+}
+
+
+template<typename T>
+void write_vector(FILE *out, const vector<T> &vec) {
+    static_assert(is_trivially_copyable<T>::value, "POD values expected");
+    write_value(out, static_cast<uint64_t>(vec.size()));
+    if (!vec.empty()) {
+        CHECK_F(fwrite(vec.data(), sizeof(T), vec.size(), out) == vec.size(),
+                "Cannot write checkpoint");
+    }
+}
+
+
+template<typename T>
+void read_value(FILE *in, T &value) {
+    CHECK_F(fread(&value, sizeof(T), 1, in) == 1, "Truncated checkpoint");
+}
+
+
+template<typename T>
+void read_vector(FILE *in, vector<T> &vec) {
+    uint64_t size = 0;
+    read_value(in, size);
+    // A simple protection against a corrupted size
+    CHECK_F(size <= (1ull << 34) / sizeof(T), "Invalid checkpoint");
+    vec.resize(size);
+    if (size > 0) {
+        CHECK_F(fread(vec.data(), sizeof(T), size, in) == size,
+                "Truncated checkpoint");
+    }
+}
+
+
+void save_checkpoint(const string &path, const Checkpoint &checkpoint) {
+    const auto tmp_path = path + ".tmp";
+    auto out = fopen(tmp_path.c_str(), "wb");
+    CHECK_F(out != nullptr, "Cannot create checkpoint: %s", tmp_path.c_str());
+
+    const auto &s = checkpoint.state_;
+    CHECK_F(fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, out) == 1,
+            "Cannot write checkpoint");
+    write_value(out, checkpoint.trial_);
+    write_value(out, checkpoint.dimension_);
+    write_value(out, checkpoint.products_count_);
+    write_value(out, s.current_iteration_);
+    write_value(out, s.u_gb_);
+    write_value(out, s.restart_best_found_iteration_);
+    write_value(out, s.global_best_found_iteration_);
+    write_value(out, s.pheromone_reset_iteration_);
+    write_value(out, s.greedy_solution_value_);
+    write_value(out, s.global_best_cost_no_ls_);
+    write_vector(out, s.global_best_values_no_ls_);
+    write_value(out, s.initial_pheromone_);
+    write_value(out, s.min_pheromone_);
+    write_value(out, s.max_pheromone_);
+    write_vector(out, s.pheromone_trails_);
+    write_vector(out, s.heuristic_);
+    write_vector(out, s.global_best_route_);
+    write_vector(out, s.restart_best_route_);
+    write_value(out, static_cast<uint64_t>(s.ls_cache_entries_.size()));
+    for (const auto &entry : s.ls_cache_entries_) {
+        write_vector(out, entry.first);
+        write_vector(out, entry.second);
+    }
+    write_value(out, s.ls_cache_lookups_);
+    write_value(out, s.ls_cache_hits_);
+    write_value(out, s.rng_state_);
+
+    CHECK_F(fclose(out) == 0, "Cannot write checkpoint: %s", tmp_path.c_str());
+    CHECK_F(rename(tmp_path.c_str(), path.c_str()) == 0,
+            "Cannot rename %s to %s", tmp_path.c_str(), path.c_str());
+}
+
+
+Checkpoint load_checkpoint(const string &path) {
+    auto in = fopen(path.c_str(), "rb");
+    CHECK_F(in != nullptr, "Cannot open checkpoint: %s", path.c_str());
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    CHECK_F(fread(magic, sizeof(magic), 1, in) == 1
+            && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0,
+            "Not a checkpoint file (or unsupported version): %s", path.c_str());
+
+    Checkpoint checkpoint;
+    auto &s = checkpoint.state_;
+    read_value(in, checkpoint.trial_);
+    read_value(in, checkpoint.dimension_);
+    read_value(in, checkpoint.products_count_);
+    read_value(in, s.current_iteration_);
+    read_value(in, s.u_gb_);
+    read_value(in, s.restart_best_found_iteration_);
+    read_value(in, s.global_best_found_iteration_);
+    read_value(in, s.pheromone_reset_iteration_);
+    read_value(in, s.greedy_solution_value_);
+    read_value(in, s.global_best_cost_no_ls_);
+    read_vector(in, s.global_best_values_no_ls_);
+    read_value(in, s.initial_pheromone_);
+    read_value(in, s.min_pheromone_);
+    read_value(in, s.max_pheromone_);
+    read_vector(in, s.pheromone_trails_);
+    read_vector(in, s.heuristic_);
+    read_vector(in, s.global_best_route_);
+    read_vector(in, s.restart_best_route_);
+    uint64_t entries_count = 0;
+    read_value(in, entries_count);
+    CHECK_F(entries_count <= (1u << 24), "Invalid checkpoint");
+    s.ls_cache_entries_.resize(entries_count);
+    for (auto &entry : s.ls_cache_entries_) {
+        read_vector(in, entry.first);
+        read_vector(in, entry.second);
+    }
+    read_value(in, s.ls_cache_lookups_);
+    read_value(in, s.ls_cache_hits_);
+    read_value(in, s.rng_state_);
+    fclose(in);
+    return checkpoint;
+}
+
+
+CheckpointWriter::CheckpointWriter(string path)
+    : path_(move(path)),
+      writer_(&CheckpointWriter::write_loop, this) {
+}
+
+
+CheckpointWriter::~CheckpointWriter() {
+    close();
+}
+
+
+void CheckpointWriter::submit(Checkpoint checkpoint) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        pending_ = make_unique<Checkpoint>(move(checkpoint));
+    }
+    cv_.notify_one();
+}
+
+
+void CheckpointWriter::close() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (done_) {
+            return ;
+        }
+        done_ = true;
+    }
+    cv_.notify_one();
+    writer_.join();
+}
+
+
+void CheckpointWriter::write_loop() {
+    while (true) {
+        unique_ptr<Checkpoint> checkpoint;
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return pending_ || done_; });
+            if (!pending_) {
+                break ;  // done_ and nothing left to save
+            }
+            checkpoint = move(pending_);
+        }
+        save_checkpoint(path_, *checkpoint);
+        LOG_F(INFO, "Checkpoint saved, trial: %u, iteration: %d",
+              checkpoint->trial_, checkpoint->state_.current_iteration_);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "aco.h"
+
+
+/*
+ * A snapshot of a (long) run which allows to resume it after e.g. a crash
+ * or a job preemption.
+ */
+struct Checkpoint {
+    uint32_t trial_ = 0;
+    uint32_t dimension_ = 0;  // Of the instance, for a sanity check
+    uint32_t products_count_ = 0;
+    AcoState state_;
+};
+
+
+/*
+ * Saves the checkpoint in a binary format. The data are written to a
+ * temporary file which is then renamed, so a crash in the middle of
+ * writing never leaves a corrupted checkpoint.
+ */
+void save_checkpoint(const std::string &path, const Checkpoint &checkpoint);
+
+Checkpoint load_checkpoint(const std::string &path);
+
+
+/*
+ * Saves the checkpoints in a background thread so that the solver does not
+ * wait for the I/O. Only the newest checkpoint matters, so if the previous
+ * one was not saved yet it is replaced.
+ */
+struct CheckpointWriter {
+
+    explicit CheckpointWriter(std::string path);
+
+    ~CheckpointWriter();
+
+    void submit(Checkpoint checkpoint);
+
+    /*
+     * Saves the pending checkpoint (if any) and stops the writer thread.
+     */
+    void close();
+
+private:
+
+    std::string path_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unique_ptr<Checkpoint> pending_;
+    bool done_ = false;
+    std::thread writer_;
+
+    void write_loop();
+};
+
+
+#endif
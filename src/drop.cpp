@@ -4,12 +4,116 @@
 
 #include "drop.h"
 #include "logging.h"
+#include "profiler.h"
 #include "rand.h"
+#include "utils.h"
 
 using namespace std;
 using namespace TPP;
 
 
+MarketDontLookBits::MarketDontLookBits(const TPP::Instance &instance,
+                                       size_t nn_count)
+    : instance_(instance),
+      nn_count_(nn_count),
+      bits_(instance.dimension_, false),
+      market_selected_(instance.dimension_, false),
+      pred_(instance.dimension_, 0),
+      succ_(instance.dimension_, 0) {
+}
+
+
+/*
+ * Returns true if markets a and b offer at least one common product.
+ */
+bool have_common_products(const TPP::Instance &instance, uint32_t a, uint32_t b) {
+    const auto &b_offers = instance.market_product_offers_[b];
+    for (const auto &offer : instance.market_offers_[a]) {
+        if (b_offers[offer.product_id_].quantity_ > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Compares the solution with the state seen by the previous update and
+ * resets the bits of the markets which could have been affected by the
+ * changes.
+ *
+ * Complexity is O(M) if no market was added or removed, and
+ * O(M * K * (number of added / removed markets)) otherwise.
+ */
+void MarketDontLookBits::update(const TPP::Solution &sol) {
+    const auto &route = sol.route_;
+    const auto len = route.size();
+    const auto is_first_update = route_.empty();
+
+    vector<uint32_t> changed;  // Added or removed markets
+    if (!is_first_update) {
+        for (auto m : route) {
+            if (!market_selected_[m]) {
+                changed.push_back(m);
+                bits_[m] = false;
+            }
+        }
+        for (auto m : route_) {
+            if (!sol.market_selected_[m]) {
+                changed.push_back(m);
+            }
+            market_selected_[m] = false;
+        }
+    }
+    for (auto i = 0u; i < len; ++i) {
+        const auto m = route[i];
+        const auto p = route[(i + len - 1) % len];
+        const auto s = route[(i + 1) % len];
+        const auto same_neighbors = (p == pred_[m] && s == succ_[m])
+            || (instance_.is_symmetric_ && p == succ_[m] && s == pred_[m]);
+        if (!same_neighbors) {
+            bits_[m] = false;
+            pred_[m] = p;
+            succ_[m] = s;
+        }
+        market_selected_[m] = true;
+    }
+    if (!changed.empty()) {
+        for (auto m : route) {
+            if (!bits_[m]) {
+                continue ;
+            }
+            for (auto c : changed) {
+                if (have_common_products(instance_, c, m)) {
+                    bits_[m] = false;
+                    break ;
+                }
+            }
+        }
+    }
+    route_ = route;
+}
+
+
+/*
+ * Returns the unselected markets among the nn_count_ nearest neighbors of
+ * the market.
+ */
+void MarketDontLookBits::get_insertion_candidates(const TPP::Solution &sol,
+                                                  uint32_t market,
+                                                  vector<uint32_t> &candidates) const {
+    candidates.clear();
+    const auto &nn_list = instance_.nn_lists_[market];
+    const auto count = min(nn_count_, nn_list.size());
+    for (auto idx = 0u; idx < count; ++idx) {
+        const auto cand = nn_list[idx];
+        if (!sol.is_market_used(cand)) {
+            candidates.push_back(cand);
+        }
+    }
+}
+
+
 /**
  * This is an impl. of a "drop" heuristic in which a market is dropped from the
  * tour as soon as the decrease in traveling costs is greater than the increase
@@ -21,24 +125,40 @@ using namespace TPP;
  *
  * The complexity is O(M^2 * K) for the U-TPP but if no market is
  * dropped it will perform only O(M * max(K, M)) operations.
+ *
+ * If dlb is given the markets with don't look bits set are skipped.
  */
-int drop_heuristic(const TPP::Instance &instance, TPP::Solution &solution) {
+int drop_heuristic(const TPP::Instance &instance, TPP::Solution &solution,
+                   MarketDontLookBits *dlb) {
     //LOG_SCOPE_F(INFO, "drop_heuristic");
     const auto start_cost = solution.cost_;
     auto solution_changed = false;
+    if (dlb != nullptr) {
+        dlb->update(solution);
+    }
     for (auto i = 1u; i < solution.route_.size(); ++i) {
         const auto market_id = solution.route_.at(i);
+        if (dlb != nullptr && dlb->is_set(market_id)) {
+            continue ;
+        }
         const auto after = solution.calc_market_removal_cost(market_id,
                 /*validity_required=*/true);
+        PROFILE_COUNT("drop_moves_evaluated", 1);
 
         if (after.demand_satisfied_ && after.cost_change_ < 0) {
+            PROFILE_COUNT("drop_moves_accepted", 1);
             solution.remove_market_at_pos(i);
             solution_changed = true;
             --i;
+            if (dlb != nullptr) {
+                dlb->update(solution);
+            }
+        } else if (dlb != nullptr) {
+            dlb->set(market_id);
         }
     }
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, solution.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, solution.route_),
                 "Sol. should be valid");
     }
     return solution.cost_ - start_cost;
@@ -64,7 +184,7 @@ int drop_heuristic_randomized(const TPP::Instance &instance, TPP::Solution &solu
         }
     }
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, solution.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, solution.route_),
                 "Sol. should be valid");
     }
     return solution.cost_ - start_cost;
@@ -93,13 +213,13 @@ int insertion_heuristic(const TPP::Instance &instance, TPP::Solution &solution)
             total_cost_change += verdict.cost_change_;
 
             solution.insert_market_at_pos(cand, verdict.index_);
-            CHECK_F(prev_cost + verdict.cost_change_ == solution.cost_,
+            DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == solution.cost_,
                     "Updated cost should be OK, %d", solution.cost_);
             solution_changed = true;
         }
     }
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, route),
+        DEBUG_CHECK_F(is_solution_valid(instance, route),
                 "Sol. should be valid");
     }
     LOG_F(INFO, "Total cost change: %d", total_cost_change);
@@ -108,12 +228,49 @@ int insertion_heuristic(const TPP::Instance &instance, TPP::Solution &solution)
 }
 
 
+uint32_t repair_solution(const TPP::Instance &instance, TPP::Solution &solution) {
+    uint32_t inserted = 0;
+    while (!solution.is_valid()) {
+        auto best_cost = numeric_limits<int>::max();
+        auto best_market = 0u;
+        auto best_index = 0u;
+        for (auto market : solution.get_unselected_markets()) {
+            const auto &offers = instance.market_offers_[market];
+            const auto offers_missing = any_of(begin(offers), end(offers),
+                [&](const ProductOffer &offer) {
+                    return solution.demand_remaining_[offer.product_id_] > 0;
+                });
+            if (!offers_missing) {
+                continue ;
+            }
+            const auto verdict = solution.calc_market_add_cost(market);
+            if (verdict.cost_change_ < best_cost) {
+                best_cost = verdict.cost_change_;
+                best_market = market;
+                best_index = verdict.index_;
+            }
+        }
+        CHECK_F(best_market != 0, "Cannot satisfy the demand");
+        solution.insert_market_at_pos(best_market, best_index);
+        ++inserted;
+    }
+    return inserted;
+}
+
+
 /**
  * This heuristic drops a market from the solution and tries to insert one of
  * the unvisited ones as long as it yields cost reduction while maintaining
  * feasibility.
+ *
+ * If dlb is given the markets with don't look bits set are skipped and only
+ * the nearest neighbors of the removed market are considered for insertion.
+ *
+ * The moves are evaluated with calc_exchange_cost so the solution is
+ * modified only if an improving move is found.
  */
-int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol) {
+int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
+                       MarketDontLookBits *dlb) {
     LOG_SCOPE_F(INFO, "exchange_heuristic");
 
     LOG_F(INFO, "Start cost: %d", sol.cost_);
@@ -121,48 +278,62 @@ int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol) {
     auto total_cost_change = 0;
     auto unselected = sol.get_unselected_markets();
     auto solution_changed = false;
+    vector<uint32_t> nearest_unselected;
+    vector<uint32_t> removed(1);
+    if (dlb != nullptr) {
+        dlb->update(sol);
+    }
 
     const vector<size_t> markets_to_check(sol.route_.begin() + 1, sol.route_.end());
 
     for (const auto market_id : markets_to_check) {
-        const auto cost_before_removal = sol.cost_;
-        const auto market_pos = sol.get_market_pos_in_route(market_id);
-        sol.remove_market_at_pos(market_pos);
+        if (dlb != nullptr && dlb->is_set(market_id)) {
+            continue ;
+        }
+        if (dlb != nullptr) {
+            dlb->get_insertion_candidates(sol, market_id, nearest_unselected);
+        }
+        const auto &candidates = (dlb != nullptr) ? nearest_unselected : unselected;
 
+        removed[0] = market_id;
+        const auto removal = sol.calc_markets_removal(removed);
         bool found = false;
         // Look for another market to insert
-        for (auto cand : unselected) {
-            if ( !sol.check_market_satisfies_demand(cand) ) {
-                continue ;
-            }
-
-            const auto verdict = sol.calc_market_add_cost(cand);
+        for (auto cand : candidates) {
+            const auto verdict = sol.calc_exchange_cost(removal, cand,
+                    /*validity_required=*/true);
 
-            if (sol.cost_ + verdict.cost_change_ <= cost_before_removal
-                    && verdict.demand_satisfied_) {
-                LOG_F(INFO, "Cost of adding %zu is %d at pos %zu",
-                        cand, verdict.cost_change_, verdict.index_);
+            if (verdict.demand_satisfied_ && verdict.cost_change_ <= 0) {
+                LOG_F(INFO, "Cost of exchanging %zu with %u is %d at pos %u",
+                        market_id, cand, verdict.cost_change_, verdict.index_);
                 const auto prev_cost = sol.cost_;
                 total_cost_change += verdict.cost_change_;
 
-                sol.insert_market_at_pos(cand, verdict.index_);
+                sol.exchange_markets(removed, cand, verdict.index_);
 
-                CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
+                DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
                         "Updated cost should be OK, %d", sol.cost_);
                 LOG_F(INFO, "Cost now: %d", sol.cost_);
-                unselected.erase(find(begin(unselected), end(unselected), cand));
+                if (dlb == nullptr) {  // Otherwise the candidates are found using nn lists
+                    unselected.erase(find(begin(unselected), end(unselected), cand));
+                }
                 found = true;
                 break ;
             }
         }
-        if (!found) { // Restore solution to the previous state
-            sol.insert_market_at_pos(market_id, market_pos);
+        if (!found) {
+            if (dlb != nullptr) {
+                dlb->set(market_id);
+            }
         } else {
             solution_changed = true;
+            if (dlb != nullptr) {
+                dlb->update(sol);
+            }
         }
     }
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, sol.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, sol.route_),
                 "Sol. should be valid");
     }
     return total_cost_change;
@@ -173,7 +344,8 @@ int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol) {
  * This is similar to the exchange_heuristic but drops two consecutive markets
  * from the tour and tries to insert a single one from the unvisited.
  */
-int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol) {
+int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
+                              MarketDontLookBits *dlb) {
     LOG_SCOPE_F(INFO, "double_exchange_heuristic");
 
     LOG_F(INFO, "Start cost: %d", sol.cost_);
@@ -181,48 +353,52 @@ int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol)
     auto total_cost_change = 0;
     auto solution_changed = false;
     auto unselected = sol.get_unselected_markets();
+    vector<uint32_t> nearest_unselected;
+    vector<uint32_t> removed(2);
+    if (dlb != nullptr) {
+        dlb->update(sol);
+    }
 
     const auto route_copy = sol.route_;
 
     for (auto i = 1u; i + 1 < route_copy.size(); ++i) {
-        const auto cost_before_removal = sol.cost_;
         const auto market_1 = route_copy.at(i);
         const auto market_2 = route_copy.at(i + 1);
 
-        const auto pos_1 = sol.get_market_pos_in_route(market_1);
-        const auto pos_2 = sol.get_market_pos_in_route(market_2);
-
-        CHECK_F(pos_1 != sol.route_.size(), "pos_1 out of bounds");
-        CHECK_F(pos_2 != sol.route_.size(), "pos_1 out of bounds");
+        if (dlb != nullptr && dlb->is_set(market_1)) {
+            continue ;
+        }
+        DEBUG_CHECK_F(sol.is_market_used(market_1), "market_1 should be in the sol.");
+        DEBUG_CHECK_F(sol.is_market_used(market_2), "market_2 should be in the sol.");
 
-        if (pos_1 < pos_2) {
-            sol.remove_market_at_pos(pos_2);
-            sol.remove_market_at_pos(pos_1);
-        } else {
-            sol.remove_market_at_pos(pos_1);
-            sol.remove_market_at_pos(pos_2);
+        if (dlb != nullptr) {
+            dlb->get_insertion_candidates(sol, market_1, nearest_unselected);
         }
+        const auto &candidates = (dlb != nullptr) ? nearest_unselected : unselected;
+
+        removed[0] = market_1;
+        removed[1] = market_2;
+        const auto removal = sol.calc_markets_removal(removed);
         bool found = false;
         // Look for another market to insert
-        for (auto cand : unselected) {
-            if ( !sol.check_market_satisfies_demand(cand) ) {
-                continue ;
-            }
-            const auto verdict = sol.calc_market_add_cost(cand);
+        for (auto cand : candidates) {
+            const auto verdict = sol.calc_exchange_cost(removal, cand,
+                    /*validity_required=*/true);
 
-            if (sol.cost_ + verdict.cost_change_ < cost_before_removal
-                    && verdict.demand_satisfied_) {
-                LOG_F(INFO, "Cost of adding %zu is %d at pos %zu",
-                        cand, verdict.cost_change_, verdict.index_);
+            if (verdict.demand_satisfied_ && verdict.cost_change_ < 0) {
+                LOG_F(INFO, "Cost of exchanging %u, %u with %u is %d at pos %u",
+                        market_1, market_2, cand, verdict.cost_change_, verdict.index_);
                 const auto prev_cost = sol.cost_;
                 total_cost_change += verdict.cost_change_;
 
-                sol.insert_market_at_pos(cand, verdict.index_);
+                sol.exchange_markets(removed, cand, verdict.index_);
 
-                CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
+                DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
                         "Updated cost should be OK, %d", sol.cost_);
                 LOG_F(INFO, "Cost now: %d", sol.cost_);
-                unselected.erase(find(begin(unselected), end(unselected), cand));
+                if (dlb == nullptr) {  // Otherwise the candidates are found using nn lists
+                    unselected.erase(find(begin(unselected), end(unselected), cand));
+                }
                 found = true;
                 break ;
             }
@@ -230,19 +406,16 @@ int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol)
         if (found) {
             solution_changed = true;
             ++i; // Skip over market_2
-        } else { // Restore solution to the previous state
-            if (pos_1 < pos_2) {
-                sol.insert_market_at_pos(market_1, pos_1);
-                sol.insert_market_at_pos(market_2, pos_2);
-            } else {
-                sol.insert_market_at_pos(market_2, pos_2);
-                sol.insert_market_at_pos(market_1, pos_1);
+            if (dlb != nullptr) {
+                dlb->update(sol);
             }
+        } else if (dlb != nullptr) {
+            dlb->set(market_1);
         }
     }
     LOG_F(INFO, "Final cost: %d", sol.cost_);
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, sol.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, sol.route_),
                 "Sol. should be valid");
     }
     return total_cost_change;
@@ -263,42 +436,33 @@ int double_exchange_heuristic_r(const TPP::Instance &instance, TPP::Solution &so
     auto total_cost_change = 0;
     auto solution_changed = false;
     auto unselected = sol.get_unselected_markets();
+    vector<uint32_t> removed(2);
 
     //const auto route_copy = sol.route_;
     vector<size_t> route_copy(sol.route_.begin() + 1, sol.route_.end());
     shuffle_vector(route_copy);
 
     for (auto i = 0u; i + 1 < route_copy.size(); ++i) {
-        const auto cost_before_removal = sol.cost_;
-        const auto market_1 = route_copy.at(i);
-        const auto market_2 = route_copy.at(i + 1);
-
-        const auto pos_1 = sol.get_market_pos_in_route(market_1);
-        const auto pos_2 = sol.get_market_pos_in_route(market_2);
+        removed[0] = route_copy.at(i);
+        removed[1] = route_copy.at(i + 1);
 
-        CHECK_F(pos_1 != sol.route_.size(), "pos_1 out of bounds");
-        CHECK_F(pos_2 != sol.route_.size(), "pos_1 out of bounds");
+        DEBUG_CHECK_F(sol.is_market_used(removed[0]), "market_1 should be in the sol.");
+        DEBUG_CHECK_F(sol.is_market_used(removed[1]), "market_2 should be in the sol.");
 
-        if (pos_1 < pos_2) {
-            sol.remove_market_at_pos(pos_2);
-            sol.remove_market_at_pos(pos_1);
-        } else {
-            sol.remove_market_at_pos(pos_1);
-            sol.remove_market_at_pos(pos_2);
-        }
+        const auto removal = sol.calc_markets_removal(removed);
         bool found = false;
         // Look for another market to insert
         for (auto cand : unselected) {
-            const auto verdict = sol.calc_market_add_cost(cand);
+            const auto verdict = sol.calc_exchange_cost(removal, cand,
+                    /*validity_required=*/true);
 
-            if (sol.cost_ + verdict.cost_change_ < cost_before_removal
-                    && verdict.demand_satisfied_) {
+            if (verdict.demand_satisfied_ && verdict.cost_change_ < 0) {
                 const auto prev_cost = sol.cost_;
                 total_cost_change += verdict.cost_change_;
 
-                sol.insert_market_at_pos(cand, verdict.index_);
+                sol.exchange_markets(removed, cand, verdict.index_);
 
-                CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
+                DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
                         "Updated cost should be OK, %d", sol.cost_);
                 unselected.erase(find(begin(unselected), end(unselected), cand));
                 found = true;
@@ -308,18 +472,10 @@ int double_exchange_heuristic_r(const TPP::Instance &instance, TPP::Solution &so
         if (found) {
             solution_changed = true;
             ++i; // Skip over market_2
-        } else { // Restore solution to the previous state
-            if (pos_1 < pos_2) {
-                sol.insert_market_at_pos(market_1, pos_1);
-                sol.insert_market_at_pos(market_2, pos_2);
-            } else {
-                sol.insert_market_at_pos(market_2, pos_2);
-                sol.insert_market_at_pos(market_1, pos_1);
-            }
         }
     }
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, sol.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, sol.route_),
                 "Sol. should be valid");
     }
     return total_cost_change;
@@ -331,7 +487,7 @@ int double_exchange_heuristic_r(const TPP::Instance &instance, TPP::Solution &so
  * from the tour and tries to insert a single one from the unvisited.
  */
 int k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
-                         const uint32_t k) {
+                         const uint32_t k, MarketDontLookBits *dlb) {
     LOG_SCOPE_F(INFO, "k_exchange_heuristic");
 
     LOG_F(INFO, "Start cost: %d", sol.cost_);
@@ -342,54 +498,47 @@ int k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
 
     const auto route_copy = sol.route_;
 
-    struct MarketPosition {
-        size_t market_{ 0 };
-        size_t position_{ 0 };
-
-        bool operator<(const MarketPosition &rhs) {
-            return this->position_ < rhs.position_;;
-        }
-    };
-
-    vector<MarketPosition> rem_markets;
-    rem_markets.reserve(k);
+    vector<uint32_t> removed(k);
+    vector<uint32_t> nearest_unselected;
+    if (dlb != nullptr) {
+        dlb->update(sol);
+    }
 
     for (auto i = 1u; i + k - 1 < route_copy.size(); ++i) {
-        const auto cost_before_removal = sol.cost_;
+        const auto first_market = route_copy.at(i);
 
-        rem_markets.clear();
-        for (auto j = 0u; j < k; ++j) {
-            const auto market = route_copy.at(i + j);
-            const auto pos = sol.get_market_pos_in_route(market);
-            rem_markets.push_back(MarketPosition{ market, pos });
+        if (dlb != nullptr) {
+            if (dlb->is_set(first_market)) {
+                continue ;
+            }
+            dlb->get_insertion_candidates(sol, first_market, nearest_unselected);
         }
-        sort(begin(rem_markets), end(rem_markets));
+        const auto &candidates = (dlb != nullptr) ? nearest_unselected : unselected;
 
-        for (auto it = rem_markets.rbegin(); it != rem_markets.rend(); ++it) {
-            const auto &el = *it;
-            sol.remove_market_at_pos(el.position_);
+        for (auto j = 0u; j < k; ++j) {
+            removed[j] = route_copy.at(i + j);
         }
+        const auto removal = sol.calc_markets_removal(removed);
         bool found = false;
         // Look for another market to insert
-        for (auto cand : unselected) {
-            if ( !sol.check_market_satisfies_demand(cand) ) {
-                continue ;
-            }
-            const auto verdict = sol.calc_market_add_cost(cand);
+        for (auto cand : candidates) {
+            const auto verdict = sol.calc_exchange_cost(removal, cand,
+                    /*validity_required=*/true);
 
-            if (sol.cost_ + verdict.cost_change_ < cost_before_removal
-                    && verdict.demand_satisfied_) {
-                LOG_F(INFO, "Cost of adding %zu is %d at pos %zu",
-                        cand, verdict.cost_change_, verdict.index_);
+            if (verdict.demand_satisfied_ && verdict.cost_change_ < 0) {
+                LOG_F(INFO, "Cost of exchanging %u markets with %u is %d at pos %u",
+                        k, cand, verdict.cost_change_, verdict.index_);
                 const auto prev_cost = sol.cost_;
                 total_cost_change += verdict.cost_change_;
 
-                sol.insert_market_at_pos(cand, verdict.index_);
+                sol.exchange_markets(removed, cand, verdict.index_);
 
-                CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
+                DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == sol.cost_,
                         "Updated cost should be OK, %d", sol.cost_);
                 LOG_F(INFO, "Cost now: %d", sol.cost_);
-                unselected.erase(find(begin(unselected), end(unselected), cand));
+                if (dlb == nullptr) {  // Otherwise the candidates are found using nn lists
+                    unselected.erase(find(begin(unselected), end(unselected), cand));
+                }
                 found = true;
                 break ;
             }
@@ -397,17 +546,114 @@ int k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
         if (found) {
             solution_changed = true;
             i += k - 1; // Skip over removed markets
-        } else { // Restore solution to the previous state
-            for (auto it = rem_markets.begin(); it != rem_markets.end(); ++it) {
-                const auto &el = *it;
-                sol.insert_market_at_pos(el.market_, el.position_);
+            if (dlb != nullptr) {
+                dlb->update(sol);
             }
+        } else if (dlb != nullptr) {
+            dlb->set(first_market);
         }
     }
     LOG_F(INFO, "Final cost: %d", sol.cost_);
     if (solution_changed) {
-        CHECK_F(is_solution_valid(instance, sol.route_),
+        DEBUG_CHECK_F(is_solution_valid(instance, sol.route_),
                 "Sol. should be valid");
     }
     return total_cost_change;
 }
+
+
+struct ExchangeMove {
+    int cost_change_{ 0 };
+    uint32_t first_pos_{ 0 };  // Position of the first of the removed markets
+    uint32_t market_{ 0 };  // The market to insert
+    uint32_t index_{ 0 };  // Where to insert, see calc_exchange_cost
+};
+
+
+/*
+ * Returns the best improving move in which k consecutive markets starting at
+ * one of the positions [first_pos, last_pos) are replaced with one of the
+ * candidates. If no improving move exists the returned cost_change_ is 0.
+ */
+ExchangeMove find_best_exchange(const TPP::Solution &sol, uint32_t k,
+                                const vector<uint32_t> &candidates,
+                                size_t first_pos, size_t last_pos) {
+    ExchangeMove best;
+    vector<uint32_t> removed(k);
+    for (auto pos = first_pos; pos < last_pos; ++pos) {
+        copy_n(sol.route_.begin() + pos, k, removed.begin());
+        const auto removal = sol.calc_markets_removal(removed);
+
+        for (auto cand : candidates) {
+            const auto verdict = sol.calc_exchange_cost(removal, cand,
+                    /*validity_required=*/true);
+            if (verdict.demand_satisfied_ && verdict.cost_change_ < best.cost_change_) {
+                best = ExchangeMove{ verdict.cost_change_,
+                                     static_cast<uint32_t>(pos),
+                                     cand, verdict.index_ };
+            }
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Best-improvement version of the k_exchange_heuristic: all the moves in which
+ * k consecutive markets are replaced with a single unselected one are
+ * evaluated and the best is applied. This is repeated as long as an improving
+ * move exists.
+ *
+ * The route positions are split into chunks scanned in parallel by the
+ * threads of the pool (or by the calling thread). The solution is only read
+ * during the scan, and the ties are broken by position so the result does
+ * not depend on the number of threads.
+ *
+ * A single scan has O(M^2 * max(K, M)) complexity.
+ */
+int best_k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
+                              const uint32_t k, WorkerPool *pool) {
+    LOG_SCOPE_F(INFO, "best_k_exchange_heuristic");
+
+    const auto start_cost = sol.cost_;
+    vector<ExchangeMove> chunk_best(pool != nullptr ? pool->size() : 1u);
+
+    while (true) {
+        const auto &candidates = sol.unselected_markets_;
+        const auto first_pos = 1u;
+        const auto last_pos = (sol.route_.size() >= k + 1) ? sol.route_.size() - k + 1 : 1u;
+
+        fill(begin(chunk_best), end(chunk_best), ExchangeMove{});
+        if (pool != nullptr) {
+            pool->parallel_for(first_pos, last_pos,
+                               [&](size_t chunk_first, size_t chunk_last, uint32_t chunk) {
+                                   chunk_best[chunk] = find_best_exchange(sol, k, candidates,
+                                                                          chunk_first, chunk_last);
+                               });
+        } else {
+            chunk_best[0] = find_best_exchange(sol, k, candidates, first_pos, last_pos);
+        }
+        // The chunks are ordered by position so the first best is kept
+        ExchangeMove best;
+        for (const auto &move : chunk_best) {
+            if (move.cost_change_ < best.cost_change_) {
+                best = move;
+            }
+        }
+        if (best.cost_change_ >= 0) {
+            break ;
+        }
+        const vector<uint32_t> removed(sol.route_.begin() + best.first_pos_,
+                                       sol.route_.begin() + best.first_pos_ + k);
+        const auto prev_cost = sol.cost_;
+        sol.exchange_markets(removed, best.market_, best.index_);
+        DEBUG_CHECK_F(prev_cost + best.cost_change_ == sol.cost_,
+                "Updated cost should be OK, %d", sol.cost_);
+    }
+    if (sol.cost_ != start_cost) {
+        DEBUG_CHECK_F(is_solution_valid(instance, sol.route_),
+                "Sol. should be valid");
+    }
+    LOG_F(INFO, "Final cost: %d", sol.cost_);
+    return sol.cost_ - start_cost;
+}
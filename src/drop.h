@@ -4,6 +4,53 @@
 #include "tpp.h"
 #include "tpp_solution.h"
 #include "logging.h"
+#include "worker_pool.h"
+
+
+/**
+ * Market-level don't look bits used by the drop & exchange heuristics.
+ *
+ * The bit is set for a market if an attempt to remove (exchange) it from the
+ * route failed. The bits are kept across the calls within a single local
+ * search invocation and a bit is reset only if the market's neighbors in the
+ * route changed or a market offering some of the same products was added or
+ * removed, i.e. when the cost of its removal could have changed.
+ *
+ * Each heuristic should use its own MarketDontLookBits object.
+ */
+struct MarketDontLookBits {
+    const TPP::Instance &instance_;
+    // How many nearest neighbors of a removed market are checked when
+    // looking for a market to insert in its place
+    size_t nn_count_;
+    std::vector<uint8_t> bits_;
+    // The state of the solution seen by the last update
+    std::vector<uint32_t> route_;
+    std::vector<uint8_t> market_selected_;
+    std::vector<uint32_t> pred_;
+    std::vector<uint32_t> succ_;
+
+
+    MarketDontLookBits(const TPP::Instance &instance, size_t nn_count=50);
+
+    bool is_set(uint32_t market) const noexcept { return bits_[market]; }
+
+    void set(uint32_t market) noexcept { bits_[market] = true; }
+
+    /*
+     * Compares the solution with the state seen by the previous update and
+     * resets the bits of the markets which could have been affected by the
+     * changes.
+     */
+    void update(const TPP::Solution &sol);
+
+    /*
+     * Returns the unselected markets among the nn_count_ nearest neighbors of
+     * the market.
+     */
+    void get_insertion_candidates(const TPP::Solution &sol, uint32_t market,
+                                  std::vector<uint32_t> &candidates) const;
+};
 
 
 /**
@@ -14,8 +61,11 @@
  * The 'solution' is modified in place if an improvement is found.
  *
  * Returns a change in total solution cost, i.e. improvement.
+ *
+ * If dlb is given the markets with don't look bits set are skipped.
  */
-int drop_heuristic(const TPP::Instance &instance, TPP::Solution &solution);
+int drop_heuristic(const TPP::Instance &instance, TPP::Solution &solution,
+                   MarketDontLookBits *dlb=nullptr);
 
 
 int drop_heuristic_randomized(const TPP::Instance &instance, TPP::Solution &solution);
@@ -27,13 +77,34 @@ int drop_heuristic_randomized(const TPP::Instance &instance, TPP::Solution &solu
 int insertion_heuristic(const TPP::Instance &instance, TPP::Solution &solution);
 
 
-int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &solution);
+/**
+ * Makes an infeasible solution feasible by inserting markets which offer
+ * the missing products, each time the one with the lowest cost of insertion
+ * is selected. This is used e.g. for solutions found for a slightly
+ * different instance.
+ *
+ * Returns the number of inserted markets.
+ */
+uint32_t repair_solution(const TPP::Instance &instance, TPP::Solution &solution);
+
+
+/**
+ * This heuristic drops a market from the solution and tries to insert one of
+ * the unvisited ones as long as it yields cost reduction while maintaining
+ * feasibility.
+ *
+ * If dlb is given the markets with don't look bits set are skipped and only
+ * the nearest neighbors of the removed market are considered for insertion.
+ */
+int exchange_heuristic(const TPP::Instance &instance, TPP::Solution &solution,
+                       MarketDontLookBits *dlb=nullptr);
 
 /**
  * This is similar to the exchange_heuristic but drops two consecutive markets
  * from the tour and tries to insert a single one from the unvisited.
  */
-int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol);
+int double_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
+                              MarketDontLookBits *dlb=nullptr);
 
 /**
  * This is similar to the exchange_heuristic but drops two consecutive markets
@@ -48,7 +119,21 @@ int double_exchange_heuristic_r(const TPP::Instance &instance, TPP::Solution &so
  * from the tour and tries to insert a single one from the unvisited.
  */
 int k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
-                         const uint32_t k);
+                         const uint32_t k, MarketDontLookBits *dlb=nullptr);
+
+/**
+ * Best-improvement version of the k_exchange_heuristic: all the moves in which
+ * k consecutive markets are replaced with a single unselected one are
+ * evaluated and the best is applied. This is repeated as long as an improving
+ * move exists.
+ *
+ * The route positions are split into chunks scanned in parallel by the
+ * threads of the pool, or by the calling thread if pool is nullptr. The
+ * solution is only read during the scan, and the result does not depend on
+ * the number of threads.
+ */
+int best_k_exchange_heuristic(const TPP::Instance &instance, TPP::Solution &sol,
+                              const uint32_t k, WorkerPool *pool=nullptr);
 
 
 
@@ -72,14 +157,14 @@ int insertion_heuristic(const TPP::Instance &instance, TPP::Solution &solution,
             total_cost_change += verdict.cost_change_;
 
             solution.insert_market_at_pos(cand, verdict.index_);
-            CHECK_F(prev_cost + verdict.cost_change_ == solution.cost_,
+            DEBUG_CHECK_F(prev_cost + verdict.cost_change_ == solution.cost_,
                     "Updated cost should be OK, %d", solution.cost_);
-            CHECK_F(is_solution_valid(instance, solution.route_),
+            DEBUG_CHECK_F(is_solution_valid(instance, solution.route_),
                     "Sol should be valid");
         }
     }
-    CHECK_F(is_solution_valid(instance, route), "Sol. should be valid");
-    CHECK_F(solution.is_valid(), "Sol. should be valid");
+    DEBUG_CHECK_F(is_solution_valid(instance, route), "Sol. should be valid");
+    DEBUG_CHECK_F(solution.is_valid(), "Sol. should be valid");
     LOG_F(INFO, "Total cost change: %d", total_cost_change);
     LOG_F(INFO, "New sol. cost: %d", solution.cost_);
     return total_cost_change;
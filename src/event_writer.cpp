@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <unistd.h>
+
+#include "event_writer.h"
+#include "logging.h"
+
+using namespace std;
+
+
+EventWriter::EventWriter(size_t queue_capacity)
+    : queue_(queue_capacity) {
+}
+
+
+EventWriter::~EventWriter() {
+    close();
+}
+
+
+void EventWriter::open(const string &target) {
+    CHECK_F(!is_open(), "Event writer is already open");
+    CHECK_F(!target.empty(), "Events target should not be empty");
+
+    const auto is_fd = all_of(begin(target), end(target),
+                              [](char c) { return isdigit(c); });
+    if (is_fd) {
+        // dup so that closing the stream does not close e.g. the stdout
+        const auto fd = dup(stoi(target));
+        CHECK_F(fd >= 0, "Cannot use file descriptor: %s", target.c_str());
+        out_ = fdopen(fd, "w");
+    } else {
+        out_ = fopen(target.c_str(), "w");
+    }
+    CHECK_F(out_ != nullptr, "Cannot open events output: %s", target.c_str());
+
+    done_ = false;
+    writer_ = thread(&EventWriter::write_loop, this);
+}
+
+
+void EventWriter::push(uint32_t trial, const IterationStats &stats) noexcept {
+    if (!queue_.try_push({ trial, stats })) {
+        ++dropped_;
+    }
+}
+
+
+void EventWriter::close() {
+    if (!is_open()) {
+        return ;
+    }
+    done_ = true;
+    writer_.join();
+    fclose(out_);
+    out_ = nullptr;
+}
+
+
+void EventWriter::write_loop() {
+    Event event;
+    while (true) {
+        // Read done_ before draining so that no event pushed before close()
+        // is lost
+        const auto done = done_.load();
+        auto written = false;
+        while (queue_.try_pop(event)) {
+            write_event(event);
+            written = true;
+        }
+        if (written) {
+            fflush(out_);
+        }
+        if (done) {
+            break ;
+        }
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+}
+
+
+void EventWriter::write_event(const Event &event) {
+    const auto &s = event.stats_;
+    fprintf(out_,
+            "{\"type\":\"iteration\",\"trial\":%u,\"iteration\":%d,"
+            "\"iteration_time_us\":%.1f,\"construction_time_us\":%.1f,"
+            "\"ls_time_us\":%.1f,\"iteration_best\":%d,\"global_best\":%d,",
+            event.trial_, s.iteration_,
+            s.iteration_time_us_, s.construction_time_us_,
+            s.ls_time_us_, s.iteration_best_cost_, s.global_best_cost_);
+    if (s.branching_factor_ >= 0) {
+        fprintf(out_, "\"branching_factor\":%.6f,", s.branching_factor_);
+    } else {
+        fprintf(out_, "\"branching_factor\":null,");
+    }
+    fprintf(out_, "\"reset\":%s}\n", s.pheromone_reset_ ? "true" : "false");
+}
@@ -0,0 +1,67 @@
+#ifndef EVENT_WRITER_H
+#define EVENT_WRITER_H
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "aco.h"
+#include "spsc_queue.h"
+
+
+/*
+ * Writes the per-iteration statistics of the ACO as a stream of JSON
+ * objects, one per line (NDJSON).
+ *
+ * The solver only pushes the raw statistics to a lock-free queue, the
+ * formatting and the I/O are done by a background thread. If the writer
+ * cannot keep up and the queue is full the event is dropped (and counted)
+ * instead of blocking the solver.
+ */
+struct EventWriter {
+    uint64_t dropped_ = 0;
+
+
+    explicit EventWriter(size_t queue_capacity = 1 << 14);
+
+    ~EventWriter();
+
+    /*
+     * Opens the output and starts the writer thread. The target is either
+     * a path to a file or a number of an already open file descriptor,
+     * e.g. 1 for the stdout.
+     */
+    void open(const std::string &target);
+
+    bool is_open() const noexcept { return out_ != nullptr; }
+
+    /*
+     * Called by the solver thread, never blocks.
+     */
+    void push(uint32_t trial, const IterationStats &stats) noexcept;
+
+    /*
+     * Writes the remaining events and closes the output.
+     */
+    void close();
+
+private:
+
+    struct Event {
+        uint32_t trial_;
+        IterationStats stats_;
+    };
+
+    FILE *out_ = nullptr;
+    SpscQueue<Event> queue_;
+    std::atomic<bool> done_{ false };
+    std::thread writer_;
+
+    void write_loop();
+
+    void write_event(const Event &event);
+};
+
+
+#endif
@@ -2,6 +2,7 @@
 #include <limits>
 #include <algorithm>
 #include <numeric>
+#include <queue>
 
 #include "logging.h"
 #include "gsh.h"
@@ -86,9 +87,47 @@ vector<vector<int>> calc_market_product_prices(const TPP::Instance& instance,
 }
 
 
+/*
+ * Returns the max. savings of inserting market h into one of the route's
+ * edges, i.e. max over (i, j) of c_ij - c_ih - c_hj, together with the first
+ * market (i) of the best edge.
+ *
+ * Complexity is O(route length)
+ */
+pair<int, uint32_t> calc_best_edge_savings(const TPP::Instance &instance,
+                                           const vector<uint32_t> &route,
+                                           uint32_t h) {
+    auto best_savings = numeric_limits<int>::min();
+    auto best_i = route.back();
+    auto i = route.back();
+    for (auto j : route) {
+        const auto savings = instance.get_travel_cost(i, j)
+                           - instance.get_travel_cost(i, h)
+                           - instance.get_travel_cost(h, j);
+        if (savings > best_savings) {
+            best_savings = savings;
+            best_i = i;
+        }
+        i = j;
+    }
+    return make_pair(best_savings, best_i);
+}
+
+
 /*
  * This assumes that TPP instance is uncapacitated, i.e. each supplier (market)
  * has unlimited amount of a product or does not offer it at all.
+ *
+ * The savings of the unselected markets are kept in a max-heap and updated
+ * incrementally, i.e. after a market h is inserted between (i, j) only the
+ * travel savings related to the new edges (i, h), (h, j) and the purchase
+ * savings related to the products which became cheaper are recalculated.
+ * The heap entries are invalidated lazily - an entry is skipped if its value
+ * does not match the current savings of a market.
+ *
+ * The ties are broken as in the full rescan of the (edge, market) pairs,
+ * i.e. the edges are scanned in the route order starting with the closing
+ * edge (route.back(), route[0]) and then the markets in the order of ids.
  */
 TPP::Solution calc_gsh_solution(const TPP::Instance& instance) {
     CHECK_F(instance.is_capacitated_ == false,
@@ -98,6 +137,18 @@ TPP::Solution calc_gsh_solution(const TPP::Instance& instance) {
 
     int super_price = -1;
     const auto market_product_prices = calc_market_product_prices(instance, &super_price);
+    const auto products = instance.needed_products_.size();
+
+    // [k] = a list of (market, price) for the k-th required product
+    vector<vector<pair<uint32_t, int>>> product_market_prices(products);
+    for (auto m = 1u; m < instance.dimension_; ++m) {
+        const auto &prices = market_product_prices[m];
+        for (auto k = 0u; k < products; ++k) {
+            if (prices[k] != super_price) {
+                product_market_prices[k].emplace_back(m, prices[k]);
+            }
+        }
+    }
 
     TPP::Solution sol(instance);
 
@@ -127,14 +178,209 @@ TPP::Solution calc_gsh_solution(const TPP::Instance& instance) {
     LOG_F(INFO, "market: %zu, max_products: %d, min_total_cost: %d",
           chosen_market_id, max_products, min_total_cost);
 
-    vector<size_t> unselected(instance.dimension_ - 1);
+    sol.push_back_market(chosen_market_id);
+
+    // [i] = price for product i
+    vector<int> prices_in_sol{ market_product_prices.at(chosen_market_id) };
+
+    // For each market h: [h] = max. travel savings of inserting h into the
+    // route and the first market of the corresponding edge
+    vector<int> edge_savings(instance.dimension_, 0);
+    vector<uint32_t> edge_start(instance.dimension_, 0);
+    // [h] = sum of max(0, prices_in_sol[k] - price of k at h)
+    vector<int> price_savings(instance.dimension_, 0);
+    // [i] = the position of the edge (i, next of i) in the order of the scan,
+    // i.e. 0 for the closing edge of the route
+    vector<uint32_t> edge_rank(instance.dimension_, 0);
+    auto update_edge_ranks = [&]() {
+        const auto len = sol.route_.size();
+        for (auto pos = 0u; pos < len; ++pos) {
+            edge_rank[sol.route_[pos]] = static_cast<uint32_t>((pos + 1) % len);
+        }
+    };
+    update_edge_ranks();
+    // True if inserting h into the edge starting at i is preferred over its
+    // current best edge
+    auto is_better_edge = [&](uint32_t h, int savings, uint32_t i) {
+        return savings > edge_savings[h]
+            || (savings == edge_savings[h] && edge_rank[i] < edge_rank[edge_start[h]]);
+    };
+
+    using entry_t = pair<int, uint32_t>;  // (savings, market)
+    priority_queue<entry_t> heap;
+
+    for (auto h : sol.unselected_markets_) {
+        const auto best_edge = calc_best_edge_savings(instance, sol.route_, h);
+        edge_savings[h] = best_edge.first;
+        edge_start[h] = best_edge.second;
+        price_savings[h] = Vec::calc_diff_max_0_sum(prices_in_sol,
+                                                    market_product_prices[h]);
+        heap.emplace(edge_savings[h] + price_savings[h], h);
+    }
+
+    vector<uint8_t> touched(instance.dimension_, false);
+    vector<uint32_t> touched_markets;
+    touched_markets.reserve(instance.dimension_);
+    vector<uint32_t> ties;
+
+    auto is_stale = [&](const entry_t &entry) {
+        const auto h = entry.second;
+        return sol.is_market_used(h) || entry.first != edge_savings[h] + price_savings[h];
+    };
+
+    while (!heap.empty()) {
+        const auto top = heap.top();
+        heap.pop();
+
+        if (is_stale(top)) {
+            continue ;
+        }
+        const auto best_savings = top.first;
+        if (best_savings <= 0) {
+            break ;
+        }
+        // The markets with the same savings, the one whose edge comes first
+        // in the scan is selected
+        auto best_h = top.second;
+        ties.clear();
+        while (!heap.empty() && heap.top().first == best_savings) {
+            const auto entry = heap.top();
+            heap.pop();
+            if (is_stale(entry) || entry.second == best_h) {
+                continue ;
+            }
+            auto h = entry.second;
+            const auto h_rank = edge_rank[edge_start[h]];
+            const auto best_rank = edge_rank[edge_start[best_h]];
+            if (h_rank < best_rank || (h_rank == best_rank && h < best_h)) {
+                swap(h, best_h);
+            }
+            ties.push_back(h);
+        }
+        for (auto h : ties) {
+            if (h != best_h) {
+                heap.emplace(best_savings, h);
+            }
+        }
+        const auto best_i = edge_start[best_h];
+        LOG_F(INFO, "Savings found: %d for h: %u after i: %u", best_savings, best_h, best_i);
+
+        const auto index = sol.get_market_pos_in_route(best_i) + 1;
+        const auto best_j = sol.route_[index % sol.route_.size()];
+        sol.insert_market_at_pos(best_h, index);
+        update_edge_ranks();
+
+        touched_markets.clear();
+        auto mark_touched = [&](uint32_t h) {
+            if (!touched[h]) {
+                touched[h] = true;
+                touched_markets.push_back(h);
+            }
+        };
+
+        // Travel savings - only edges (best_i, best_h) and (best_h, best_j)
+        // are new, and (best_i, best_j) is gone
+        for (auto h : sol.unselected_markets_) {
+            if (edge_start[h] == best_i) {
+                const auto best_edge = calc_best_edge_savings(instance, sol.route_, h);
+                edge_savings[h] = best_edge.first;
+                edge_start[h] = best_edge.second;
+                mark_touched(h);
+            } else {
+                const auto c_ih = instance.get_travel_cost(best_i, h);
+                const auto c_hh = instance.get_travel_cost(best_h, h);
+                const auto c_hj = instance.get_travel_cost(h, best_j);
+                const auto via_i = instance.get_travel_cost(best_i, best_h) - c_ih - c_hh;
+                const auto via_j = instance.get_travel_cost(best_h, best_j) - c_hh - c_hj;
+                if (is_better_edge(h, via_i, best_i)) {
+                    edge_savings[h] = via_i;
+                    edge_start[h] = best_i;
+                    mark_touched(h);
+                }
+                if (is_better_edge(h, via_j, best_h)) {
+                    edge_savings[h] = via_j;
+                    edge_start[h] = best_h;
+                    mark_touched(h);
+                }
+            }
+        }
+
+        // Purchase savings - only for the products which are now cheaper
+        const auto &h_prices = market_product_prices.at(best_h);
+        for (auto k = 0u; k < products; ++k) {
+            const auto old_price = prices_in_sol[k];
+            const auto new_price = h_prices[k];
+            if (new_price >= old_price) {
+                continue ;
+            }
+            prices_in_sol[k] = new_price;
+
+            for (const auto &market_price : product_market_prices[k]) {
+                const auto h = market_price.first;
+                const auto price = market_price.second;
+                if (price < old_price && !sol.is_market_used(h)) {
+                    price_savings[h] -= (old_price - price) - max(0, new_price - price);
+                    mark_touched(h);
+                }
+            }
+        }
+
+        for (auto h : touched_markets) {
+            heap.emplace(edge_savings[h] + price_savings[h], h);
+            touched[h] = false;
+        }
+    }
+
+    assert(is_solution_valid(instance, sol.route_));
+    LOG_F(INFO, "Autocalculated sol cost: %d", sol.cost_);
+    auto cost = calc_solution_cost(instance, sol.route_);
+    LOG_F(INFO, "Final GSH sol cost: %d", cost);
+    LOG_F(INFO, "Final GSH sol: %s", container_to_string(sol.route_).c_str());
+    sol.cost_ = cost;
+    return sol;
+}
+
+
+/*
+ * The GSH which rescans all the (edge, unselected market) pairs to find the
+ * best insertion in each step, i.e. O(n^2) per step. Used as a reference by
+ * gsh_run_tests.
+ */
+TPP::Solution calc_gsh_solution_rescan(const TPP::Instance& instance) {
+    int super_price = -1;
+    const auto market_product_prices = calc_market_product_prices(instance, &super_price);
+
+    TPP::Solution sol(instance);
+
+    // Find a market with most products at the lowest total price
+    int max_products = 0;
+    int min_total_cost = numeric_limits<int>::max();
+    size_t chosen_market_id = 0;
+    size_t market_id = 0;
+    for (const auto &prices: market_product_prices) {
+        int products_available = 0;
+        int total_cost = 0;
+        for (auto price : prices) {
+            if (price != super_price) {
+                ++products_available;
+                total_cost += price;
+            }
+        }
+        if (products_available > max_products
+            || (products_available == max_products
+                && min_total_cost > total_cost)) {
+            max_products = products_available;
+            min_total_cost = total_cost;
+            chosen_market_id = market_id;
+        }
+        ++market_id;
+    }
+    vector<uint32_t> unselected(instance.dimension_ - 1);
     iota(begin(unselected), end(unselected), 1u);  // 1, 2, ..., dimension - 1
-    // Remove chosen_market_id
     unselected.erase(find(begin(unselected), end(unselected), chosen_market_id));
 
     sol.push_back_market(chosen_market_id);
 
-    // [i] = price for product i
     vector<int> prices_in_sol{ market_product_prices.at(chosen_market_id) };
     auto improvement_found = false;
     do {
@@ -146,20 +392,14 @@ TPP::Solution calc_gsh_solution(const TPP::Instance& instance) {
 
         auto i = sol.route_.back();
         for (auto j : sol.route_) {
-            const auto c_ij = instance.edge_weights_.at(i).at(j);
+            const auto c_ij = instance.get_travel_cost(i, j);
 
-            // Look for customer h that can be inserted between (i, j)
             for (auto h : unselected) {
-                auto c_ih = instance.edge_weights_.at(i).at(h);
-                auto c_hj = instance.edge_weights_.at(h).at(j);
-                const auto &h_prices = market_product_prices.at(h);
-
-                //auto diff_sum = 0;
-                //for (auto k = 0ul, end = prices_in_sol.size(); k < end; ++k) {
-                    //diff_sum += max(0, prices_in_sol.at(k) - h_prices.at(k));
-                //}
-                auto diff_sum = Vec::calc_diff_max_0_sum(prices_in_sol, h_prices);
-                auto savings = c_ij - c_ih - c_hj + diff_sum;
+                const auto c_ih = instance.get_travel_cost(i, h);
+                const auto c_hj = instance.get_travel_cost(h, j);
+                const auto diff_sum = Vec::calc_diff_max_0_sum(prices_in_sol,
+                                                               market_product_prices.at(h));
+                const auto savings = c_ij - c_ih - c_hj + diff_sum;
 
                 if (savings > best_savings) {
                     best_i = i;
@@ -170,28 +410,31 @@ TPP::Solution calc_gsh_solution(const TPP::Instance& instance) {
             i = j;
         }
         if (best_savings > 0) {
-            LOG_F(INFO, "Savings found: %d for h: %u after i: %d", best_savings, best_h, best_i);
             improvement_found = true;
 
-            auto it = find(begin(sol.route_), end(sol.route_), best_i);
-            ++it;
-            int index = distance(begin(sol.route_), it);
-            sol.insert_market_at_pos(best_h, static_cast<size_t>(index));
-            // route.insert(pos, best_h);
+            sol.insert_market_at_pos(best_h, sol.get_market_pos_in_route(best_i) + 1);
             unselected.erase(find(begin(unselected), end(unselected), best_h));
 
             const auto &h_prices = market_product_prices.at(best_h);
-            for (auto k =0u; k < instance.product_count_; ++k) {
+            for (auto k = 0u; k < prices_in_sol.size(); ++k) {
                 prices_in_sol.at(k) = min(prices_in_sol.at(k), h_prices.at(k));
             }
         }
     } while(improvement_found);
-
-    assert(is_solution_valid(instance, sol.route_));
-    LOG_F(INFO, "Autocalculated sol cost: %d", sol.cost_);
-    auto cost = calc_solution_cost(instance, sol.route_);
-    LOG_F(INFO, "Final GSH sol cost: %d", cost);
-    LOG_F(INFO, "Final GSH sol: %s", container_to_string(sol.route_).c_str());
-    sol.cost_ = cost;
+    sol.cost_ = calc_solution_cost(instance, sol.route_);
     return sol;
 }
+
+
+void gsh_run_tests(const TPP::Instance &instance) {
+    LOG_SCOPE_F(INFO, "gsh_run_tests");
+
+    const auto sol = calc_gsh_solution(instance);
+    const auto expected = calc_gsh_solution_rescan(instance);
+
+    CHECK_F(sol.route_ == expected.route_, "Route: %s, expected: %s",
+            container_to_string(sol.route_).c_str(),
+            container_to_string(expected.route_).c_str());
+    CHECK_F(sol.cost_ == expected.cost_, "Cost: %d, expected: %d",
+            sol.cost_, expected.cost_);
+}
@@ -16,4 +16,11 @@
 TPP::Solution calc_gsh_solution(const TPP::Instance& instance);
 
 
+/*
+ * Checks if calc_gsh_solution returns the same solution for the instance as
+ * the version which rescans all the possible insertions in each step.
+ */
+void gsh_run_tests(const TPP::Instance &instance);
+
+
 #endif
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "instance_generator.h"
+#include "logging.h"
+
+using namespace std;
+
+
+/*
+ * Returns the coordinates of the markets, the depot is placed like the other
+ * markets.
+ */
+vector<pair<int, int>> generate_coords(const TPP::GeneratorConfig &config,
+                                       mt19937 &rng) {
+    uniform_int_distribution<int> coord(0, config.max_coord_ - 1);
+    vector<pair<int, int>> coords;
+    coords.reserve(config.markets_);
+
+    if (config.clusters_ == 0) {
+        for (auto i = 0u; i < config.markets_; ++i) {
+            const auto x = coord(rng);
+            coords.emplace_back(x, coord(rng));
+        }
+        return coords;
+    }
+    vector<pair<int, int>> centers;
+    for (auto i = 0u; i < config.clusters_; ++i) {
+        const auto x = coord(rng);
+        centers.emplace_back(x, coord(rng));
+    }
+    uniform_int_distribution<uint32_t> any_center(0, config.clusters_ - 1);
+    normal_distribution<double> offset(0, config.max_coord_ / 20.0);
+    auto clamp_coord = [&](double v) {
+        return static_cast<int>(min(max(v, 0.0), config.max_coord_ - 1.0));
+    };
+    for (auto i = 0u; i < config.markets_; ++i) {
+        const auto &c = centers[any_center(rng)];
+        const auto x = clamp_coord(c.first + offset(rng));
+        coords.emplace_back(x, clamp_coord(c.second + offset(rng)));
+    }
+    return coords;
+}
+
+
+/*
+ * Returns offers[m] = list of (product, price) pairs of market m. The depot
+ * (market 0) does not offer anything and every product is offered by at
+ * least one market.
+ */
+vector<vector<pair<uint32_t, int>>>
+generate_offers(const TPP::GeneratorConfig &config, mt19937 &rng) {
+    const auto n = config.markets_;
+    uniform_int_distribution<int> price(config.min_price_, config.max_price_);
+    vector<vector<pair<uint32_t, int>>> offers(n);
+
+    vector<uint32_t> markets(n - 1);
+    iota(begin(markets), end(markets), 1u);
+
+    for (auto p = 0u; p < config.products_; ++p) {
+        uint32_t count = 0;
+        if (config.offer_density_ > 0) {
+            binomial_distribution<uint32_t> offered(n - 1, config.offer_density_);
+            count = max(1u, offered(rng));
+        } else {
+            count = uniform_int_distribution<uint32_t>(1, n - 1)(rng);
+        }
+        // Partial Fisher-Yates shuffle selects count random markets
+        for (auto i = 0u; i < count; ++i) {
+            uniform_int_distribution<uint32_t> pos(i, n - 2);
+            swap(markets[i], markets[pos(rng)]);
+            offers[markets[i]].emplace_back(p, price(rng));
+        }
+    }
+    for (auto &market_offers : offers) {
+        sort(begin(market_offers), end(market_offers));
+    }
+    return offers;
+}
+
+
+int calc_distance(const pair<int, int> &a, const pair<int, int> &b) {
+    const double dx = a.first - b.first;
+    const double dy = a.second - b.second;
+    return static_cast<int>(sqrt(dx * dx + dy * dy));  // As in load_from_file
+}
+
+
+void TPP::write_random_instance(ostream &out, const GeneratorConfig &config) {
+    CHECK_F(config.markets_ >= 2, "At least 2 markets are required");
+    CHECK_F(config.products_ >= 1, "At least 1 product is required");
+    CHECK_F(config.min_price_ >= 1 && config.min_price_ <= config.max_price_,
+            "Invalid price range");
+    if (config.explicit_weights_ && config.markets_ > 10000) {
+        LOG_F(WARNING, "EXPLICIT weights for %u markets require %.1lf GB",
+              config.markets_,
+              config.markets_ * (config.markets_ - 1.0) / 2 * 4 / 1e9);
+    }
+
+    mt19937 rng(config.seed_);
+    const auto coords = generate_coords(config, rng);
+    const auto offers = generate_offers(config, rng);
+    const auto n = config.markets_;
+
+    out << "NAME : Gen." << n << "." << config.products_ << "." << config.seed_ << "\n"
+        << "TYPE : TPP\n"
+        << "COMMENT : Generated, seed " << config.seed_
+        << ", clusters " << config.clusters_
+        << ", offer density " << config.offer_density_ << "\n"
+        << "DIMENSION : " << n << "\n";
+    if (config.explicit_weights_) {
+        out << "EDGE_WEIGHT_TYPE : EXPLICIT\n"
+            << "EDGE_WEIGHT_FORMAT : UPPER_ROW\n"
+            << "EDGE_WEIGHT_SECTION :\n";
+        for (auto i = 0u; i + 1 < n; ++i) {
+            for (auto j = i + 1; j < n; ++j) {
+                out << calc_distance(coords[i], coords[j])
+                    << (j + 1 < n ? " " : "\n");
+            }
+        }
+    } else {
+        out << "EDGE_WEIGHT_TYPE : EUC_2D\n"
+            << "DISPLAY_DATA_TYPE : COORD_DISPLAY\n"
+            << "NODE_COORD_SECTION :\n";
+        for (auto i = 0u; i < n; ++i) {
+            out << (i + 1) << " " << coords[i].first << " " << coords[i].second << "\n";
+        }
+    }
+    out << "DEMAND_SECTION :\n" << config.products_ << "\n";
+    for (auto p = 0u; p < config.products_; ++p) {
+        out << (p + 1) << " 1\n";
+    }
+    out << "OFFER_SECTION :\n";
+    for (auto m = 0u; m < n; ++m) {
+        out << (m + 1) << " " << offers[m].size();
+        for (const auto &o : offers[m]) {
+            out << " " << (o.first + 1) << " " << o.second << " 1";
+        }
+        out << "\n";
+    }
+    out << "EOF\n";
+}
@@ -0,0 +1,41 @@
+#ifndef INSTANCE_GENERATOR_H
+#define INSTANCE_GENERATOR_H
+
+#include <cstdint>
+#include <ostream>
+
+
+namespace TPP {
+
+    /*
+     * Parameters of a randomly generated U-TPP instance.
+     */
+    struct GeneratorConfig {
+        uint32_t markets_ = 100;  // Including the depot
+        uint32_t products_ = 50;
+        uint32_t seed_ = 1;
+        // If true the distances are written in the EDGE_WEIGHT_SECTION
+        // (EXPLICIT, UPPER_ROW), otherwise as the node coords (EUC_2D)
+        bool explicit_weights_ = false;
+        // The markets are placed in clusters_ clusters (normal distribution
+        // around the centers) or uniformly if clusters_ == 0
+        uint32_t clusters_ = 0;
+        int max_coord_ = 1000;
+        // The probability that a market offers a product. If 0, the
+        // number of markets offering a product is drawn from [1, markets_ - 1]
+        // as in the classes of Laporte et al. and Riera-Ledesma et al.
+        double offer_density_ = 0;
+        int min_price_ = 1;
+        int max_price_ = 500;
+    };
+
+
+    /*
+     * Writes a random U-TPP instance in the TPPLIB format. The same config
+     * (including the seed) always gives the same instance.
+     */
+    void write_random_instance(std::ostream &out, const GeneratorConfig &config);
+}
+
+
+#endif
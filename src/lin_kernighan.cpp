@@ -0,0 +1,227 @@
+#include <algorithm>
+
+#include "lin_kernighan.h"
+#include "route_neighborhood.h"
+#include "logging.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/*
+ * A single step (flip) of the LK move, i.e. edges (t1, t2) and (t4, t3)
+ * are replaced with (t2, t3) and (t1, t4). The t1 is fixed for the whole
+ * move.
+ */
+struct Flip {
+    uint32_t t2_;
+    uint32_t t3_;
+    uint32_t t4_;
+};
+
+
+struct FlipCandidate {
+    int score_;  // d(t3, t4) - d(t2, t3)
+    uint32_t t3_;
+    uint32_t t4_;
+};
+
+
+bool same_edge(uint32_t a, uint32_t b, uint32_t c, uint32_t d) noexcept {
+    return (a == c && b == d) || (a == d && b == c);
+}
+
+
+/*
+ * Returns true if (a, b) was removed by one of the flips.
+ */
+bool was_removed(const vector<Flip> &flips, uint32_t a, uint32_t b) noexcept {
+    for (const auto &f : flips) {
+        if (same_edge(a, b, f.t3_, f.t4_)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Returns true if (a, b) was added by one of the flips.
+ */
+bool was_added(const vector<Flip> &flips, uint32_t a, uint32_t b) noexcept {
+    for (const auto &f : flips) {
+        if (same_edge(a, b, f.t2_, f.t3_)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Looks for the candidates for the next flip, i.e. nearest neighbors (t3) of
+ * t2 for which the partial gain g - d(t2, t3) stays positive. The
+ * candidates are sorted according to d(t3, t4) - d(t2, t3), the best first.
+ */
+void find_flip_candidates(const RouteNeighborhood &nh,
+                          uint32_t t1, uint32_t t2, int g,
+                          const vector<Flip> &flips,
+                          vector<FlipCandidate> &candidates) {
+    candidates.clear();
+
+    const bool forward = (nh.succ(t1) == t2);
+    const auto t2_succ = nh.succ(t2);
+    const auto t2_pred = nh.pred(t2);
+    const auto &nn_list = nh.instance_.nn_lists_[t2];
+    const auto nn_count = min(nh.nn_count_, nn_list.size());
+
+    for (auto idx = 0u; idx < nn_count; ++idx) {
+        const auto t3 = nn_list[idx];
+        const auto d_23 = nh.dist(t2, t3);
+        if (g - d_23 <= 0) {
+            break ;  // The remaining neighbors are even further
+        }
+        if (!nh.is_in_route(t3) || t3 == t1 || t3 == t2_succ || t3 == t2_pred) {
+            continue ;
+        }
+        const auto t4 = forward ? nh.pred(t3) : nh.succ(t3);
+        if (was_removed(flips, t2, t3) || was_added(flips, t3, t4)) {
+            continue ;
+        }
+        candidates.push_back({ nh.dist(t3, t4) - d_23, t3, t4 });
+    }
+    sort(begin(candidates), end(candidates),
+         [](const FlipCandidate &a, const FlipCandidate &b) {
+             return a.score_ > b.score_;
+         });
+}
+
+
+void undo_flip(RouteNeighborhood &nh, uint32_t t1, const Flip &f) noexcept {
+    nh.make_2opt_move(t1, f.t4_, f.t2_, f.t3_);
+}
+
+
+/*
+ * Tries to build an improving LK move starting with removal of the edge
+ * (t1, t2). At the first level up to Breadth alternatives for t3 are tried,
+ * at the deeper levels only the best one.
+ *
+ * If an improvement is found the route is left in the improved state, the
+ * flips performed are stored in flips and the gain is returned.
+ * Otherwise, the route is restored and 0 is returned.
+ */
+int lk_move(RouteNeighborhood &nh, uint32_t t1, uint32_t t2,
+            uint32_t max_depth, vector<Flip> &flips) {
+    constexpr auto Breadth = 3u;
+
+    const auto g0 = nh.dist(t1, t2);
+
+    flips.clear();
+    vector<FlipCandidate> first_level;
+    find_flip_candidates(nh, t1, t2, g0, flips, first_level);
+    if (first_level.size() > Breadth) {
+        first_level.resize(Breadth);
+    }
+    vector<FlipCandidate> candidates;
+
+    for (const auto &first : first_level) {
+        flips.clear();
+        auto g = g0;
+        auto curr_t2 = t2;
+        auto next = first;
+        auto best_gain = 0;
+        auto best_len = 0u;
+
+        while (true) {
+            nh.make_2opt_move(t1, curr_t2, next.t4_, next.t3_);
+            flips.push_back({ curr_t2, next.t3_, next.t4_ });
+
+            g += next.score_;
+            const auto tour_gain = g - nh.dist(next.t4_, t1);
+            if (tour_gain > best_gain) {
+                best_gain = tour_gain;
+                best_len = flips.size();
+            }
+            if (flips.size() >= max_depth) {
+                break ;
+            }
+            curr_t2 = next.t4_;
+            find_flip_candidates(nh, t1, curr_t2, g, flips, candidates);
+            if (candidates.empty()) {
+                break ;
+            }
+            next = candidates.front();
+        }
+        // Go back to the best tour found
+        while (flips.size() > best_len) {
+            undo_flip(nh, t1, flips.back());
+            flips.pop_back();
+        }
+        if (best_gain > 0) {
+            return best_gain;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Impl. of a Lin-Kernighan style heuristic in which a variable depth move is
+ * built from a sequence of 2-opt moves (flips).
+ *
+ * The route is kept in an array (see RouteNeighborhood) and each flip
+ * reverses the shorter part of it. The routes in the TPP solutions are
+ * rarely longer than a few hundred markets so this is fast enough and a
+ * 2-level doubly linked list is not needed.
+ *
+ * Returns the change of the route length (travel distance), i.e. a value
+ * <= 0.
+ */
+int lin_kernighan(const TPP::Instance &instance, TPP::Solution &sol,
+                  bool use_dont_look_bits, size_t nn_count,
+                  uint32_t max_depth) {
+    LOG_SCOPE_F(INFO, "lin_kernighan");
+
+    CHECK_F(instance.is_symmetric_, "Symmetric instance expected!");
+
+    auto &route = sol.route_;
+    if (route.size() < 4) {
+        return 0;
+    }
+    const auto old_travel_cost = instance.calc_travel_cost(route);
+
+    RouteNeighborhood nh(instance, route, nn_count);
+    vector<Flip> flips;
+    flips.reserve(max_depth);
+
+    auto found_improvement = false;
+    do {
+        found_improvement = false;
+
+        for (auto i = 0u; i < nh.len_; ++i) {
+            const auto t1 = route[i];
+            if (nh.dont_look_bits_[t1]) {
+                continue ;
+            }
+            auto gain = lk_move(nh, t1, nh.succ(t1), max_depth, flips);
+            if (gain == 0) {
+                gain = lk_move(nh, t1, nh.pred(t1), max_depth, flips);
+            }
+            if (gain > 0) {
+                found_improvement = true;
+                nh.travel_cost_change_ -= gain;
+                nh.reset_dont_look_bits({ t1 });
+                for (const auto &f : flips) {
+                    nh.reset_dont_look_bits({ f.t2_, f.t3_, f.t4_ });
+                }
+            } else if (use_dont_look_bits) {
+                nh.dont_look_bits_[t1] = true;
+            }
+        }
+    } while (found_improvement);
+
+    const auto delta = nh.apply_to(sol, old_travel_cost);
+    LOG_F(INFO, "LK improvement: %d", -delta);
+    return delta;
+}
@@ -0,0 +1,30 @@
+#ifndef LIN_KERNIGHAN_H
+#define LIN_KERNIGHAN_H
+
+
+#include "tpp_solution.h"
+
+
+/*
+ * Impl. of a Lin-Kernighan style heuristic in which a variable depth move is
+ * built from a sequence of 2-opt moves (flips) as in:
+ *
+ * Johnson, D. S., & McGeoch, L. A. (1997). The traveling salesman problem:
+ * A case study in local optimization. Local search in combinatorial
+ * optimization, 1(1), 215-310.
+ *
+ * Only edges connecting nn_count nearest neighbors are considered when
+ * extending the move. Up to max_depth flips are tried, the move is cut back
+ * to the step with the largest gain.
+ *
+ * The solution's route is modified only if a better order was found.
+ *
+ * Returns the change of the route length (travel distance), i.e. a value
+ * <= 0.
+ */
+int lin_kernighan(const TPP::Instance &instance, TPP::Solution &sol,
+                  bool use_dont_look_bits=true, size_t nn_count=10,
+                  uint32_t max_depth=50);
+
+
+#endif
@@ -6,6 +6,25 @@
 #include <sstream>
 
 
+/*
+ * Checks of the hot paths, e.g. the incremental updates of a solution or the
+ * moves of the ants. These are enabled in the debug builds, the release
+ * builds (NDEBUG) skip them unless TPP_DEBUG_CHECKS is defined (make
+ * checks=1). Use CHECK_F for the validation of the input, which should be
+ * always performed.
+ *
+ * DEBUG_AT(container, index) is container.at(index) if the checks are
+ * enabled and container[index] otherwise.
+ */
+#if !defined(NDEBUG) || defined(TPP_DEBUG_CHECKS)
+#define DEBUG_CHECK_F(test, ...) CHECK_F(test, ##__VA_ARGS__)
+#define DEBUG_AT(container, index) (container).at(index)
+#else
+#define DEBUG_CHECK_F(test, ...) do { (void)sizeof(test); } while (false)
+#define DEBUG_AT(container, index) (container)[index]
+#endif
+
+
 template<typename T>
 std::string
 container_to_string(const T& container, std::string delimeter = " ") {
@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "ls_cache.h"
+
+using namespace std;
+
+
+/*
+ * Mixes the bits of x, this is the finalizer of the splitmix64 generator.
+ */
+uint64_t mix_bits(uint64_t x) noexcept {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+/*
+ * Returns the route starting at the depot and, if the instance is symmetric,
+ * with the direction in which the second market has the lower id.
+ */
+vector<uint32_t> get_canonical_route(const TPP::Instance &instance,
+                                     const vector<uint32_t> &route) {
+    vector<uint32_t> canonical(route);
+    auto depot_pos = find(begin(canonical), end(canonical), 0u);
+    rotate(begin(canonical), depot_pos, end(canonical));
+    if (instance.is_symmetric_ && canonical.size() > 2
+            && canonical[1] > canonical.back()) {
+        reverse(begin(canonical) + 1, end(canonical));
+    }
+    return canonical;
+}
+
+
+/*
+ * The hash of the set of markets does not depend on their order, the hash
+ * of the route does.
+ */
+uint64_t calc_key(const vector<uint32_t> &canonical_route) noexcept {
+    uint64_t set_hash = 0;
+    uint64_t route_hash = 14695981039346656037ULL;
+    for (auto m : canonical_route) {
+        set_hash ^= mix_bits(m);
+        route_hash = (route_hash ^ m) * 1099511628211ULL;
+    }
+    return set_hash ^ mix_bits(route_hash);
+}
+
+
+LocalSearchCache::LocalSearchCache(size_t capacity)
+    : capacity_(capacity) {
+}
+
+
+const TPP::Solution *LocalSearchCache::find(const TPP::Instance &instance,
+                                            const vector<uint32_t> &route) {
+    ++lookups_;
+    const auto canonical = get_canonical_route(instance, route);
+    const auto key = calc_key(canonical);
+    const auto range = index_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const auto entry_it = it->second;
+        if (entry_it->route_ == canonical) {
+            ++hits_;
+            // Move to the front (most recently used)
+            entries_.splice(begin(entries_), entries_, entry_it);
+            return entry_it->result_.get();
+        }
+    }
+    return nullptr;
+}
+
+
+void LocalSearchCache::insert(const TPP::Instance &instance,
+                              const vector<uint32_t> &route_before,
+                              const TPP::Solution &result) {
+    if (capacity_ == 0) {
+        return ;
+    }
+    auto stored = make_shared<TPP::Solution>(result);
+
+    auto canonical = get_canonical_route(instance, route_before);
+    const auto key = calc_key(canonical);
+    insert_entry(key, move(canonical), stored);
+
+    auto canonical_result = get_canonical_route(instance, result.route_);
+    const auto result_key = calc_key(canonical_result);
+    if (result_key != key) {
+        insert_entry(result_key, move(canonical_result), stored);
+    }
+}
+
+
+void LocalSearchCache::insert_entry(uint64_t key, vector<uint32_t> route,
+                                    shared_ptr<TPP::Solution> result) {
+    const auto range = index_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->route_ == route) {
+            it->second->result_ = result;
+            entries_.splice(begin(entries_), entries_, it->second);
+            return ;
+        }
+    }
+    entries_.push_front(Entry{ key, move(route), move(result) });
+    index_.emplace(key, begin(entries_));
+
+    while (entries_.size() > capacity_) {  // Evict the least recently used
+        const auto &last = entries_.back();
+        auto it = index_.equal_range(last.key_).first;
+        while (it->second != prev(end(entries_))) {
+            ++it;
+        }
+        index_.erase(it);
+        entries_.pop_back();
+    }
+}
+
+
+vector<LocalSearchCache::EntryRoutes> LocalSearchCache::get_entries() const {
+    vector<EntryRoutes> result;
+    result.reserve(entries_.size());
+    for (const auto &entry : entries_) {
+        result.emplace_back(entry.route_, entry.result_->route_);
+    }
+    return result;
+}
+
+
+void LocalSearchCache::set_entries(const TPP::Instance &instance,
+                                   const vector<EntryRoutes> &entries) {
+    entries_.clear();
+    index_.clear();
+    // insert_entry puts the entry at the front so start from the least
+    // recently used
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        auto result = make_shared<TPP::Solution>(instance);
+        for (auto m : it->second) {
+            if (m != 0) {
+                result->push_back_market(m);
+            }
+        }
+        insert_entry(calc_key(it->first), it->first, move(result));
+    }
+}
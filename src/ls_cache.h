@@ -0,0 +1,91 @@
+#ifndef LS_CACHE_H
+#define LS_CACHE_H
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "tpp_solution.h"
+
+
+/*
+ * A bounded (LRU) cache of the local search results.
+ *
+ * The key is a hash of the set of selected markets combined with a hash of
+ * the route in a canonical form, i.e. starting at the depot and, for a
+ * symmetric instance, with the direction fixed. The routes are compared on
+ * lookup so a hash collision cannot return a wrong result.
+ *
+ * With MMAS close to convergence many ants build the same solutions, so the
+ * result of the local search can be copied instead of being recomputed.
+ */
+struct LocalSearchCache {
+    // An input route (in the canonical form) and the route of the result
+    using EntryRoutes = std::pair<std::vector<uint32_t>, std::vector<uint32_t>>;
+
+    size_t capacity_;
+    uint64_t lookups_ = 0;
+    uint64_t hits_ = 0;
+
+
+    explicit LocalSearchCache(size_t capacity);
+
+    /*
+     * Returns the stored result of the local search started from the route
+     * or nullptr if it is not available.
+     */
+    const TPP::Solution *find(const TPP::Instance &instance,
+                              const std::vector<uint32_t> &route);
+
+    /*
+     * Stores the result of the local search started from route_before. The
+     * result is also stored as its own result, as it is a local optimum.
+     */
+    void insert(const TPP::Instance &instance,
+                const std::vector<uint32_t> &route_before,
+                const TPP::Solution &result);
+
+    double get_hit_rate() const noexcept {
+        return lookups_ > 0 ? hits_ / static_cast<double>(lookups_) : 0.0;
+    }
+
+    size_t size() const noexcept { return entries_.size(); }
+
+    /*
+     * Removes all the entries, e.g. when the results are no longer valid.
+     */
+    void clear() noexcept {
+        entries_.clear();
+        index_.clear();
+    }
+
+    /*
+     * Returns the contents of the cache, the most recently used first.
+     */
+    std::vector<EntryRoutes> get_entries() const;
+
+    /*
+     * Replaces the contents of the cache with the entries returned by
+     * get_entries, so that the cache behaves in the same way as the one
+     * from which they were taken.
+     */
+    void set_entries(const TPP::Instance &instance,
+                     const std::vector<EntryRoutes> &entries);
+
+private:
+
+    struct Entry {
+        uint64_t key_;
+        std::vector<uint32_t> route_;  // In the canonical form
+        std::shared_ptr<TPP::Solution> result_;
+    };
+
+    std::list<Entry> entries_;  // The most recently used first
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index_;
+
+    void insert_entry(uint64_t key, std::vector<uint32_t> route,
+                      std::shared_ptr<TPP::Solution> result);
+};
+
+
+#endif
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <numeric>
+
+#include "ls_scheduler.h"
+
+using namespace std;
+
+
+LocalSearchScheduler::LocalSearchScheduler(const vector<string> &operator_names) {
+    for (const auto &name : operator_names) {
+        LocalSearchOperatorStats stats;
+        stats.name_ = name;
+        stats_.push_back(stats);
+    }
+}
+
+
+/*
+ * Returns the indices of the operators in the order in which they should be
+ * applied. The operators which were not called yet go first, so that each of
+ * them gets a chance to be measured.
+ */
+vector<uint32_t> LocalSearchScheduler::get_order() const {
+    vector<uint32_t> order(stats_.size());
+    iota(begin(order), end(order), 0u);
+    if (adaptive_) {
+        stable_sort(begin(order), end(order),
+                    [this](uint32_t a, uint32_t b) {
+                        const auto &x = stats_[a];
+                        const auto &y = stats_[b];
+                        if ((x.calls_ == 0) != (y.calls_ == 0)) {
+                            return x.calls_ == 0;
+                        }
+                        return x.gain_rate_ema_ > y.gain_rate_ema_;
+                    });
+    }
+    return order;
+}
+
+
+bool LocalSearchScheduler::should_run(uint32_t op) {
+    auto &stats = stats_.at(op);
+    if (adaptive_
+            && stats.calls_without_improvement_ >= patience_
+            && stats.skipped_in_row_ + 1 < explore_period_) {
+        ++stats.skipped_;
+        ++stats.skipped_in_row_;
+        return false;
+    }
+    stats.skipped_in_row_ = 0;
+    return true;
+}
+
+
+void LocalSearchScheduler::record(uint32_t op, int gain, double time_us) {
+    auto &stats = stats_.at(op);
+    ++stats.calls_;
+    stats.total_time_us_ += time_us;
+    if (gain > 0) {
+        ++stats.improvements_;
+        stats.total_gain_ += gain;
+        stats.calls_without_improvement_ = 0;
+    } else {
+        ++stats.calls_without_improvement_;
+    }
+    const auto rate = max(gain, 0) / max(time_us, 1.0);
+    stats.gain_rate_ema_ = (stats.calls_ == 1)
+                         ? rate
+                         : ema_alpha_ * rate + (1 - ema_alpha_) * stats.gain_rate_ema_;
+}
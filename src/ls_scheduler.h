@@ -0,0 +1,69 @@
+#ifndef LS_SCHEDULER_H
+#define LS_SCHEDULER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+ * Statistics of a single local search operator (heuristic).
+ */
+struct LocalSearchOperatorStats {
+    std::string name_;
+    uint64_t calls_ = 0;
+    uint64_t skipped_ = 0;
+    uint64_t improvements_ = 0;  // How many calls improved the solution
+    int64_t total_gain_ = 0;  // Total decrease of the solution cost
+    double total_time_us_ = 0;
+    // Exponential moving average of the gain per microsecond
+    double gain_rate_ema_ = 0;
+    uint32_t calls_without_improvement_ = 0;
+    uint32_t skipped_in_row_ = 0;
+};
+
+
+/*
+ * Decides in which order the local search operators are applied and which
+ * of them are skipped, based on the measured gain per microsecond.
+ *
+ * In the adaptive mode the operators are ordered by the moving average of
+ * their gain rate, and an operator which did not improve the solution in
+ * patience_ consecutive calls is skipped. It is still run once per
+ * explore_period_ opportunities, so it can come back if it starts to pay off
+ * again.
+ *
+ * If adaptive_ == false the operators are always run in the default order,
+ * and only the statistics are collected. This keeps the runs reproducible
+ * for a given seed, as the timings do not affect the search.
+ */
+struct LocalSearchScheduler {
+    bool adaptive_ = false;
+    double ema_alpha_ = 0.2;
+    uint32_t patience_ = 10;
+    uint32_t explore_period_ = 10;
+    std::vector<LocalSearchOperatorStats> stats_;
+
+
+    explicit LocalSearchScheduler(const std::vector<std::string> &operator_names);
+
+    /*
+     * Returns the indices of the operators in the order in which they should
+     * be applied.
+     */
+    std::vector<uint32_t> get_order() const;
+
+    /*
+     * Returns true if the operator should be run now. If false is returned
+     * the operator is counted as skipped.
+     */
+    bool should_run(uint32_t op);
+
+    /*
+     * Updates the statistics of the operator after it was run.
+     */
+    void record(uint32_t op, int gain, double time_us);
+};
+
+
+#endif
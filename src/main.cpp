@@ -1,9 +1,11 @@
 #include <iostream>
+#include <atomic>
 #include <chrono>
 #include <random>
 #include <algorithm>
 #include <fstream>
 #include <ctime>
+#include <csignal>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -12,13 +14,13 @@
 #include "utils.h"
 #include "tpp.h"
 #include "gsh.h"
-#include "vec.h"
-#include "two_opt.h"
-#include "three_opt.h"
 #include "drop.h"
 #include "rand.h"
-#include "cah.h"
-#include "aco.h"
+#include "solver.h"
+#include "event_writer.h"
+#include "checkpoint.h"
+#include "server.h"
+#include "profiler.h"
 #include "tpp_info.h"
 #include "json.hpp"
 
@@ -32,7 +34,16 @@ R"(AntsTPP.
     Usage:
       ants-tpp [--instance=<path>] [--verbosity=<n>] [--trials=<n>]
                [--iterations=<n>] [--timeout=<f>] [--id=<s>]
-               [--outdir=<path>] [--alg=<s>] [--seed=<n>]
+               [--outdir=<path>] [--alg=<s>] [--seed=<n>] [--threads=<n>]
+               [--cah-orders=<n>] [--route-opt=<s>] [--ls-exchange=<s>]
+               [--ls-schedule=<s>] [--ls-dlb=<n>]
+               [--ls-cache=<n>] [--events=<target>] [--target=<s>]
+               [--stagnation=<n>] [--checkpoint=<path>]
+               [--checkpoint-every=<n>] [--resume=<path>]
+               [--init-solution=<path>] [--init-pheromone=<path>]
+               [--deltas=<path>] [--delta-iterations=<n>]
+      ants-tpp --serve=<target> [--workers=<n>] [--instance-cache=<n>]
+               [--verbosity=<n>]
       ants-tpp (-h | --help)
       ants-tpp --version
 
@@ -46,94 +57,203 @@ R"(AntsTPP.
       --alg=<s>            Algorithm to run aco|cah [default: aco].
       --seed=<n>           Initial seed for the pseudo-random num. gen.
                            If 0 current time is used [default: 0]
+      --threads=<n>        How many threads evaluate the product orders of
+                           the CAH, or scan the neighborhood of the local
+                           search with --ls-exchange=best [default: 1].
+      --cah-orders=<n>     How many random product orders the CAH evaluates
+                           in each iteration [default: 1].
+      --route-opt=<s>      Route optimizer used by the local search
+                           3opt|2opt-oropt|lk [default: 3opt].
+      --ls-exchange=<s>    How the local search selects exchange moves
+                           first|best [default: first].
+      --ls-schedule=<s>    Order of the local search operators fixed|adaptive,
+                           the adaptive skips and reorders them according
+                           to the measured gain per us [default: fixed].
+      --ls-dlb=<n>         How many nearest neighbors of a market the
+                           first-improvement drop/exchange heuristics check,
+                           they also skip the markets with don't look bits
+                           set; 0 disables both [default: 50].
+      --ls-cache=<n>       How many local search results are cached, e.g.
+                           1024, 0 disables the cache [default: 0].
+      --target=<s>         Stop when a solution with the cost <= s is found,
+                           s is a number or best-known.
+      --stagnation=<n>     Stop if no better solution was found in n
+                           consecutive iterations, i.e. since the last
+                           improvement of the global best solution.
+      --events=<target>    Where to stream the per-iteration statistics as
+                           NDJSON, a file path or a file descriptor number.
+      --checkpoint=<path>  Where to periodically save the state of the ACO
+                           so that the run can be resumed.
+      --checkpoint-every=<n>  How often (in iterations) the checkpoint is
+                           saved [default: 100].
+      --resume=<path>      Continue the run from the given checkpoint, the
+                           other options should be the same as in the
+                           original run.
+      --init-solution=<path>  Start from the solution (route) given in a
+                           results file (best_found_solution) or as a JSON
+                           array, e.g. from a run on a previous version of
+                           the instance.
+      --init-pheromone=<path>  Start with the pheromone trails saved in a
+                           checkpoint (see --checkpoint) of a previous run.
+      --deltas=<path>      Dynamic mode: after the run the changes of the
+                           offers given in the JSON file are applied one
+                           by one, and after each the ACO continues with
+                           the current pheromone trails.
+      --delta-iterations=<n>  How many iterations are performed after each
+                           change in the dynamic mode [default: 100].
+      --serve=<target>     Run as a service reading JSON-RPC requests, one
+                           per line, from stdin (target -) or a Unix socket
+                           at the target path (see server.h).
+      --workers=<n>        How many requests are solved in parallel by the
+                           service [default: 1].
+      --instance-cache=<n>  How many loaded instances the service keeps
+                           [default: 8].
       -h --help            Show this screen.
       --version            Show version.
       --verbosity=<n>      Verbosity level INFO|WARNING|ERROR [default: WARNING].
 )";
 
 
-enum class Algorithm {
-    ACO, CAH
-};
+/*
+ * Returns the statistics of the local search operators as a JSON array.
+ */
+json record_ls_operator_stats(const LocalSearchScheduler &scheduler) {
+    json records = json::array();
+    for (const auto &stats : scheduler.stats_) {
+        records.push_back({
+            {"name", stats.name_},
+            {"calls", stats.calls_},
+            {"skipped", stats.skipped_},
+            {"improvements", stats.improvements_},
+            {"total_gain", stats.total_gain_},
+            {"total_time_us", stats.total_time_us_},
+            {"gain_per_us", stats.total_gain_ / max(stats.total_time_us_, 1.0)},
+        });
+    }
+    return records;
+}
 
 
-void perform_trial(ACO &aco, StopCondition* stop_condition, json &record) {
-    clock_t trial_start_time{ 0 };
+/*
+ * Returns the timers and counters collected by the profiler (TPP_PROFILE)
+ * as a JSON object.
+ */
+json record_profile(const vector<ProfileEntry> &entries) {
+    json timers = json::object();
+    json counters = json::object();
+    for (const auto &e : entries) {
+        if (e.is_timer_) {
+            timers[e.name_] = {
+                {"calls", e.count_},
+                {"total_ms", e.total_ns_ / 1e6},
+                {"mean_us", e.total_ns_ / 1e3 / max(e.count_, uint64_t{ 1 })},
+            };
+        } else {
+            counters[e.name_] = e.count_;
+        }
+    }
+    return { {"timers", timers}, {"counters", counters} };
+}
 
-    vector<int> best_solutions_cost_log;
-    vector<int> best_solutions_iteration_log;
-    vector<double> best_solutions_time_log;
-    vector<double> best_solutions_error_log;
 
-    auto new_best_found_callback = [&](const ACO &aco) {
-        const auto time_elapsed_sec = (clock() - trial_start_time)
-            / static_cast<double>(CLOCKS_PER_SEC);
+/*
+ * Returns the wall time in seconds elapsed since start.
+ */
+double get_elapsed_seconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
 
-        if (aco.global_best_ == nullptr) {
-            return ;
-        }
-        best_solutions_cost_log.push_back(aco.global_best_->cost());
-        best_solutions_iteration_log.push_back(aco.current_iteration_);
-        best_solutions_time_log.push_back(time_elapsed_sec);
 
-        auto rel_error = aco.global_best_->solution_.get_relative_error() * 100;
-        best_solutions_error_log.push_back(rel_error);
+// Set by the first SIGINT / SIGTERM, the running solver (if any) is
+// cancelled. Both atomics are lock-free so they can be used by the handler
+static atomic<bool> stop_requested{ false };
+static atomic<Solver*> running_solver{ nullptr };
 
-        LOG_F(WARNING, "New global best: %d (%.2lf%%, %d), iter: %d",
-                aco.global_best_->cost(),
-                rel_error,
-                aco.instance_.best_known_cost_,
-                aco.current_iteration_);
-    };
 
-    aco.new_best_found_callback_ = new_best_found_callback;
+/*
+ * The first SIGINT / SIGTERM stops the computations but the results found so
+ * far are still saved, the second one terminates the program.
+ */
+extern "C" void handle_stop_signal(int signal_number) {
+    stop_requested.store(true, memory_order_relaxed);
+    auto solver = running_solver.load();
+    if (solver != nullptr) {
+        solver->cancel();
+    }
+    std::signal(signal_number, SIG_DFL);
+}
+
+
+bool is_stop_requested() {
+    return stop_requested.load(memory_order_relaxed);
+}
+
 
-    trial_start_time = clock();
+void perform_trial(Solver &solver, json &record) {
+    solver.new_best_found_callback_ = [](const Solver &solver) {
+        const auto &improvement = solver.result_.improvements_.back();
+        if (solver.instance_.best_known_cost_ == 0) {  // E.g. after a delta
+            LOG_F(WARNING, "New global best: %d, iter: %d",
+                  improvement.cost_, improvement.iteration_);
+            return ;
+        }
+        LOG_F(WARNING, "New global best: %d (%.2lf%%, %d), iter: %d",
+                improvement.cost_,
+                improvement.relative_error_ * 100,
+                solver.instance_.best_known_cost_,
+                improvement.iteration_);
+    };
 
-    aco.run(stop_condition);
+    profiler::reset();
 
-    const auto time_elapsed_sec = (clock() - trial_start_time)
-        / static_cast<double>(CLOCKS_PER_SEC);
+    const auto &result = solver.run();
 
-    if (aco.global_best_) {
+    if (result.cost_ > 0) {
         LOG_F(WARNING, "Best route: %s",
-              container_to_string(aco.global_best_->solution_.route_).c_str());
+              container_to_string(result.route_).c_str());
+    }
+
+    vector<int> best_solutions_cost_log;
+    vector<uint32_t> best_solutions_iteration_log;
+    vector<double> best_solutions_time_log;
+    vector<double> best_solutions_error_log;
+    for (const auto &improvement : result.improvements_) {
+        best_solutions_cost_log.push_back(improvement.cost_);
+        best_solutions_iteration_log.push_back(improvement.iteration_);
+        best_solutions_time_log.push_back(improvement.time_);
+        best_solutions_error_log.push_back(improvement.relative_error_ * 100);
     }
 
-    record["duration"] = time_elapsed_sec;
-    record["total_iterations"] = aco.current_iteration_;
+    record["duration"] = result.duration_;
+    record["total_iterations"] = result.iterations_;
     record["best_solutions_cost_log"] = best_solutions_cost_log;
     record["best_solutions_iteration_log"] = best_solutions_iteration_log;
     record["best_solutions_time_log"] = best_solutions_time_log;
     record["best_solutions_error_log"] = best_solutions_error_log;
-}
-
-
-void perform_trial_cah(const TPP::Instance &instance,
-                       StopCondition* stop_condition, json &record) {
 
-    unique_ptr<TPP::Solution> best_solution = nullptr;
-
-    stop_condition->start();
-
-    for ( ; !stop_condition->is_reached(); stop_condition->next_iteration()) {
-        const auto sol = commodity_adding_heuristic(instance);
-
-        if (!best_solution
-                || best_solution->cost_ > sol.cost_) {
-            best_solution = make_unique<TPP::Solution>(sol);
+    if (!solver.aco_) {
+        return ;
+    }
+    const auto &aco = *solver.aco_;
+    record["ls_operators"] = record_ls_operator_stats(aco.ls_scheduler_);
+#ifdef TPP_PROFILE
+    record["profile"] = record_profile(profiler::get_profile());
+#endif
+    record["ls_cache"] = {
+        {"size", aco.ls_cache_.size()},
+        {"lookups", aco.ls_cache_.lookups_},
+        {"hits", aco.ls_cache_.hits_},
+        {"hit_rate", aco.ls_cache_.get_hit_rate()},
+    };
+}
 
-            auto rel_error = best_solution->get_relative_error() * 100;
 
-            LOG_F(WARNING, "New global best: %d (%.2lf%%, %d), iter: %d",
-                    best_solution->cost_,
-                    rel_error,
-                    instance.best_known_cost_,
-                    stop_condition->get_iteration());
-        }
-    }
-    if (best_solution) {
-        LOG_F(WARNING, "Final solution cost: %d", best_solution->cost_);
+const char *route_optimizer_to_string(RouteOptimizer route_optimizer) {
+    switch (route_optimizer) {
+    case RouteOptimizer::TwoOptOrOpt: return "2opt-oropt";
+    case RouteOptimizer::LinKernighan: return "lk";
+    case RouteOptimizer::ThreeOpt:
+    default: return "3opt";
     }
 }
 
@@ -144,11 +264,113 @@ json record_aco_parameters(const ACO &aco) {
         {"evaporation_rate", aco.evaporation_rate_},
         {"cand_list_size", aco.cand_list_size_},
         {"local_search_enabled", aco.use_local_search_},
+        {"route_optimizer", route_optimizer_to_string(aco.route_optimizer_)},
+        {"ls_exchange", aco.ls_best_improvement_ ? "best" : "first"},
+        {"ls_dlb", aco.ls_dlb_nn_count_},
+        {"ls_threads", aco.ls_threads_count_},
+        {"ls_schedule", aco.ls_scheduler_.adaptive_ ? "adaptive" : "fixed"},
+        {"ls_cache", aco.ls_cache_.capacity_},
     };
     return record;
 }
 
 
+/*
+ * Returns the route saved in a JSON file, either a results file (the best
+ * found solution is used) or a plain array of market ids.
+ */
+vector<uint32_t> load_route(const string &path) {
+    ifstream in(path);
+    CHECK_F(in.is_open(), "Cannot open file: %s", path.c_str());
+    json data;
+    in >> data;
+    if (data.is_object() && data.count("best_found_solution")) {
+        data = data["best_found_solution"];
+    }
+    CHECK_F(data.is_array() && !data.empty(),
+            "No route found in the file: %s", path.c_str());
+    return data.get<vector<uint32_t>>();
+}
+
+
+/*
+ * Returns the changes of the instance saved in a JSON file as an array of
+ * objects like:
+ *
+ *  { "set_offers": [[market, product, price], ...],
+ *    "remove_offers": [[market, product], ...],
+ *    "close_markets": [market, ...] }
+ *
+ * The ids are 0-based, as in the solution routes.
+ */
+vector<TPP::InstanceDelta> load_deltas(const string &path) {
+    ifstream in(path);
+    CHECK_F(in.is_open(), "Cannot open file: %s", path.c_str());
+    json data;
+    in >> data;
+    CHECK_F(data.is_array(), "An array of changes expected: %s", path.c_str());
+
+    auto make_offer = [](const json &item) {
+        TPP::ProductOffer offer;
+        offer.market_id_ = item.at(0).get<uint16_t>();
+        offer.product_id_ = item.at(1).get<uint16_t>();
+        offer.price_ = item.size() > 2 ? item.at(2).get<int>() : 0;
+        offer.quantity_ = 1;
+        return offer;
+    };
+    vector<TPP::InstanceDelta> deltas;
+    for (const auto &item : data) {
+        TPP::InstanceDelta delta;
+        for (const auto &offer : item.value("set_offers", json::array())) {
+            delta.updated_offers_.push_back(make_offer(offer));
+        }
+        for (const auto &offer : item.value("remove_offers", json::array())) {
+            delta.removed_offers_.push_back(make_offer(offer));
+        }
+        delta.closed_markets_ = item.value("close_markets", vector<uint32_t>{});
+        deltas.push_back(delta);
+    }
+    return deltas;
+}
+
+
+/*
+ * Applies the changes to the instance one by one and after each continues
+ * the ACO run for the given number of iterations. Returns the results for
+ * each of the changes.
+ */
+json perform_deltas(Solver &solver, TPP::Instance &instance,
+                    const vector<TPP::InstanceDelta> &deltas,
+                    uint32_t iterations) {
+    json records = json::array();
+    for (const auto &delta : deltas) {
+        if (is_stop_requested()) {
+            break ;
+        }
+        const auto start_time = chrono::steady_clock::now();
+        const auto changed_markets = TPP::apply_delta(instance, delta);
+        const auto repaired_cost = solver.on_instance_changed(changed_markets);
+        const auto repair_time = get_elapsed_seconds(start_time);
+
+        const auto &result = solver.run(
+                make_unique<FixedIterationsStopCondition>(iterations));
+        const auto duration = get_elapsed_seconds(start_time);
+
+        LOG_F(WARNING, "Change %zu: repaired cost: %d, best: %d, %.3lf s",
+              records.size(), repaired_cost, result.cost_, duration);
+
+        records.push_back({
+            {"repaired_cost", repaired_cost},
+            {"repair_time", repair_time},
+            {"best_cost", result.cost_},
+            {"best_solution", result.route_},
+            {"duration", duration},
+        });
+    }
+    return records;
+}
+
+
 void init_logging(int argc, char * argv[]) {
     loguru::init(argc, argv);
 }
@@ -179,6 +401,8 @@ std::string get_result_file_name(const string &label="") {
 
 int main(int argc, char *argv[])
 {
+    const auto program_start_time = chrono::steady_clock::now();
+
     std::map<std::string, docopt::value> args
         = docopt::docopt(USAGE,
                          { argv + 1, argv + argc },
@@ -205,10 +429,17 @@ int main(int argc, char *argv[])
         }
     }
 
-    TPP::run_tests();
-    Vec::run_tests();
-    test_two_opt();
-    three_opt_run_tests();
+    if (args.count("--serve") && args["--serve"]) {
+        std::signal(SIGINT, handle_stop_signal);
+        std::signal(SIGTERM, handle_stop_signal);
+
+        ServerConfig config;
+        config.stop_flag_ = &stop_requested;
+        config.workers_ = static_cast<uint32_t>(args["--workers"].asLong());
+        config.instance_cache_capacity_ = args["--instance-cache"].asLong();
+        run_server(args["--serve"].asString(), config);
+        return EXIT_SUCCESS;
+    }
 
     auto outdir = args["--outdir"].asString();
     make_path(outdir);
@@ -228,18 +459,55 @@ int main(int argc, char *argv[])
         const auto best_known = TPP::get_best_known_solution(path);
         instance.best_known_cost_ = best_known.cost_;
 
-        auto alg = Algorithm::ACO;
+        SolverConfig config;
+        config.seed_ = get_initial_seed();
 
         if (args.count("--alg")) {
             const auto name = args["--alg"].asString();
             if (name == "aco") {
-                alg = Algorithm::ACO;
+                config.algorithm_ = Algorithm::ACO;
             } else if (name == "cah") {
-                alg = Algorithm::CAH;
+                config.algorithm_ = Algorithm::CAH;
             } else {
                 CHECK_F(false, "Unknown algorithm: %s", name.c_str());
             }
         }
+        const auto alg = config.algorithm_;
+
+        if (args.count("--route-opt")) {
+            const auto name = args["--route-opt"].asString();
+            if (name == "3opt") {
+                config.route_optimizer_ = RouteOptimizer::ThreeOpt;
+            } else if (name == "2opt-oropt") {
+                config.route_optimizer_ = RouteOptimizer::TwoOptOrOpt;
+            } else if (name == "lk") {
+                config.route_optimizer_ = RouteOptimizer::LinKernighan;
+            } else {
+                CHECK_F(false, "Unknown route optimizer: %s", name.c_str());
+            }
+        }
+
+        if (args.count("--ls-exchange")) {
+            const auto name = args["--ls-exchange"].asString();
+            if (name == "best") {
+                config.ls_best_improvement_ = true;
+            } else {
+                CHECK_F(name == "first", "Unknown exchange mode: %s", name.c_str());
+            }
+        }
+
+        if (args.count("--ls-schedule")) {
+            const auto name = args["--ls-schedule"].asString();
+            if (name == "adaptive") {
+                config.ls_adaptive_schedule_ = true;
+            } else {
+                CHECK_F(name == "fixed", "Unknown schedule: %s", name.c_str());
+            }
+        }
+        config.threads_ = static_cast<uint32_t>(args["--threads"].asLong());
+        config.cah_orders_ = static_cast<uint32_t>(max(1l, args["--cah-orders"].asLong()));
+        config.ls_cache_capacity_ = args["--ls-cache"].asLong();
+        config.ls_dlb_nn_count_ = max(0l, args["--ls-dlb"].asLong());
 
         auto trials = 1;
         if (args.count("--trials")) {
@@ -250,22 +518,38 @@ int main(int argc, char *argv[])
 
         record["experiment_id"] = args["--id"].asString();
 
-        unique_ptr<StopCondition> stop_condition{ nullptr };
         if (args["--timeout"]) {
             const auto timeout_str = args["--timeout"].asString();
-            const auto timeout_sec = std::atof(timeout_str.c_str());
-
-            stop_condition = make_unique<TimeoutStopCondition>(timeout_sec);
+            config.timeout_ = std::atof(timeout_str.c_str());
+            config.max_iterations_ = 0;
 
-            record["timeout"] = timeout_sec;
+            record["timeout"] = config.timeout_;
         } else {
             const auto max_iterations = args["--iterations"].asLong();
-            if (max_iterations > 0) {
-                stop_condition = make_unique<FixedIterationsStopCondition>(max_iterations);
-            }
+            config.max_iterations_ = static_cast<uint32_t>(max(0l, max_iterations));
             record["max_iterations"] = max_iterations;
         }
-        CHECK_F(stop_condition != nullptr, "Stop condition should be initialized");
+        CHECK_F(config.timeout_ > 0 || config.max_iterations_ > 0,
+                "Stop condition should be initialized");
+
+        if (args.count("--target") && args["--target"]) {
+            const auto value = args["--target"].asString();
+            const auto target_cost = (value == "best-known")
+                                   ? instance.best_known_cost_
+                                   : stoi(value);
+            CHECK_F(target_cost > 0, "Target cost should be > 0, is the best known cost available?");
+            config.target_cost_ = target_cost;
+            record["target_cost"] = target_cost;
+        }
+        if (args.count("--stagnation") && args["--stagnation"]) {
+            const auto max_idle = args["--stagnation"].asLong();
+            CHECK_F(max_idle > 0, "Stagnation limit should be > 0");
+            config.stagnation_iterations_ = static_cast<uint32_t>(max_idle);
+            record["stagnation_iterations"] = max_idle;
+        }
+
+        std::signal(SIGINT, handle_stop_signal);
+        std::signal(SIGTERM, handle_stop_signal);
 
         record["trials_count"] = trials;
         record["instance_path"] = path;
@@ -273,7 +557,59 @@ int main(int argc, char *argv[])
         record["instance_dimension"] = instance.dimension_;
         record["instance_product_count"] = instance.product_count_;
         record["best_known_cost"] = instance.best_known_cost_;
-        record["rng_seed"] = get_initial_seed();
+        record["rng_seed"] = config.seed_;
+        // Time of the instance loading and preprocessing
+        record["startup_time"] = chrono::duration<double>(
+                chrono::steady_clock::now() - program_start_time).count();
+
+        EventWriter events;
+        if (args.count("--events") && args["--events"]) {
+            events.open(args["--events"].asString());
+        }
+
+        unique_ptr<CheckpointWriter> checkpoints;
+        if (args.count("--checkpoint") && args["--checkpoint"]) {
+            CHECK_F(alg == Algorithm::ACO, "Checkpoints require --alg=aco");
+            checkpoints = make_unique<CheckpointWriter>(args["--checkpoint"].asString());
+        }
+        const auto checkpoint_every = max(1l, args["--checkpoint-every"].asLong());
+
+        auto first_trial = 0;
+        unique_ptr<Checkpoint> resume_checkpoint;
+        if (args.count("--resume") && args["--resume"]) {
+            CHECK_F(alg == Algorithm::ACO, "Resuming requires --alg=aco");
+            resume_checkpoint = make_unique<Checkpoint>(
+                    load_checkpoint(args["--resume"].asString()));
+            CHECK_F(resume_checkpoint->dimension_ == instance.dimension_
+                    && resume_checkpoint->products_count_ == instance.product_count_,
+                    "The checkpoint does not match the instance");
+            first_trial = static_cast<int>(resume_checkpoint->trial_);
+            record["resumed_from_trial"] = first_trial;
+            record["resumed_from_iteration"] = resume_checkpoint->state_.current_iteration_;
+        }
+
+        if (args.count("--init-solution") && args["--init-solution"]) {
+            CHECK_F(alg == Algorithm::ACO, "Initial solution requires --alg=aco");
+            config.initial_route_ = load_route(args["--init-solution"].asString());
+            record["init_solution"] = args["--init-solution"].asString();
+        }
+        if (args.count("--init-pheromone") && args["--init-pheromone"]) {
+            CHECK_F(alg == Algorithm::ACO, "Initial pheromone requires --alg=aco");
+            const auto path = args["--init-pheromone"].asString();
+            auto checkpoint = load_checkpoint(path);
+            CHECK_F(checkpoint.dimension_ == instance.dimension_,
+                    "The pheromone in %s is for a different number of markets",
+                    path.c_str());
+            config.initial_trails_ = move(checkpoint.state_.pheromone_trails_);
+            record["init_pheromone"] = path;
+        }
+
+        vector<TPP::InstanceDelta> deltas;
+        if (args.count("--deltas") && args["--deltas"]) {
+            CHECK_F(alg == Algorithm::ACO && trials == 1,
+                    "Dynamic mode requires --alg=aco and a single trial");
+            deltas = load_deltas(args["--deltas"].asString());
+        }
 
         json trials_record = json::array();
 
@@ -283,32 +619,81 @@ int main(int argc, char *argv[])
         vector<int> trials_best_cost;
         vector<double> trials_best_error;
 
-        for (auto trial = 0; trial < trials; ++trial) {
+        Solver solver(instance, move(config));
+        // A signal received before this is noticed by the loop below
+        running_solver = &solver;
+
+        for (auto trial = first_trial; trial < trials && !is_stop_requested(); ++trial) {
             json trial_record;
 
+            if (trial > first_trial) {
+                solver.reset();
+            }
+            if (events.is_open() || checkpoints) {
+                solver.iteration_done_callback_ = [&](const Solver &solver) {
+                    const auto &aco = *solver.aco_;
+                    if (events.is_open()) {
+                        events.push(trial, aco.iteration_stats_);
+                    }
+                    // An interrupted iteration (signal or time limit) is not
+                    // saved as it would not be reproducible
+                    if (checkpoints && !is_stop_requested()
+                            && !aco.iteration_stats_.interrupted_
+                            && aco.current_iteration_ % checkpoint_every == 0) {
+                        Checkpoint checkpoint;
+                        checkpoint.trial_ = static_cast<uint32_t>(trial);
+                        checkpoint.dimension_ = instance.dimension_;
+                        checkpoint.products_count_ = instance.product_count_;
+                        checkpoint.state_ = aco.get_state();
+                        checkpoints->submit(move(checkpoint));
+                    }
+                };
+            }
+            if (resume_checkpoint) {
+                solver.aco_->resume_from(move(resume_checkpoint->state_));
+                resume_checkpoint = nullptr;
+            }
+            perform_trial(solver, trial_record);
+            trials_record.push_back(trial_record);
+
+            const auto &result = solver.result_;
+            if (result.cost_ == 0) {
+                break ;
+            }
+            if (result.cost_ < best_found_cost) {
+                best_found_cost = result.cost_;
+                best_found_solution = result.route_;
+                best_found_error = result.relative_error_;
+            }
+            trials_best_cost.push_back(result.cost_);
+            trials_best_error.push_back(result.relative_error_);
+
             if (alg == Algorithm::ACO) {
-                ACO aco(instance);
-                perform_trial(aco, stop_condition.get(), trial_record);
-                trials_record.push_back(trial_record);
-
-                if (!aco.global_best_) {
-                    break ;
-                }
-                const auto &best_ant = *aco.global_best_;
-                if (best_ant.cost() < best_found_cost) {
-                    best_found_cost = best_ant.cost();
-                    best_found_solution = best_ant.solution_.route_;
-                    best_found_error = best_ant.solution_.get_relative_error();
-                }
-                trials_best_cost.push_back(best_ant.cost());
-                trials_best_error.push_back(best_ant.solution_.get_relative_error());
-
-                record["aco_parameters"] = record_aco_parameters(aco);
-            } else if (alg == Algorithm::CAH) {
-                perform_trial_cah(instance, stop_condition.get(), trial_record);
+                record["aco_parameters"] = record_aco_parameters(*solver.aco_);
+            } else {
+                record["cah_orders"] = solver.config_.cah_orders_;
+                record["cah_threads"] = solver.config_.threads_;
+            }
+
+            if (!deltas.empty()) {
+                const auto iterations = args["--delta-iterations"].asLong();
+                record["delta_iterations"] = iterations;
+                record["deltas"] = perform_deltas(solver, instance, deltas,
+                                                  static_cast<uint32_t>(iterations));
             }
         }
+        running_solver = nullptr;
         record["trials"] = trials_record;
+        record["interrupted"] = is_stop_requested();
+
+        if (checkpoints) {
+            checkpoints->close();
+        }
+
+        if (events.is_open()) {
+            events.close();
+            record["events_dropped"] = events.dropped_;
+        }
 
         record["best_found_cost"] = best_found_cost;
         record["best_found_error"] = best_found_error;
@@ -0,0 +1,162 @@
+#include <algorithm>
+
+#include "or_opt.h"
+#include "route_neighborhood.h"
+#include "logging.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/*
+ * Tries to find an improving 2-opt move which introduces an edge between
+ * a and one of its nearest neighbors. The first such move is applied.
+ */
+bool improve_2opt(RouteNeighborhood &nh, uint32_t a) noexcept {
+    if (nh.len_ < 4) {
+        return false;
+    }
+    const auto &nn_list = nh.instance_.nn_lists_[a];
+    const auto nn_count = min(nh.nn_count_, nn_list.size());
+
+    for (auto dir = 0; dir < 2; ++dir) {
+        const auto b = (dir == 0) ? nh.succ(a) : nh.pred(a);
+        const auto d_ab = nh.dist(a, b);
+
+        for (auto idx = 0u; idx < nn_count; ++idx) {
+            const auto c = nn_list[idx];
+            const auto g1 = d_ab - nh.dist(a, c);
+            if (g1 <= 0) {
+                break ;  // The remaining neighbors are even further
+            }
+            if (!nh.is_in_route(c) || c == b) {
+                continue ;
+            }
+            const auto d = (dir == 0) ? nh.succ(c) : nh.pred(c);
+            if (d == a) {
+                continue ;
+            }
+            const auto gain = g1 + nh.dist(c, d) - nh.dist(b, d);
+            if (gain > 0) {
+                nh.make_2opt_move(a, b, c, d);
+                nh.travel_cost_change_ -= gain;
+                nh.reset_dont_look_bits({ a, b, c, d });
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+/*
+ * Tries to find an improving move of a segment of 1, 2 or 3 markets
+ * starting at a to a place next to one of the nearest neighbors of the
+ * segment's ends. The first such move is applied.
+ */
+bool improve_or_opt(RouteNeighborhood &nh, uint32_t a) noexcept {
+    const auto len = nh.len_;
+    const auto first = nh.pos_in_route_[a];
+
+    for (auto k = 1u; k <= 3 && k + 3 <= len; ++k) {
+        const auto s1 = a;
+        const auto s2 = nh.route_[(first + k - 1) % len];
+        const auto p = nh.pred(s1);
+        const auto n = nh.succ(s2);
+        const auto removal_gain = nh.dist(p, s1) + nh.dist(s2, n) - nh.dist(p, n);
+        if (removal_gain <= 0) {
+            continue ;
+        }
+        auto in_segment = [&](uint32_t m) {
+            return (nh.pos_in_route_[m] + len - first) % len < k;
+        };
+
+        for (auto end : { s1, s2 }) {
+            const auto &nn_list = nh.instance_.nn_lists_[end];
+            const auto nn_count = min(nh.nn_count_, nn_list.size());
+
+            for (auto idx = 0u; idx < nn_count; ++idx) {
+                const auto c = nn_list[idx];
+                if (nh.dist(end, c) >= removal_gain) {
+                    break ;
+                }
+                if (!nh.is_in_route(c) || in_segment(c)) {
+                    continue ;
+                }
+                for (auto x : { nh.pred(c), c }) {
+                    const auto e = nh.succ(x);
+                    if (in_segment(x) || in_segment(e)) {
+                        continue ;
+                    }
+                    const auto d_xe = nh.dist(x, e);
+                    const auto gain_fwd = removal_gain - (nh.dist(x, s1) + nh.dist(s2, e) - d_xe);
+                    const auto gain_rev = removal_gain - (nh.dist(x, s2) + nh.dist(s1, e) - d_xe);
+                    if (gain_fwd > 0 || gain_rev > 0) {
+                        const bool reversed = gain_rev > gain_fwd;
+                        nh.move_segment(first, k, nh.pos_in_route_[x], reversed);
+                        nh.travel_cost_change_ -= max(gain_fwd, gain_rev);
+                        nh.reset_dont_look_bits({ p, n, s1, s2, x, e });
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+int two_opt_or_opt_search(const TPP::Instance &instance, TPP::Solution &sol,
+                          bool use_dont_look_bits, size_t nn_count,
+                          bool use_2opt, bool use_or_opt) {
+    CHECK_F(instance.is_symmetric_, "Symmetric instance expected!");
+
+    auto &route = sol.route_;
+    if (route.size() < 3) {
+        return 0;
+    }
+    const auto old_travel_cost = instance.calc_travel_cost(route);
+
+    RouteNeighborhood nh(instance, route, nn_count);
+
+    auto found_improvement = false;
+    do {
+        found_improvement = false;
+        for (auto i = 0u; i < nh.len_; ++i) {
+            const auto a = route[i];
+            if (nh.dont_look_bits_[a]) {
+                continue ;
+            }
+            const auto found = (use_2opt && improve_2opt(nh, a))
+                            || (use_or_opt && improve_or_opt(nh, a));
+            if (found) {
+                found_improvement = true;
+            } else if (use_dont_look_bits) {
+                nh.dont_look_bits_[a] = true;
+            }
+        }
+    } while (found_improvement);
+
+    return nh.apply_to(sol, old_travel_cost);
+}
+
+
+int two_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+               bool use_dont_look_bits, size_t nn_count) {
+    return two_opt_or_opt_search(instance, sol, use_dont_look_bits, nn_count,
+                                 /*use_2opt=*/true, /*use_or_opt=*/false);
+}
+
+
+int or_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+              bool use_dont_look_bits, size_t nn_count) {
+    return two_opt_or_opt_search(instance, sol, use_dont_look_bits, nn_count,
+                                 /*use_2opt=*/false, /*use_or_opt=*/true);
+}
+
+
+int two_opt_or_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+                      bool use_dont_look_bits, size_t nn_count) {
+    return two_opt_or_opt_search(instance, sol, use_dont_look_bits, nn_count,
+                                 /*use_2opt=*/true, /*use_or_opt=*/true);
+}
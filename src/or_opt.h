@@ -0,0 +1,47 @@
+#ifndef OR_OPT_H
+#define OR_OPT_H
+
+
+#include "tpp_solution.h"
+
+
+/*
+ * A first-improvement version of the 2-opt heuristic in which for each market
+ * only edges leading to its nn_count nearest neighbors are considered.
+ *
+ * The solution's route is modified only if a better order was found.
+ *
+ * Returns the change of the route length (travel distance), i.e. a value
+ * <= 0.
+ */
+int two_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+               bool use_dont_look_bits=true, size_t nn_count=25);
+
+
+/*
+ * Impl. of the Or-opt heuristic, i.e. segments of 1, 2 or 3 consecutive
+ * markets are moved (and possibly reversed) to a place next to one of the
+ * nn_count nearest neighbors of the segment's ends.
+ *
+ * The solution's route is modified only if a better order was found.
+ *
+ * Returns the change of the route length (travel distance), i.e. a value
+ * <= 0.
+ */
+int or_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+              bool use_dont_look_bits=true, size_t nn_count=25);
+
+
+/*
+ * Runs both the first-improvement 2-opt and the Or-opt moves until neither
+ * of them can find an improvement. It is a cheaper alternative to
+ * three_opt_nn.
+ *
+ * Returns the change of the route length (travel distance), i.e. a value
+ * <= 0.
+ */
+int two_opt_or_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
+                      bool use_dont_look_bits=true, size_t nn_count=25);
+
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <mutex>
+
+#include "profiler.h"
+
+using namespace std;
+
+
+namespace {
+
+    struct ThreadProfile;
+
+
+    /*
+     * Names of the timers and counters and the profiles of the live threads.
+     * The values of the finished threads are moved to retired_.
+     */
+    struct Registry {
+        mutex mutex_;
+        vector<ProfileEntry> entries_;
+        vector<ThreadProfile*> threads_;
+        vector<ProfileEntry> retired_;
+    };
+
+
+    Registry &get_registry() {
+        static Registry registry;
+        return registry;
+    }
+
+
+    struct ThreadProfile {
+        vector<uint64_t> counts_;
+        vector<uint64_t> total_ns_;
+
+        ThreadProfile() {
+            auto &registry = get_registry();
+            lock_guard<mutex> lock(registry.mutex_);
+            registry.threads_.push_back(this);
+        }
+
+        ~ThreadProfile() {
+            auto &registry = get_registry();
+            lock_guard<mutex> lock(registry.mutex_);
+            auto &retired = registry.retired_;
+            retired.resize(max(retired.size(), counts_.size()));
+            for (auto i = 0u; i < counts_.size(); ++i) {
+                retired[i].count_ += counts_[i];
+                retired[i].total_ns_ += total_ns_[i];
+            }
+            auto &threads = registry.threads_;
+            threads.erase(remove(begin(threads), end(threads), this), end(threads));
+        }
+    };
+
+
+    ThreadProfile &get_thread_profile() {
+        thread_local ThreadProfile profile;
+        return profile;
+    }
+
+
+    uint32_t register_entry(const char *name, bool is_timer) {
+        auto &registry = get_registry();
+        lock_guard<mutex> lock(registry.mutex_);
+        auto &entries = registry.entries_;
+        for (auto i = 0u; i < entries.size(); ++i) {
+            if (entries[i].name_ == name && entries[i].is_timer_ == is_timer) {
+                return i;
+            }
+        }
+        ProfileEntry entry;
+        entry.name_ = name;
+        entry.is_timer_ = is_timer;
+        entries.push_back(entry);
+        return static_cast<uint32_t>(entries.size() - 1);
+    }
+}
+
+
+uint32_t profiler::register_timer(const char *name) {
+    return register_entry(name, true);
+}
+
+
+uint32_t profiler::register_counter(const char *name) {
+    return register_entry(name, false);
+}
+
+
+void profiler::add(uint32_t id, uint64_t count, uint64_t total_ns) noexcept {
+    auto &profile = get_thread_profile();
+    if (id >= profile.counts_.size()) {
+        profile.counts_.resize(id + 1, 0);
+        profile.total_ns_.resize(id + 1, 0);
+    }
+    profile.counts_[id] += count;
+    profile.total_ns_[id] += total_ns;
+}
+
+
+vector<ProfileEntry> profiler::get_profile() {
+    auto &registry = get_registry();
+    lock_guard<mutex> lock(registry.mutex_);
+    auto result = registry.entries_;
+    for (auto i = 0u; i < result.size() && i < registry.retired_.size(); ++i) {
+        result[i].count_ += registry.retired_[i].count_;
+        result[i].total_ns_ += registry.retired_[i].total_ns_;
+    }
+    for (auto *profile : registry.threads_) {
+        for (auto i = 0u; i < result.size() && i < profile->counts_.size(); ++i) {
+            result[i].count_ += profile->counts_[i];
+            result[i].total_ns_ += profile->total_ns_[i];
+        }
+    }
+    return result;
+}
+
+
+void profiler::reset() {
+    auto &registry = get_registry();
+    lock_guard<mutex> lock(registry.mutex_);
+    registry.retired_.clear();
+    for (auto *profile : registry.threads_) {
+        fill(begin(profile->counts_), end(profile->counts_), 0);
+        fill(begin(profile->total_ns_), end(profile->total_ns_), 0);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * A low-overhead instrumentation of the hot paths: scoped timers and event
+ * counters identified by names.
+ *
+ * Each thread aggregates its measurements locally (no locks or atomics on
+ * the hot path), the per-thread values are summed by get_profile().
+ *
+ * The profile is process-wide, i.e. it is not kept per Solver, so it
+ * describes a single run only if no other solver runs at the same time,
+ * e.g. in ants-tpp but not in the server.
+ *
+ * The macros PROFILE_SCOPE and PROFILE_COUNT compile to nothing unless
+ * TPP_PROFILE is defined (make profile=1).
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+struct ProfileEntry {
+    std::string name_;
+    bool is_timer_ = false;
+    uint64_t count_ = 0;  // No. of timed scopes or the counter value
+    uint64_t total_ns_ = 0;
+};
+
+
+namespace profiler {
+
+    uint32_t register_timer(const char *name);
+
+    uint32_t register_counter(const char *name);
+
+    void add(uint32_t id, uint64_t count, uint64_t total_ns = 0) noexcept;
+
+    /*
+     * Returns the measurements summed over all threads. It should not be
+     * called while the profiled code is running in other threads.
+     */
+    std::vector<ProfileEntry> get_profile();
+
+    void reset();
+
+
+    struct ScopedTimer {
+        uint32_t id_;
+        std::chrono::steady_clock::time_point start_;
+
+        explicit ScopedTimer(uint32_t id) noexcept
+            : id_(id),
+              start_(std::chrono::steady_clock::now()) {
+        }
+
+        ~ScopedTimer() {
+            const auto elapsed = std::chrono::steady_clock::now() - start_;
+            add(id_, 1, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    };
+}
+
+
+#define PROFILE_CONCAT_IMPL(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef TPP_PROFILE
+
+#define PROFILE_SCOPE(name) \
+    static const auto PROFILE_CONCAT(profile_timer_id_, __LINE__) \
+        = profiler::register_timer(name); \
+    profiler::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)( \
+        PROFILE_CONCAT(profile_timer_id_, __LINE__))
+
+#define PROFILE_COUNT(name, n) \
+    do { \
+        static const auto profile_counter_id = profiler::register_counter(name); \
+        profiler::add(profile_counter_id, (n)); \
+    } while (false)
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while (false)
+#define PROFILE_COUNT(name, n) do {} while (false)
+
+#endif
+
+
+#endif
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <chrono>
 #include <random>
 
@@ -8,21 +9,28 @@
 using namespace std;
 
 
-uint32_t initial_seed = 0;
+// 0 until it is set or drawn from the clock by the first get_initial_seed,
+// which can be called concurrently, e.g. by the threads of the CAH
+static atomic<uint32_t> initial_seed{ 0 };
 
 
 uint32_t get_initial_seed() {
-    if (::initial_seed == 0) {
-        auto t = chrono::system_clock::now().time_since_epoch().count();
-        ::initial_seed = t;
+    auto seed = ::initial_seed.load();
+    if (seed == 0) {
+        const auto t = static_cast<uint32_t>(
+                chrono::system_clock::now().time_since_epoch().count());
+        const auto drawn = max(1u, t);
+        // Only the first of the racing threads sets the seed, the others
+        // get its value
+        seed = ::initial_seed.compare_exchange_strong(seed, drawn) ? drawn : seed;
     }
-    return initial_seed;;
+    return seed;
 }
 
 
 void set_initial_seed(uint32_t value) {
     CHECK_F(value != 0, "Initial seed value needs to be > 0");
-    ::initial_seed = value;
+    ::initial_seed.store(value);
 }
 
 
@@ -30,8 +38,12 @@ void set_initial_seed(uint32_t value) {
  * Initializes generator using std::default_random_engine seeded with current
  * time.
  */
-xoroshiro128plus::xoroshiro128plus() {
-    const auto seed = get_initial_seed();
+xoroshiro128plus::xoroshiro128plus()
+    : xoroshiro128plus(get_initial_seed()) {
+}
+
+
+xoroshiro128plus::xoroshiro128plus(uint32_t seed) {
     auto rnd_engine = default_random_engine(seed);
     state_[0] = rnd_engine();
     state_[1] = rnd_engine();
@@ -57,12 +69,30 @@ uint64_t xoroshiro128plus::next() noexcept {
 
 
 
+// Set by ScopedRandomEngine
+static thread_local xoroshiro128plus *current_engine = nullptr;
+
+
 xoroshiro128plus& get_random_engine() {
-    static xoroshiro128plus engine;
+    if (current_engine != nullptr) {
+        return *current_engine;
+    }
+    thread_local xoroshiro128plus engine;
     return engine;
 }
 
 
+ScopedRandomEngine::ScopedRandomEngine(xoroshiro128plus &engine) noexcept
+    : previous_(current_engine) {
+    current_engine = &engine;
+}
+
+
+ScopedRandomEngine::~ScopedRandomEngine() {
+    current_engine = previous_;
+}
+
+
 /**
  * Returns a random sample of sample_size numbers from 0 to n-1.
  * TODO this is inefficient - complexity is O(n) instead of O(sample_size)
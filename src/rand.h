@@ -6,6 +6,10 @@
 #include <algorithm>
 
 
+/**
+ * Returns the seed set with set_initial_seed or, if not set, the one drawn
+ * from the clock on the first call. Thread-safe.
+ */
 uint32_t get_initial_seed();
 
 
@@ -23,6 +27,8 @@ struct xoroshiro128plus {
 
     xoroshiro128plus();
 
+    explicit xoroshiro128plus(uint32_t seed);
+
     uint64_t next(void) noexcept;
 
     uint64_t operator()() noexcept { return next(); }
@@ -33,9 +39,33 @@ struct xoroshiro128plus {
 };
 
 
+/**
+ * Returns the generator of the calling thread, i.e. the one set with a
+ * ScopedRandomEngine if any, otherwise the thread's own generator
+ * initialized with the initial seed.
+ */
 xoroshiro128plus& get_random_engine();
 
 
+/**
+ * Makes the engine the generator of the calling thread for the lifetime of
+ * this object, so e.g. a Solver draws the numbers from its own generator no
+ * matter which thread runs it.
+ */
+struct ScopedRandomEngine {
+    explicit ScopedRandomEngine(xoroshiro128plus &engine) noexcept;
+
+    ~ScopedRandomEngine();
+
+    ScopedRandomEngine(const ScopedRandomEngine &) = delete;
+
+    ScopedRandomEngine& operator=(const ScopedRandomEngine &) = delete;
+
+private:
+    xoroshiro128plus *previous_;
+};
+
+
 template<typename T>
 void shuffle_vector(std::vector<T> &vec) {
     std::shuffle(vec.begin(), vec.end(), get_random_engine());
@@ -46,7 +76,7 @@ void shuffle_vector(std::vector<T> &vec) {
  * Returns uniform random value in range [0, 1)
  */
 inline double get_random_value() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
     return distribution(get_random_engine());
 }
 
@@ -56,7 +86,7 @@ inline double get_random_value() {
  * probability.
  */
 inline double get_random_uint(uint32_t min, uint32_t max) {
-    static std::uniform_int_distribution<uint32_t> distribution(min, max);
+    std::uniform_int_distribution<uint32_t> distribution(min, max);
     return distribution(get_random_engine());
 }
 
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <array>
+
+#include "route_neighborhood.h"
+#include "logging.h"
+
+using namespace std;
+
+
+RouteNeighborhood::RouteNeighborhood(const TPP::Instance &instance,
+                                     vector<uint32_t> &route,
+                                     size_t nn_count)
+    : instance_(instance),
+      route_(route),
+      len_(static_cast<uint32_t>(route.size())),
+      nn_count_(nn_count),
+      pos_in_route_(instance.dimension_, len_),
+      dont_look_bits_(instance.dimension_, false) {
+
+    for (auto i = 0u; i < len_; ++i) {
+        pos_in_route_[ route_[i] ] = i;
+    }
+}
+
+
+/*
+ * Reverses the order of markets at positions first, first + 1, ..., last
+ * (modulo route length). If the complementary part of the route is
+ * shorter it is reversed instead - the resulting tour is the same.
+ *
+ * Complexity is O(min(segment length, route length - segment length))
+ */
+void RouteNeighborhood::reverse_path(uint32_t first, uint32_t last) noexcept {
+    auto size = (last + len_ - first) % len_ + 1;
+    if (2 * size > len_) {  // Reverse the other part
+        const auto new_first = (last + 1) % len_;
+        last = (first + len_ - 1) % len_;
+        first = new_first;
+        size = len_ - size;
+    }
+    for (auto k = 0u; k < size / 2; ++k) {
+        const auto a = route_[first];
+        const auto b = route_[last];
+        set_at(first, b);
+        set_at(last, a);
+        first = (first + 1 == len_) ? 0 : first + 1;
+        last = (last == 0) ? len_ - 1 : last - 1;
+    }
+}
+
+
+/*
+ * Replaces edges (a, b) and (c, d) with (a, c) and (b, d), where b is a
+ * successor of a, and d is a successor of c (or both are predecessors if
+ * the route orientation was flipped by the previous reversals).
+ */
+void RouteNeighborhood::make_2opt_move(uint32_t a, uint32_t b,
+                                       uint32_t c, uint32_t d) noexcept {
+    if (succ(a) == b) {  // a b ... c d -> a c ... b d
+        reverse_path(pos_in_route_[b], pos_in_route_[c]);
+    } else {  // d c ... b a -> d b ... c a
+        reverse_path(pos_in_route_[c], pos_in_route_[b]);
+    }
+}
+
+
+/*
+ * Moves a segment of k <= 3 markets starting at position first so that
+ * it is placed right after the market at position after. The segment is
+ * reversed if reversed == true.
+ *
+ * The markets between the segment and its new place are shifted by k
+ * positions, the shorter of the two possible paths is chosen.
+ */
+void RouteNeighborhood::move_segment(uint32_t first, uint32_t k,
+                                     uint32_t after, bool reversed) noexcept {
+    array<uint32_t, 3> segment;
+    for (auto t = 0u; t < k; ++t) {
+        segment[t] = route_[(first + t) % len_];
+    }
+    if (reversed) {
+        reverse(segment.begin(), segment.begin() + k);
+    }
+    // l1 = number of markets from the segment's successor to 'after'
+    const auto l1 = (after + len_ - (first + k) % len_) % len_ + 1;
+    const auto l2 = len_ - k - l1;
+    uint32_t dest = 0;
+    if (l1 <= l2) {  // Shift the markets (succ, ..., after) left
+        for (auto t = 0u; t < l1; ++t) {
+            set_at((first + t) % len_, route_[(first + k + t) % len_]);
+        }
+        dest = (first + l1) % len_;
+    } else {  // Shift the markets (after + 1, ..., pred) right
+        for (auto t = 0u; t < l2; ++t) {
+            const auto from = (first + len_ - 1 - t) % len_;
+            set_at((from + k) % len_, route_[from]);
+        }
+        dest = (after + 1) % len_;
+    }
+    for (auto t = 0u; t < k; ++t) {
+        set_at((dest + t) % len_, segment[t]);
+    }
+}
+
+
+/*
+ * Moves the depot back to the front of the route and updates the cost of
+ * the solution by travel_cost_change_.
+ *
+ * Returns travel_cost_change_
+ */
+int RouteNeighborhood::apply_to(TPP::Solution &sol, int old_travel_cost) noexcept {
+    auto &route = sol.route_;
+    // It may happen that depot is moved to another position
+    auto depot_pos = find(begin(route), end(route), 0);
+    if (depot_pos != route.begin()) {
+        rotate(begin(route), depot_pos, end(route));
+    }
+    const auto delta = travel_cost_change_;
+    DEBUG_CHECK_F(instance_.calc_travel_cost(route) - old_travel_cost == delta,
+            "Travel cost change should be equal to predicted");
+    sol.cost_ += delta;
+    sol.travel_cost_ += delta;
+    return delta;
+}
@@ -0,0 +1,92 @@
+#ifndef ROUTE_NEIGHBORHOOD_H
+#define ROUTE_NEIGHBORHOOD_H
+
+#include <initializer_list>
+
+#include "tpp_solution.h"
+
+
+/*
+ * The state shared by the route optimization heuristics (2-opt, Or-opt,
+ * 3-opt), i.e. the route, positions of the markets in the route and the
+ * don't look bits.
+ *
+ * The moves are applied in place and pos_in_route_ is updated only for the
+ * markets which were actually moved.
+ */
+struct RouteNeighborhood {
+    const TPP::Instance &instance_;
+    std::vector<uint32_t> &route_;
+    const uint32_t len_;
+    const size_t nn_count_;
+    std::vector<uint32_t> pos_in_route_;  // [m] = len_ if m is not in route
+    std::vector<uint8_t> dont_look_bits_;
+    int travel_cost_change_{ 0 };
+
+
+    RouteNeighborhood(const TPP::Instance &instance,
+                      std::vector<uint32_t> &route,
+                      size_t nn_count);
+
+    int dist(uint32_t a, uint32_t b) const noexcept {
+        return instance_.get_travel_cost(a, b);
+    }
+
+    uint32_t succ(uint32_t market) const noexcept {
+        const auto pos = pos_in_route_[market] + 1;
+        return route_[pos == len_ ? 0 : pos];
+    }
+
+    uint32_t pred(uint32_t market) const noexcept {
+        const auto pos = pos_in_route_[market];
+        return route_[pos == 0 ? len_ - 1 : pos - 1];
+    }
+
+    bool is_in_route(uint32_t market) const noexcept {
+        return pos_in_route_[market] != len_;
+    }
+
+    void set_at(uint32_t pos, uint32_t market) noexcept {
+        route_[pos] = market;
+        pos_in_route_[market] = pos;
+    }
+
+    void reset_dont_look_bits(std::initializer_list<uint32_t> markets) noexcept {
+        for (auto m : markets) {
+            dont_look_bits_[m] = false;
+        }
+    }
+
+    /*
+     * Reverses the order of markets at positions first, first + 1, ..., last
+     * (modulo route length). If the complementary part of the route is
+     * shorter it is reversed instead - the resulting tour is the same.
+     */
+    void reverse_path(uint32_t first, uint32_t last) noexcept;
+
+    /*
+     * Replaces edges (a, b) and (c, d) with (a, c) and (b, d), where b is a
+     * successor of a, and d is a successor of c (or both are predecessors if
+     * the route orientation was flipped by the previous reversals).
+     */
+    void make_2opt_move(uint32_t a, uint32_t b, uint32_t c, uint32_t d) noexcept;
+
+    /*
+     * Moves a segment of k <= 3 markets starting at position first so that
+     * it is placed right after the market at position after. The segment is
+     * reversed if reversed == true.
+     */
+    void move_segment(uint32_t first, uint32_t k, uint32_t after,
+                      bool reversed) noexcept;
+
+    /*
+     * Moves the depot back to the front of the route and updates the cost of
+     * the solution by travel_cost_change_.
+     *
+     * Returns travel_cost_change_
+     */
+    int apply_to(TPP::Solution &sol, int old_travel_cost) noexcept;
+};
+
+
+#endif
@@ -0,0 +1,610 @@
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "instance_generator.h"
+#include "logging.h"
+#include "solver.h"
+#include "stopcondition.h"
+#include "tpp_info.h"
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+
+shared_ptr<CachedInstance> InstanceCache::get(const string &path, string &error) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        ++lookups_;
+        auto it = index_.find(path);
+        if (it != index_.end()) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
+        }
+    }
+    auto cached = make_shared<CachedInstance>();
+    if (!TPP::try_load_from_file(path, cached->instance_, error)) {
+        return nullptr;
+    }
+    if (cached->instance_.is_capacitated_) {
+        error = "Capacitated instances are not supported: " + path;
+        return nullptr;
+    }
+    cached->instance_.best_known_cost_ = TPP::get_best_known_solution(path).cost_;
+
+    lock_guard<mutex> lock(mutex_);
+    if (index_.count(path) == 0 && capacity_ > 0) {
+        entries_.emplace_front(path, cached);
+        index_[path] = entries_.begin();
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+    return cached;
+}
+
+
+size_t InstanceCache::size() {
+    lock_guard<mutex> lock(mutex_);
+    return entries_.size();
+}
+
+
+/*
+ * A client of the server, the responses of the workers are written under
+ * the mutex so that the lines are not interleaved.
+ */
+struct Connection {
+    int in_fd_;
+    int out_fd_;
+    bool owns_fds_;
+    mutex write_mutex_;
+
+
+    Connection(int in_fd, int out_fd, bool owns_fds)
+        : in_fd_(in_fd), out_fd_(out_fd), owns_fds_(owns_fds) {
+    }
+
+    ~Connection() {
+        if (owns_fds_) {
+            close(in_fd_);
+            if (out_fd_ != in_fd_) {
+                close(out_fd_);
+            }
+        }
+    }
+
+    /*
+     * Returns false if the client is gone.
+     */
+    bool send(const json &message) {
+        const auto line = message.dump() + "\n";
+        lock_guard<mutex> lock(write_mutex_);
+        size_t written = 0;
+        while (written < line.size()) {
+            const auto n = write(out_fd_, line.data() + written,
+                                 line.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue ;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+};
+
+
+struct SolveJob {
+    shared_ptr<Connection> connection_;
+    json id_;
+    string instance_path_;
+    double timeout_ = 10;
+    uint32_t iterations_ = 0;  // 0 = no limit
+    uint32_t seed_ = 1;
+};
+
+
+struct JobQueue {
+    mutex mutex_;
+    condition_variable cv_;
+    deque<SolveJob> jobs_;
+    bool closed_ = false;
+
+
+    void push(SolveJob job) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            jobs_.push_back(move(job));
+        }
+        cv_.notify_one();
+    }
+
+    /*
+     * Returns false if the queue is closed and empty.
+     */
+    bool pop(SolveJob &job) {
+        unique_lock<mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !jobs_.empty() || closed_; });
+        if (jobs_.empty()) {
+            return false;
+        }
+        job = move(jobs_.front());
+        jobs_.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    size_t size() {
+        lock_guard<mutex> lock(mutex_);
+        return jobs_.size();
+    }
+};
+
+
+/*
+ * The solvers being run by the workers, the key is the dumped id of the
+ * solve request (the ids of the running requests may repeat). A solver
+ * publishes its best solutions to the anytime buffer without locking, the
+ * mutex only serializes the readers as the buffer allows a single reader at
+ * a time.
+ */
+struct RunningSolvers {
+    mutex mutex_;
+    unordered_multimap<string, Solver*> solvers_;
+};
+
+
+struct ServerState {
+    InstanceCache cache_;
+    JobQueue queue_;
+    RunningSolvers running_;
+    // Set by the shutdown request, the running solvers are cancelled and the
+    // queued requests are rejected
+    atomic<bool> shutdown_{ false };
+    const atomic<bool> *stop_flag_ = nullptr;
+
+
+    explicit ServerState(size_t cache_capacity) : cache_(cache_capacity) {}
+};
+
+
+bool is_shutting_down(const ServerState &server) {
+    return server.shutdown_.load(memory_order_relaxed)
+        || (server.stop_flag_ && server.stop_flag_->load(memory_order_relaxed));
+}
+
+
+/*
+ * Cancels the running solvers, the ones started later are not run.
+ */
+void shutdown(ServerState &server) {
+    lock_guard<mutex> lock(server.running_.mutex_);
+    server.shutdown_ = true;
+    for (auto &entry : server.running_.solvers_) {
+        entry.second->cancel();
+    }
+}
+
+
+json make_error(const json &id, int code, const string &message) {
+    return { {"jsonrpc", "2.0"}, {"id", id},
+             {"error", { {"code", code}, {"message", message} }} };
+}
+
+
+json make_result(const json &id, json result) {
+    return { {"jsonrpc", "2.0"}, {"id", id}, {"result", move(result)} };
+}
+
+
+/*
+ * Reads a line from the fd into line. The fd is polled so that the
+ * shutdown is noticed. Returns false on EOF, error or shutdown.
+ */
+bool read_line(int fd, string &buffer, string &line, const ServerState &server) {
+    while (true) {
+        const auto pos = buffer.find('\n');
+        if (pos != string::npos) {
+            line = buffer.substr(0, pos);
+            buffer.erase(0, pos + 1);
+            return true;
+        }
+        if (is_shutting_down(server)) {
+            return false;
+        }
+        pollfd pfd{ fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue ;  // Timeout or EINTR
+        }
+        char chunk[4096];
+        const auto n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            continue ;
+        }
+        if (n <= 0) {
+            if (!buffer.empty()) {  // The last line without '\n'
+                line = move(buffer);
+                buffer.clear();
+                return true;
+            }
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+
+void solve(SolveJob &job, ServerState &server) {
+    auto &connection = *job.connection_;
+    if (is_shutting_down(server)) {
+        connection.send(make_error(job.id_, -32000, "Server is shutting down"));
+        return ;
+    }
+    string error;
+    auto cached = server.cache_.get(job.instance_path_, error);
+    if (!cached) {
+        connection.send(make_error(job.id_, -32602, error));
+        return ;
+    }
+    SolverConfig config;
+    config.seed_ = job.seed_;
+    config.timeout_ = job.timeout_;
+    config.max_iterations_ = job.iterations_;
+    Solver solver(cached->instance_, config);
+    auto &aco = *solver.aco_;
+    // Reuse the CAH solution computed by a previous request, it does not
+    // depend on the seed
+    aco.greedy_solution_value_ = cached->greedy_cost_;
+
+    solver.new_best_found_callback_ = [&](const Solver &solver) {
+        const auto &improvement = solver.result_.improvements_.back();
+        connection.send({
+            {"jsonrpc", "2.0"},
+            {"method", "improved"},
+            {"params", {
+                {"id", job.id_},
+                {"cost", improvement.cost_},
+                {"route", solver.result_.route_},
+                {"iteration", improvement.iteration_},
+                {"time", improvement.time_},
+            }},
+        });
+    };
+
+    const auto key = job.id_.dump();
+    auto &running = server.running_;
+    bool shutting_down;
+    {
+        lock_guard<mutex> lock(running.mutex_);
+        // Checked under the lock as a solver registered after shutdown()
+        // would not be cancelled
+        shutting_down = is_shutting_down(server);
+        if (!shutting_down) {
+            running.solvers_.emplace(key, &solver);
+        }
+    }
+    if (shutting_down) {
+        connection.send(make_error(job.id_, -32000, "Server is shutting down"));
+        return ;
+    }
+    const auto &result = solver.run();
+    {
+        lock_guard<mutex> lock(running.mutex_);
+        auto range = running.solvers_.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == &solver) {
+                running.solvers_.erase(it);
+                break ;
+            }
+        }
+    }
+    cached->greedy_cost_ = aco.greedy_solution_value_;
+
+    if (result.cost_ == 0) {
+        connection.send(make_error(job.id_, -32000, "No solution found"));
+        return ;
+    }
+    connection.send(make_result(job.id_, {
+        {"cost", result.cost_},
+        {"route", result.route_},
+        {"iterations", result.iterations_},
+        {"duration", result.duration_},
+        {"best_known_cost", cached->instance_.best_known_cost_},
+    }));
+}
+
+
+void worker_loop(ServerState &server) {
+    SolveJob job;
+    while (server.queue_.pop(job)) {
+        solve(job, server);
+        job = SolveJob();  // Releases the connection
+    }
+}
+
+
+void handle_request(const shared_ptr<Connection> &connection, const string &line,
+                    ServerState &server) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+        return ;
+    }
+    json request;
+    try {
+        request = json::parse(line);
+    } catch (const exception &) {
+        connection->send(make_error(nullptr, -32700, "Parse error"));
+        return ;
+    }
+    if (!request.is_object() || !request.count("method")
+            || !request["method"].is_string()) {
+        connection->send(make_error(nullptr, -32600, "Invalid request"));
+        return ;
+    }
+    const auto id = request.value("id", json());
+    const auto method = request["method"].get<string>();
+    const auto params = request.value("params", json::object());
+
+    if (method == "solve") {
+        SolveJob job;
+        try {
+            job.instance_path_ = params.at("instance").get<string>();
+            job.timeout_ = params.value("timeout", job.timeout_);
+            job.iterations_ = params.value("iterations", job.iterations_);
+            job.seed_ = params.value("seed", job.seed_);
+        } catch (const exception &) {
+            connection->send(make_error(id, -32602, "Invalid params"));
+            return ;
+        }
+        if (job.timeout_ <= 0 && job.iterations_ == 0) {
+            connection->send(make_error(id, -32602, "Either timeout or iterations should be > 0"));
+            return ;
+        }
+        job.connection_ = connection;
+        job.id_ = id;
+        server.queue_.push(move(job));
+    } else if (method == "best") {
+        if (!params.count("id")) {
+            connection->send(make_error(id, -32602, "Invalid params"));
+            return ;
+        }
+        auto &running = server.running_;
+        lock_guard<mutex> lock(running.mutex_);
+        auto it = running.solvers_.find(params["id"].dump());
+        if (it == running.solvers_.end()) {
+            connection->send(make_error(id, -32000, "No such running request"));
+            return ;
+        }
+        const auto &best = it->second->aco_->anytime_best_.read();
+        if (best.version_ == 0) {
+            connection->send(make_error(id, -32000, "No solution found yet"));
+            return ;
+        }
+        connection->send(make_result(id, {
+            {"cost", best.cost_},
+            {"route", best.route_},
+            {"iteration", best.iteration_},
+            {"time", best.time_},
+            {"version", best.version_},
+        }));
+    } else if (method == "stats") {
+        connection->send(make_result(id, {
+            {"instance_cache", {
+                {"size", server.cache_.size()},
+                {"lookups", server.cache_.lookups_.load()},
+                {"hits", server.cache_.hits_.load()},
+            }},
+            {"queued", server.queue_.size()},
+        }));
+    } else if (method == "shutdown") {
+        connection->send(make_result(id, "ok"));
+        shutdown(server);
+    } else {
+        connection->send(make_error(id, -32601, "Method not found: " + method));
+    }
+}
+
+
+void read_requests(const shared_ptr<Connection> &connection, ServerState &server) {
+    string buffer;
+    string line;
+    while (read_line(connection->in_fd_, buffer, line, server)) {
+        handle_request(connection, line, server);
+    }
+}
+
+
+/*
+ * Accepts the clients until the shutdown, each one is served by a separate
+ * thread.
+ */
+void serve_socket(const string &path, ServerState &server) {
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_F(fd >= 0, "Cannot create socket");
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    CHECK_F(path.size() < sizeof(addr.sun_path), "Socket path too long");
+    path.copy(addr.sun_path, path.size());
+    unlink(path.c_str());
+    CHECK_F(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0,
+            "Cannot bind socket: %s", path.c_str());
+    CHECK_F(listen(fd, 16) == 0, "Cannot listen on socket: %s", path.c_str());
+    LOG_F(WARNING, "Listening on: %s", path.c_str());
+
+    struct Reader {
+        thread thread_;
+        shared_ptr<atomic<bool>> done_;
+    };
+    list<Reader> readers;
+    while (!is_shutting_down(server)) {
+        // Join the threads of the disconnected clients
+        for (auto it = readers.begin(); it != readers.end(); ) {
+            if (*it->done_) {
+                it->thread_.join();
+                it = readers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pollfd pfd{ fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue ;
+        }
+        const auto client_fd = accept(fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue ;
+        }
+        auto connection = make_shared<Connection>(client_fd, client_fd, true);
+        auto done = make_shared<atomic<bool>>(false);
+        thread reader([connection, done, &server] {
+            read_requests(connection, server);
+            *done = true;
+        });
+        readers.push_back({ move(reader), done });
+    }
+    for (auto &reader : readers) {
+        reader.thread_.join();
+    }
+    close(fd);
+    unlink(path.c_str());
+}
+
+
+void run_server(const string &target, const ServerConfig &config) {
+    // Writing to a disconnected client should not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerState server(config.instance_cache_capacity_);
+    server.stop_flag_ = config.stop_flag_;
+    vector<thread> workers;
+    for (auto i = 0u; i < max(1u, config.workers_); ++i) {
+        workers.emplace_back(worker_loop, ref(server));
+    }
+
+    if (target == "-") {
+        auto connection = make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false);
+        read_requests(connection, server);
+    } else {
+        serve_socket(target, server);
+    }
+    if (is_shutting_down(server)) {  // E.g. the stop flag was set
+        shutdown(server);
+    }
+    server.queue_.close();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+
+/*
+ * Handles the request as if it was sent by a client and solves the queued
+ * job (as a worker would). Returns the last message sent to the client.
+ */
+json send_test_request(ServerState &server, const json &request) {
+    auto out = tmpfile();
+    CHECK_F(out != nullptr, "Cannot create a temporary file");
+    {
+        auto connection = make_shared<Connection>(-1, fileno(out), false);
+        handle_request(connection, request.dump(), server);
+        SolveJob job;
+        if (server.queue_.size() > 0 && server.queue_.pop(job)) {
+            solve(job, server);
+        }
+    }
+    string output;
+    rewind(out);
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), out)) > 0) {
+        output.append(chunk, n);
+    }
+    fclose(out);
+
+    const auto end = output.find_last_not_of('\n');
+    CHECK_F(end != string::npos, "No response sent");
+    const auto begin = output.find_last_of('\n', end);
+    return json::parse(output.substr(begin == string::npos ? 0 : begin + 1));
+}
+
+
+void server_run_tests() {
+    LOG_SCOPE_F(INFO, "server_run_tests");
+
+    ServerState server(4);
+
+    const auto malformed_path = "/tmp/tpp-server-test-" + to_string(getpid()) + ".tpp";
+    {
+        ofstream out(malformed_path);
+        out << "NAME: malformed\nTYPE: TPP\nDIMENSION: 3\nEDGE_WEIGHT_TYPE: EUC_2D\n"
+            << "NODE_COORD_SECTION\n1 0 0\n2 1 x\n";
+    }
+    for (const auto &path : { malformed_path, string("/tmp") }) {
+        const auto response = send_test_request(server, {
+            {"jsonrpc", "2.0"}, {"id", 1}, {"method", "solve"},
+            {"params", { {"instance", path}, {"iterations", 1} }},
+        });
+        CHECK_F(response.count("error") && response["error"]["code"] == -32602,
+                "Loading %s should fail with invalid params: %s",
+                path.c_str(), response.dump().c_str());
+    }
+    remove(malformed_path.c_str());
+    CHECK_F(server.cache_.size() == 0, "The invalid instances should not be cached");
+
+    // The results should not depend on the previous requests, e.g. the
+    // first one computes the CAH solution which is cached for the others
+    const auto instance_path = "/tmp/tpp-server-test-" + to_string(getpid()) + "-gen.tpp";
+    {
+        TPP::GeneratorConfig config;
+        config.seed_ = 1;
+        config.markets_ = 50;
+        config.products_ = 20;
+        ofstream out(instance_path);
+        TPP::write_random_instance(out, config);
+    }
+    const json solve_request = {
+        {"jsonrpc", "2.0"}, {"id", 2}, {"method", "solve"},
+        {"params", { {"instance", instance_path}, {"iterations", 20}, {"seed", 3} }},
+    };
+    const auto first = send_test_request(server, solve_request);
+    const auto second = send_test_request(server, solve_request);
+    remove(instance_path.c_str());
+    CHECK_F(first.count("result") && second.count("result"), "The solves should succeed");
+    CHECK_F(first["result"]["cost"] == second["result"]["cost"]
+            && first["result"]["route"] == second["result"]["route"],
+            "Identical requests should give identical results: %s, %s",
+            first.dump().c_str(), second.dump().c_str());
+
+    const auto shutdown_response = send_test_request(server, {
+        {"jsonrpc", "2.0"}, {"id", 3}, {"method", "shutdown"},
+    });
+    CHECK_F(shutdown_response.count("result"), "The shutdown should succeed");
+    const auto rejected = send_test_request(server, solve_request);
+    CHECK_F(rejected.count("error") && rejected["error"]["code"] == -32000,
+            "A request after the shutdown should be rejected: %s",
+            rejected.dump().c_str());
+}
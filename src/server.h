@@ -0,0 +1,97 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "tpp.h"
+
+
+/*
+ * An instance loaded by the server together with the data which can be
+ * reused between the requests.
+ */
+struct CachedInstance {
+    TPP::Instance instance_;
+    // Cost of the CAH solution used to set the initial pheromone, 0 if not
+    // known yet
+    std::atomic<int> greedy_cost_{ 0 };
+};
+
+
+/*
+ * A bounded (LRU) cache of the instances loaded from files, the key is the
+ * path. The instances are shared so an entry removed from the cache remains
+ * valid as long as it is used by a running solver. Thread-safe.
+ */
+struct InstanceCache {
+    size_t capacity_;
+    std::atomic<uint64_t> lookups_{ 0 };
+    std::atomic<uint64_t> hits_{ 0 };
+
+
+    explicit InstanceCache(size_t capacity) : capacity_(capacity) {}
+
+    /*
+     * Returns the instance from the cache, it is loaded first if it is not
+     * in the cache. Returns nullptr and sets the error message if the file
+     * cannot be read, is not a valid instance or the instance is
+     * capacitated.
+     */
+    std::shared_ptr<CachedInstance> get(const std::string &path, std::string &error);
+
+    size_t size();
+
+private:
+
+    using Entry = std::pair<std::string, std::shared_ptr<CachedInstance>>;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;  // The most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+
+struct ServerConfig {
+    uint32_t workers_ = 1;
+    size_t instance_cache_capacity_ = 8;
+    // If set, the server shuts down when the flag becomes true, e.g. it is
+    // set by the signal handler of the client
+    const std::atomic<bool> *stop_flag_ = nullptr;
+};
+
+
+/*
+ * Runs the solver as a service. The requests are read as JSON-RPC 2.0
+ * messages, one per line, either from stdin (target "-", the responses are
+ * written to stdout) or from the clients connected to a Unix socket at the
+ * target path.
+ *
+ * Methods:
+ *
+ *  solve     {"instance": path, "timeout": seconds, "seed": n,
+ *             "iterations": n (optional)}
+ *            The improved solutions are sent as "improved" notifications
+ *            with the request id, the best one is sent as the result.
+ *  best      {"id": id of a running solve request}
+ *            Returns the current best solution of the request without
+ *            waiting for the solver, e.g. to use it at a deadline.
+ *  stats     Returns the statistics of the instance cache and the queue.
+ *  shutdown  Stops the server, the running solvers are cancelled.
+ *
+ * The solve requests are run by config.workers_ worker threads. Returns
+ * when stdin is closed (after the queued requests are solved), on shutdown
+ * or after config.stop_flag_ was set.
+ */
+void run_server(const std::string &target, const ServerConfig &config);
+
+
+void server_run_tests();
+
+
+#endif
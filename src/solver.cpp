@@ -0,0 +1,151 @@
+#include "solver.h"
+#include "cah.h"
+#include "logging.h"
+
+using namespace std;
+
+
+Solver::Solver(const TPP::Instance &instance, SolverConfig config)
+    : instance_(instance),
+      config_(move(config)) {
+
+    if (config_.seed_ == 0) {
+        config_.seed_ = get_initial_seed();
+    }
+    rng_ = xoroshiro128plus(config_.seed_);
+    reset();
+}
+
+
+void Solver::reset() {
+    result_ = SolverResult();
+    aco_ = nullptr;
+    if (config_.algorithm_ != Algorithm::ACO) {
+        return ;
+    }
+    aco_ = make_unique<ACO>(instance_);
+    aco_->route_optimizer_ = config_.route_optimizer_;
+    aco_->ls_best_improvement_ = config_.ls_best_improvement_;
+    aco_->ls_dlb_nn_count_ = config_.ls_dlb_nn_count_;
+    aco_->ls_threads_count_ = config_.threads_;
+    aco_->ls_scheduler_.adaptive_ = config_.ls_adaptive_schedule_;
+    aco_->ls_cache_.capacity_ = config_.ls_cache_capacity_;
+    aco_->initial_route_ = config_.initial_route_;
+    aco_->initial_trails_ = config_.initial_trails_;
+
+    aco_->new_best_found_callback_ = [this](const ACO &aco) {
+        if (aco.global_best_) {
+            const auto &best = *aco.global_best_;
+            on_new_best(best.cost(), best.solution_.route_,
+                        static_cast<uint32_t>(aco.current_iteration_),
+                        best.solution_.get_relative_error());
+        }
+    };
+    aco_->iteration_done_callback_ = [this](const ACO &) {
+        if (iteration_done_callback_) {
+            iteration_done_callback_(*this);
+        }
+    };
+}
+
+
+const SolverResult& Solver::run(unique_ptr<StopCondition> stop_condition) {
+    ScopedRandomEngine rng_scope(rng_);
+
+    CompositeStopCondition composite;
+    composite.add(stop_condition ? move(stop_condition) : make_stop_condition());
+    composite.add(make_unique<CancelFlagStopCondition>(cancel_requested_));
+
+    result_.improvements_.clear();
+    run_start_time_ = chrono::steady_clock::now();
+
+    if (aco_) {
+        aco_->run(&composite);
+        result_.iterations_ = static_cast<uint32_t>(aco_->current_iteration_);
+        // The best solution may be worse than before the run, e.g. after a
+        // change of the instance
+        if (aco_->global_best_) {
+            const auto &best = *aco_->global_best_;
+            result_.cost_ = best.cost();
+            result_.route_ = best.solution_.route_;
+            result_.relative_error_ = best.solution_.get_relative_error();
+        }
+    } else {
+        run_cah(composite);
+        result_.iterations_ = composite.get_iteration();
+    }
+    result_.duration_ = chrono::duration<double>(
+            chrono::steady_clock::now() - run_start_time_).count();
+    return result_;
+}
+
+
+int Solver::on_instance_changed(const vector<uint32_t> &changed_markets) {
+    CHECK_F(aco_ != nullptr, "Only the ACO supports the instance changes");
+    ScopedRandomEngine rng_scope(rng_);
+    return aco_->on_instance_changed(changed_markets);
+}
+
+
+unique_ptr<StopCondition> Solver::make_stop_condition() const {
+    auto stop_condition = make_unique<CompositeStopCondition>();
+    if (config_.timeout_ > 0) {
+        stop_condition->add(make_unique<TimeoutStopCondition>(config_.timeout_));
+    }
+    if (config_.max_iterations_ > 0) {
+        stop_condition->add(make_unique<FixedIterationsStopCondition>(config_.max_iterations_));
+    }
+    CHECK_F(!stop_condition->conditions_.empty(),
+            "Stop condition should be initialized");
+
+    if (config_.target_cost_ > 0) {
+        stop_condition->add(make_unique<TargetCostStopCondition>(config_.target_cost_));
+    }
+    if (config_.stagnation_iterations_ > 0) {
+        stop_condition->add(make_unique<StagnationStopCondition>(config_.stagnation_iterations_));
+    }
+    return stop_condition;
+}
+
+
+/*
+ * Repeats the CAH with random orders of the products, each repetition is an
+ * iteration.
+ */
+void Solver::run_cah(StopCondition &stop_condition) {
+    stop_condition.start();
+
+    for ( ; !stop_condition.is_reached(); stop_condition.next_iteration()) {
+        const auto sol = commodity_adding_heuristic(instance_, config_.cah_orders_,
+                                                    config_.threads_);
+
+        if (result_.cost_ == 0 || result_.cost_ > sol.cost_) {
+            stop_condition.update_best_cost(sol.cost_);
+            on_new_best(sol.cost_, sol.route_, stop_condition.get_iteration(),
+                        sol.get_relative_error());
+        }
+    }
+    if (result_.cost_ > 0) {
+        LOG_F(WARNING, "Final solution cost: %d", result_.cost_);
+    }
+}
+
+
+void Solver::on_new_best(int cost, const vector<uint32_t> &route,
+                         uint32_t iteration, double relative_error) {
+    result_.cost_ = cost;
+    result_.route_ = route;
+    result_.relative_error_ = relative_error;
+
+    Improvement improvement;
+    improvement.cost_ = cost;
+    improvement.iteration_ = iteration;
+    improvement.time_ = chrono::duration<double>(
+            chrono::steady_clock::now() - run_start_time_).count();
+    improvement.relative_error_ = relative_error;
+    result_.improvements_.push_back(improvement);
+
+    if (new_best_found_callback_) {
+        new_best_found_callback_(*this);
+    }
+}
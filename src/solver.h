@@ -0,0 +1,150 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+/*
+ * The interface of the solver library (libmmas_tpp). A Solver keeps all of
+ * its state: the parameters, the pseudo-random number generator, the ACO
+ * with its buffers and the callbacks, so several solvers can be run
+ * concurrently in separate threads.
+ *
+ * The exception is the profiler (make profile=1, see profiler.h): its
+ * timers and counters are process-wide, so with several solvers running
+ * they sum the measurements of all of them, and profiler::reset() clears
+ * them for all the solvers.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "aco.h"
+#include "rand.h"
+#include "stopcondition.h"
+#include "tpp.h"
+
+
+enum class Algorithm {
+    ACO, CAH
+};
+
+
+struct SolverConfig {
+    Algorithm algorithm_ = Algorithm::ACO;
+    // Seed of the generator of the solver, 0 = the initial seed (see rand.h)
+    uint32_t seed_ = 0;
+
+    // The stop condition used by run(), 0 disables a criterion but at least
+    // one of max_iterations_ and timeout_ should be > 0
+    uint32_t max_iterations_ = 1000;
+    double timeout_ = 0;  // Seconds
+    int target_cost_ = 0;
+    uint32_t stagnation_iterations_ = 0;
+
+    RouteOptimizer route_optimizer_ = RouteOptimizer::ThreeOpt;
+    bool ls_best_improvement_ = false;
+    size_t ls_dlb_nn_count_ = 50;  // See ACO::ls_dlb_nn_count_
+    bool ls_adaptive_schedule_ = false;
+    size_t ls_cache_capacity_ = 0;  // Disabled, see ACO::ls_cache_
+    // Threads used by the CAH or by the best-improvement local search
+    uint32_t threads_ = 1;
+    // Random product orders evaluated by the CAH in each iteration
+    uint32_t cah_orders_ = 1;
+
+    // Warm start of the ACO, see ACO::initial_route_ and ACO::initial_trails_
+    std::vector<uint32_t> initial_route_;
+    std::vector<double> initial_trails_;
+};
+
+
+/*
+ * An improvement of the best solution during a run.
+ */
+struct Improvement {
+    int cost_ = 0;
+    uint32_t iteration_ = 0;
+    double time_ = 0;  // Seconds since the start of the run
+    double relative_error_ = 0;  // With respect to the best known cost
+};
+
+
+struct SolverResult {
+    int cost_ = 0;  // 0 if no solution was found
+    std::vector<uint32_t> route_;
+    double relative_error_ = -1;
+    uint32_t iterations_ = 0;
+    double duration_ = 0;  // Seconds
+    std::vector<Improvement> improvements_;
+};
+
+
+struct Solver {
+    using callback_t = void (const Solver &solver);
+
+    const TPP::Instance &instance_;
+    SolverConfig config_;
+    xoroshiro128plus rng_;
+    // The ACO of the current trial, nullptr for the CAH
+    std::unique_ptr<ACO> aco_;
+    // The results of the last (or the current) run
+    SolverResult result_;
+
+    // Called after each improvement of result_
+    std::function<callback_t> new_best_found_callback_{ nullptr };
+    // Called after each iteration of the ACO, aco_ can be used e.g. to save
+    // its state
+    std::function<callback_t> iteration_done_callback_{ nullptr };
+
+
+    /**
+     * The instance should outlive the solver.
+     */
+    Solver(const TPP::Instance &instance, SolverConfig config);
+
+    Solver(const Solver &) = delete;
+
+    Solver& operator=(const Solver &) = delete;
+
+    /**
+     * Runs the algorithm until the stop condition is reached, if it is
+     * nullptr the one given by the config is used. Another run of the ACO
+     * continues the computations, e.g. after on_instance_changed().
+     */
+    const SolverResult& run(std::unique_ptr<StopCondition> stop_condition = nullptr);
+
+    /**
+     * Starts a new trial: the next run() starts from scratch, the generator
+     * is not reset so the trials differ.
+     */
+    void reset();
+
+    /**
+     * See ACO::on_instance_changed, returns the cost of the repaired best
+     * solution.
+     */
+    int on_instance_changed(const std::vector<uint32_t> &changed_markets);
+
+    /**
+     * Stops the current run as soon as possible, the later runs stop
+     * immediately. This can be called from any thread.
+     */
+    void cancel() noexcept {
+        cancel_requested_.store(true, std::memory_order_relaxed);
+    }
+
+private:
+
+    std::atomic<bool> cancel_requested_{ false };
+    std::chrono::steady_clock::time_point run_start_time_;
+
+    std::unique_ptr<StopCondition> make_stop_condition() const;
+
+    void run_cah(StopCondition &stop_condition);
+
+    void on_new_best(int cost, const std::vector<uint32_t> &route,
+                     uint32_t iteration, double relative_error);
+};
+
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+
+
+/*
+ * A bounded, lock-free queue for a single producer and a single consumer
+ * thread. Neither try_push nor try_pop ever blocks, if the queue is full
+ * (empty) they return false.
+ */
+template<typename T>
+struct SpscQueue {
+
+    explicit SpscQueue(size_t capacity)
+        : buffer_(capacity + 1) {  // One slot is always left empty
+    }
+
+    /*
+     * Should be called only by the producer thread.
+     */
+    bool try_push(const T &item) noexcept {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        const auto next = (tail + 1) % buffer_.size();
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;  // Full
+        }
+        buffer_[tail] = item;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Should be called only by the consumer thread.
+     */
+    bool try_pop(T &item) noexcept {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;  // Empty
+        }
+        item = buffer_[head];
+        head_.store((head + 1) % buffer_.size(), std::memory_order_release);
+        return true;
+    }
+
+private:
+
+    std::vector<T> buffer_;
+    // Separate cache lines so that the threads do not compete for them
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    alignas(64) std::atomic<size_t> tail_{ 0 };
+};
+
+
+#endif
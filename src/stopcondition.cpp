@@ -5,13 +5,14 @@
 
 TimeoutStopCondition::TimeoutStopCondition(double max_seconds) :
     max_seconds_(std::max(0.0, max_seconds)),
-    start_time_(0),
     iteration_(0) {
 }
 
 
 void TimeoutStopCondition::start() noexcept {
-    start_time_ = clock();
+    deadline_ = clock_type::now()
+              + std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>(max_seconds_));
     iteration_ = 0;
 }
 
@@ -22,6 +23,48 @@ void TimeoutStopCondition::next_iteration() noexcept {
 
 
 bool TimeoutStopCondition::is_reached() const noexcept {
-    const clock_t elapsed = clock() - start_time_;
-    return (elapsed / (double)CLOCKS_PER_SEC) > max_seconds_;
+    return clock_type::now() >= deadline_;
+}
+
+
+void CompositeStopCondition::start() noexcept {
+    iteration_ = 0;
+    for (auto &condition : conditions_) {
+        condition->start();
+    }
+}
+
+
+void CompositeStopCondition::next_iteration() noexcept {
+    ++iteration_;
+    for (auto &condition : conditions_) {
+        condition->next_iteration();
+    }
+}
+
+
+bool CompositeStopCondition::is_reached() const noexcept {
+    for (const auto &condition : conditions_) {
+        if (condition->is_reached()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool CompositeStopCondition::should_interrupt() const noexcept {
+    for (const auto &condition : conditions_) {
+        if (condition->should_interrupt()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void CompositeStopCondition::update_best_cost(int cost) noexcept {
+    for (auto &condition : conditions_) {
+        condition->update_best_cost(cost);
+    }
 }
@@ -1,11 +1,19 @@
 #ifndef STOPCONDITION
 #define STOPCONDITION
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <ctime>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
 
 
 struct StopCondition {
+    virtual ~StopCondition() = default;
+
     /**
      * This should be called before the first use of the other methods.
      */
@@ -27,6 +35,24 @@ struct StopCondition {
      * Returns current iteration number
      */
     virtual uint32_t get_iteration() const = 0;
+
+    /**
+     * Returns true if the current iteration should be interrupted, i.e. the
+     * time limit was exceeded or the computations were cancelled (see
+     * CancelFlagStopCondition). This is cheap enough to be polled inside an
+     * iteration, e.g. by the local search between the calls of the
+     * heuristics.
+     */
+    virtual bool should_interrupt() const noexcept {
+        return false;
+    }
+
+    /**
+     * This should be called when the algorithm finds a better solution, in
+     * case of the ACO this is the global best solution, not the best one
+     * since the last restart (pheromone reset).
+     */
+    virtual void update_best_cost(int /*cost*/) noexcept {}
 };
 
 
@@ -62,8 +88,14 @@ struct FixedIterationsStopCondition : StopCondition {
 };
 
 
-
+/*
+ * Stops after the given wall (real) time. The monotonic steady_clock is
+ * used, so unlike clock() the limit does not depend on the number of threads
+ * running and system clock changes do not matter.
+ */
 struct TimeoutStopCondition : StopCondition {
+    using clock_type = std::chrono::steady_clock;
+
 
     TimeoutStopCondition(double max_seconds);
 
@@ -77,10 +109,168 @@ struct TimeoutStopCondition : StopCondition {
         return iteration_;
     }
 
+    bool should_interrupt() const noexcept override {
+        return is_reached();
+    }
+
 
     double max_seconds_;
-    clock_t start_time_;
+    clock_type::time_point deadline_;
     uint32_t iteration_;
 };
 
+
+/*
+ * Stops when any of the contained conditions is reached, e.g. time OR
+ * iterations. The iterations are counted by this condition and passed to
+ * each of the contained conditions.
+ */
+struct CompositeStopCondition : StopCondition {
+
+    void add(std::unique_ptr<StopCondition> condition) {
+        conditions_.push_back(std::move(condition));
+    }
+
+    void start() noexcept override;
+
+    void next_iteration() noexcept override;
+
+    bool is_reached() const noexcept override;
+
+    uint32_t get_iteration() const noexcept override {
+        return iteration_;
+    }
+
+    bool should_interrupt() const noexcept override;
+
+    void update_best_cost(int cost) noexcept override;
+
+
+    std::vector<std::unique_ptr<StopCondition>> conditions_;
+    uint32_t iteration_ = 0;
+};
+
+
+/*
+ * Stops when a solution with the cost <= target_cost_ is found, e.g. the
+ * best known solution.
+ */
+struct TargetCostStopCondition : StopCondition {
+
+    explicit TargetCostStopCondition(int target_cost) :
+        target_cost_(target_cost) {
+    }
+
+    void start() noexcept override {
+        iteration_ = 0;
+        best_cost_ = std::numeric_limits<int>::max();
+    }
+
+    void next_iteration() noexcept override {
+        ++iteration_;
+    }
+
+    bool is_reached() const noexcept override {
+        return best_cost_ <= target_cost_;
+    }
+
+    uint32_t get_iteration() const noexcept override {
+        return iteration_;
+    }
+
+    void update_best_cost(int cost) noexcept override {
+        best_cost_ = std::min(best_cost_, cost);
+    }
+
+
+    int target_cost_;
+    int best_cost_ = std::numeric_limits<int>::max();
+    uint32_t iteration_ = 0;
+};
+
+
+/*
+ * Stops if no better solution was found in max_idle_iterations_
+ * consecutive iterations, i.e. since the last improvement of the global best
+ * solution. The restarts of the ACO do not re-arm the condition: the first
+ * restart best after a pheromone reset is always "new", so otherwise a limit
+ * longer than the period of the resets could never be reached. A cost which
+ * is not lower than the best one seen is ignored for the same reason.
+ */
+struct StagnationStopCondition : StopCondition {
+
+    explicit StagnationStopCondition(uint32_t max_idle_iterations) :
+        max_idle_iterations_(max_idle_iterations) {
+    }
+
+    void start() noexcept override {
+        iteration_ = 0;
+        last_improvement_iteration_ = 0;
+        best_cost_ = std::numeric_limits<int>::max();
+    }
+
+    void next_iteration() noexcept override {
+        ++iteration_;
+    }
+
+    bool is_reached() const noexcept override {
+        return iteration_ - last_improvement_iteration_ >= max_idle_iterations_;
+    }
+
+    uint32_t get_iteration() const noexcept override {
+        return iteration_;
+    }
+
+    void update_best_cost(int cost) noexcept override {
+        if (cost < best_cost_) {
+            best_cost_ = cost;
+            last_improvement_iteration_ = iteration_;
+        }
+    }
+
+
+    uint32_t max_idle_iterations_;
+    uint32_t iteration_ = 0;
+    uint32_t last_improvement_iteration_ = 0;
+    int best_cost_ = std::numeric_limits<int>::max();
+};
+
+
+/*
+ * Stops when the flag is set, e.g. by another thread or a signal handler to
+ * cancel a single solver (see Solver::cancel). The cancellation is treated
+ * as reaching the stopping criterion so the results found so far can still
+ * be saved.
+ */
+struct CancelFlagStopCondition : StopCondition {
+
+    explicit CancelFlagStopCondition(const std::atomic<bool> &flag) :
+        flag_(flag) {
+    }
+
+    void start() noexcept override {
+        iteration_ = 0;
+    }
+
+    void next_iteration() noexcept override {
+        ++iteration_;
+    }
+
+    bool is_reached() const noexcept override {
+        return flag_.load(std::memory_order_relaxed);
+    }
+
+    uint32_t get_iteration() const noexcept override {
+        return iteration_;
+    }
+
+    bool should_interrupt() const noexcept override {
+        return is_reached();
+    }
+
+
+    const std::atomic<bool> &flag_;
+    uint32_t iteration_ = 0;
+};
+
 #endif
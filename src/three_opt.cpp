@@ -4,6 +4,7 @@
 #include <array>
 
 #include "three_opt.h"
+#include "route_neighborhood.h"
 #include "rand.h"
 #include "logging.h"
 #include "utils.h"
@@ -54,8 +55,8 @@ public:
     {
         const int len = static_cast<int>(vec.size());
 
-        CHECK_F(start_index < len, "start_index < vec.size()");
-        CHECK_F(shift_from_start <= len, "%d <= %d", shift_from_start, len);
+        DEBUG_CHECK_F(start_index < len, "start_index < vec.size()");
+        DEBUG_CHECK_F(shift_from_start <= len, "%d <= %d", shift_from_start, len);
 
         anchor_ = vec.begin() + start_index;
         it_ = vec.begin() + (start_index + shift_from_start) % len;
@@ -73,7 +74,7 @@ public:
     {
         const int len = static_cast<int>(vec.size());
 
-        CHECK_F(start_index < len, "start_index < vec.size()");
+        DEBUG_CHECK_F(start_index < len, "start_index < vec.size()");
 
         it_ = anchor_ = vec.begin() + start_index;
     }
@@ -196,28 +197,6 @@ bool contains_edge(const vector<uint32_t>& vec, uint32_t a, uint32_t b) {
 }
 
 
-void perform_2_opt_move(vector<uint32_t> &route, uint32_t i, uint32_t j) {
-    using iter_t = WrappedIterator<uint32_t>;
-
-    const auto len = route.size();
-    if (i > j) {
-        swap(i, j);
-    }
-    // Now we have ..., i), (i+1, ..., j), (j+1, ...
-    uint32_t i_1 = (i + 1) % len;
-    uint32_t j_1 = (j + 1) % len;
-    Segment s1 { i_1, j };
-    Segment s2 { j_1, i };
-    if (s1.size() < s2.size()) {
-        reverse(begin(route) + s1.first_,
-                begin(route) + s1.first_ + s1.size());
-    } else {
-        reverse(iter_t(route, static_cast<int>(s2.first_)),
-                iter_t(route, static_cast<int>(s2.first_), s2.isize()));
-    }
-}
-
-
 /**
  * Performs route modifications required by a 3-opt move, i.e. segments
  * reversals and swaps.
@@ -241,7 +220,7 @@ void perform_3_opt_move(vector<uint32_t> &route, Segment s0, Segment s1, Segment
     if (s1.size() < s2.size()) {
         swap(s1, s2);
     }
-    CHECK_F((s0.size() >= s1.size()) && (s1.size() >= s2.size()),
+    DEBUG_CHECK_F((s0.size() >= s1.size()) && (s1.size() >= s2.size()),
             "Segments should be sorted");
 
     bool swap_needed = false;  // Do we need to swap shorter segments?
@@ -415,13 +394,130 @@ int three_opt(const TPP::Instance &instance, TPP::Solution &sol,
     }
     const auto new_travel_cost = instance.calc_travel_cost(route);
     const auto delta = new_travel_cost - old_travel_cost;
-    CHECK_F(delta <= 0, "Travel cost should not be grater after 3-opt");
+    DEBUG_CHECK_F(delta <= 0, "Travel cost should not be grater after 3-opt");
     sol.cost_ += delta;
     LOG_F(INFO, "3-opt improvement: %d", -delta);
     return delta;
 }
 
 
+/*
+ * Tries to find an improving 2-opt or 3-opt move in which one of the new
+ * edges connects market at_i and one of its nearest neighbors (at_j), and
+ * (for 3-opt) another one connects at_j and one of its nearest neighbors.
+ *
+ * The first improving move found is applied in place as a sequence of
+ * (at most three) 2-opt moves, each reversing the shorter part of the route.
+ */
+bool improve_3opt(RouteNeighborhood &nh, uint32_t at_i) noexcept {
+    const auto &route = nh.route_;
+    const auto len = nh.len_;
+    const auto i = nh.pos_in_route_[at_i];
+    const auto &i_nn_list = nh.instance_.nn_lists_.at(at_i);
+    const auto i_nn_count = min(nh.nn_count_, i_nn_list.size());
+
+    for (auto i_nn_idx = 0u; i_nn_idx < i_nn_count; ++i_nn_idx) {
+        const auto at_j = i_nn_list[i_nn_idx];
+        const auto j = nh.pos_in_route_[at_j];
+
+        if (j == len) {  // Not in route
+            continue ;
+        }
+
+        // Check for 2-opt move
+        const auto at_i_1 = nh.succ(at_i);
+        const auto at_j_1 = nh.succ(at_j);
+        const auto change_2opt = nh.dist(at_i, at_i_1)
+                               + nh.dist(at_j, at_j_1)
+                               - nh.dist(at_i, at_j)
+                               - nh.dist(at_i_1, at_j_1);
+        if (change_2opt > 0) {
+            nh.make_2opt_move(at_i, at_i_1, at_j, at_j_1);
+            nh.travel_cost_change_ -= change_2opt;
+            nh.reset_dont_look_bits({ at_i, at_i_1, at_j, at_j_1 });
+            return true;
+        }
+
+        const auto &j_nn_list = nh.instance_.nn_lists_.at(at_j);
+        const auto j_nn_count = min(nh.nn_count_, j_nn_list.size());
+
+        for (auto j_nn_idx = 0u; j_nn_idx < j_nn_count; ++j_nn_idx) {
+            const auto at_k = j_nn_list[j_nn_idx];
+            const auto k = nh.pos_in_route_[at_k];
+
+            if (k == len || k == i) {  // Unlikely but possible, we want at_i != at_j != at_k
+                continue ;
+            }
+
+            uint32_t x = i;
+            uint32_t y = j;
+            uint32_t z = k;
+
+            // Sort (x, y, z)
+            if (x > y) { swap(x, y); }
+            if (x > z) { swap(x, z); }
+            if (y > z) { swap(y, z); }
+
+            const auto at_x = route[x];
+            const auto at_y = route[y];
+            const auto at_z = route[z];
+            const auto at_x_1 = nh.succ(at_x);
+            const auto at_y_1 = nh.succ(at_y);
+            const auto at_z_1 = nh.succ(at_z);
+
+            const auto curr = nh.dist(at_x, at_x_1)
+                            + nh.dist(at_y, at_y_1)
+                            + nh.dist(at_z, at_z_1);
+
+            // 4 sets of possible new edges to check
+            const array<pair<uint32_t, uint32_t>, 4 * 3> pairs{{
+                { at_y, at_x }, { at_z_1, at_y_1 }, { at_z, at_x_1 },
+                { at_y, at_z_1 }, { at_x, at_y_1 }, { at_z, at_x_1 },
+                { at_y, at_z_1 }, { at_x, at_z }, { at_y_1, at_x_1 },
+                { at_y, at_z }, { at_y_1, at_x }, { at_z_1, at_x_1 }
+            }};
+
+            for (auto l = 0u; l < 4 * 3; l += 3) {
+                const auto p1 = pairs[l + 0];
+                const auto p2 = pairs[l + 1];
+                const auto p3 = pairs[l + 2];
+
+                const auto cost = nh.dist(p1.first, p1.second)
+                                + nh.dist(p2.first, p2.second)
+                                + nh.dist(p3.first, p3.second);
+
+                if (cost < curr) {
+                    // The route is x -> x_1 ... y -> y_1 ... z -> z_1 ...
+                    switch (l / 3) {
+                    case 0:  // x y..x_1 z..y_1 z_1
+                        nh.make_2opt_move(at_x, at_x_1, at_y, at_y_1);
+                        nh.make_2opt_move(at_x_1, at_y_1, at_z, at_z_1);
+                        break ;
+                    case 1:  // x y_1..z x_1..y z_1
+                        nh.make_2opt_move(at_x, at_x_1, at_y, at_y_1);
+                        nh.make_2opt_move(at_x_1, at_y_1, at_z, at_z_1);
+                        nh.make_2opt_move(at_x, at_y, at_y_1, at_z_1);
+                        break ;
+                    case 2:  // x z..y_1 x_1..y z_1
+                        nh.make_2opt_move(at_x, at_x_1, at_y, at_y_1);
+                        nh.make_2opt_move(at_x, at_y, at_z, at_z_1);
+                        break ;
+                    default:  // x y_1..z y..x_1 z_1
+                        nh.make_2opt_move(at_y, at_y_1, at_z, at_z_1);
+                        nh.make_2opt_move(at_x, at_x_1, at_y_1, at_z_1);
+                    }
+                    nh.travel_cost_change_ += cost - curr;
+                    nh.reset_dont_look_bits({ at_x, at_x_1, at_y, at_y_1,
+                                              at_z, at_z_1 });
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
 /*
  * Impl. of the 3-opt heuristic. Tries to change the order of markets in
  * solution to shorten the travel distance.
@@ -429,6 +525,10 @@ int three_opt(const TPP::Instance &instance, TPP::Solution &sol,
  * During the search for an improvement only edges connecting nn_count nearest
  * neighbors are taken into account to cut the overall search time.
  *
+ * The moves are applied in place (see RouteNeighborhood) and the search
+ * continues from the next market in the route instead of being restarted
+ * after each improvement.
+ *
  * The solution's route is modified only if a better order was found.
  *
  * Function returns improvement over the previous route length (travel
@@ -440,190 +540,34 @@ int three_opt_nn(const TPP::Instance &instance, TPP::Solution &sol,
 
     CHECK_F(instance.is_symmetric_, "Symmetric instance expected!");
 
-    const auto len = static_cast<uint32_t>(sol.route_.size());
     auto &route = sol.route_;
+    if (route.size() < 3) {
+        return 0;
+    }
     const auto old_travel_cost = instance.calc_travel_cost(route);
 
-    vector<uint8_t> dont_look_bits(instance.dimension_, false);
-    vector<uint32_t> pos_in_route(instance.dimension_);
+    RouteNeighborhood nh(instance, route, nn_count);
 
     auto found_improvement = false;
-
     do {
         found_improvement = false;
 
-        fill_n(pos_in_route.begin(), instance.dimension_, len);
-        for (auto i = 0u; i < route.size(); ++i) {
-            pos_in_route[ route[i] ] = i;
-        }
-
-        for (auto i = 0u; i < len && !found_improvement; ++i) {
-            if (dont_look_bits[route[i]]) {
+        for (auto i = 0u; i < nh.len_; ++i) {
+            const auto at_i = route[i];
+            if (nh.dont_look_bits_[at_i]) {
                 continue ;  // Do not check, it probably won't find an
                             // improvement
             }
-            const auto at_i = route[i];
-            const auto &i_nn_list = instance.nn_lists_.at(at_i);
-            const auto i_nn_count = min(nn_count, i_nn_list.size());
-
-            for (auto i_nn_idx = 0u; i_nn_idx < i_nn_count && !found_improvement; ++i_nn_idx) {
-                const auto at_j = i_nn_list[i_nn_idx];
-                const auto j = pos_in_route[at_j];
-
-                if (j == len) {  // Not in route
-                    continue ;
-                }
-
-                // Check for 2-opt move
-                auto i_1 = (i + 1) % len;
-                auto j_1 = (j + 1) % len;
-                auto at_i_1 = route[i_1];
-                auto at_j_1 = route[j_1];
-                const auto change_2opt = instance.get_travel_cost(at_i, at_i_1)
-                                       + instance.get_travel_cost(at_j, at_j_1)
-                                       - instance.get_travel_cost(at_i, at_j)
-                                       - instance.get_travel_cost(at_i_1, at_j_1);
-                if (change_2opt > 0) {
-                    const auto cost_before = instance.calc_travel_cost(route);
-                    perform_2_opt_move(route, i, j);
-                    const auto cost_after = instance.calc_travel_cost(route);
-                    CHECK_F(cost_after < cost_before, "Improvement expected!");
-                    CHECK_F(change_2opt + cost_after == cost_before, "Change should be equal to predicted");
-
-                    found_improvement = true;
-
-                    dont_look_bits[at_i] = false;
-                    dont_look_bits[at_i_1] = false;
-
-                    dont_look_bits[at_j] = false;
-                    dont_look_bits[at_j_1] = false;
-
-                    continue ;
-                }
-
-                const auto &j_nn_list = instance.nn_lists_.at(at_j);
-                const auto j_nn_count = min(nn_count, j_nn_list.size());
-
-                CHECK_F(at_i != at_j, "These two should be different");
-
-                for (auto j_nn_idx = 0u; j_nn_idx < j_nn_count && !found_improvement; ++j_nn_idx) {
-                    const auto at_k = j_nn_list[j_nn_idx];
-                    const auto k = pos_in_route[at_k];
-
-                    if (k == len || k == i) {  // Unlikely but possible, we want at_i != at_j != at_k
-                        continue ;
-                    }
-                    //LOG_F(INFO, "i, j, k = %u, %zu, %zu", i, j, k);
-                    //LOG_F(INFO, "at_i, at_j, at_k = %zu, %u, %u", at_i, at_j, at_k);
-
-                    uint32_t x = i;
-                    uint32_t y = j;
-                    uint32_t z = k;
-                    uint32_t at_x = at_i;
-                    uint32_t at_y = at_j;
-                    uint32_t at_z = at_k;
-
-                    // Sort (x, y, z)
-                    if (x > y) { swap(x, y); swap(at_x, at_y); }
-                    if (x > z) { swap(x, z); swap(at_x, at_z); }
-                    if (y > z) { swap(y, z); swap(at_y, at_z); }
-
-                    auto x_1 = (x + 1) % len;
-                    auto y_1 = (y + 1) % len;
-                    auto z_1 = (z + 1) % len;
-
-                    //LOG_F(INFO, "x, y, z = %zu, %zu, %zu", x, y, z);
-                    //LOG_F(INFO, "at_x, at_y, at_z = %zu, %zu, %zu", at_x, at_y, at_z);
-
-                    auto at_x_1 = route[x_1];
-                    auto at_y_1 = route[y_1];
-                    auto at_z_1 = route[z_1];
-
-                    const auto curr = instance.get_travel_cost(at_x, at_x_1)
-                                    + instance.get_travel_cost(at_y, at_y_1)
-                                    + instance.get_travel_cost(at_z, at_z_1);
-
-                    // 4 sets of possible new edges to check
-                    const array<pair<uint32_t, uint32_t>, 4 * 3> pairs{{
-                        { at_y, at_x }, { at_z_1, at_y_1 }, { at_z, at_x_1 },
-                        { at_y, at_z_1 }, { at_x, at_y_1 }, { at_z, at_x_1 },
-                        { at_y, at_z_1 }, { at_x, at_z }, { at_y_1, at_x_1 },
-                        { at_y, at_z }, { at_y_1, at_x }, { at_z_1, at_x_1 }
-                    }};
-
-                    // Which segments do we need to reverse in order to transform
-                    // route so that the new edges are created properly
-                    const array<bool, 4 * 3> segment_reversals{{
-                        false, true, true,
-                        true, true, true,
-                        true, true, false,
-                        true, false, true
-                    }};
-
-                    Segment seg[3] = {
-                        { z_1, x, len, 0 },
-                        { x_1, y, len, 1 },
-                        { y_1, z, len, 2 }
-                    };
-
-                    auto cost_change = 0;
-
-                    for (auto l = 0u; l < 4 * 3 && !found_improvement; l += 3) {
-                        const auto p1 = pairs[l + 0];
-                        const auto p2 = pairs[l + 1];
-                        const auto p3 = pairs[l + 2];
-
-                        const auto cost = instance.get_travel_cost(p1.first, p1.second)
-                                        + instance.get_travel_cost(p2.first, p2.second)
-                                        + instance.get_travel_cost(p3.first, p3.second);
-
-                        if (cost < curr) {
-                            found_improvement = true;
-                            cost_change = cost - curr;
-
-                            if (segment_reversals[l + 0]) {
-                                seg[0].reverse();
-                            }
-                            if (segment_reversals[l + 1]) {
-                                seg[1].reverse();
-                            }
-                            if (segment_reversals[l + 2]) {
-                                seg[2].reverse();
-                            }
-                            dont_look_bits[p1.first] = false;
-                            dont_look_bits[p1.second] = false;
-
-                            dont_look_bits[p2.first] = false;
-                            dont_look_bits[p2.second] = false;
-
-                            dont_look_bits[p3.first] = false;
-                            dont_look_bits[p3.second] = false;
-                        }
-                    }
-                    if (found_improvement) {
-                        //const auto cost_before = instance.calc_travel_cost(route);
-                        perform_3_opt_move(route, seg[0], seg[1], seg[2]);
-                        //const auto cost_after = instance.calc_travel_cost(route);
-                        //CHECK_F(cost_after < cost_before, "Improvement expected!");
-                        //CHECK_F(cost_change + cost_before == cost_after, "Change should be equal to predicted");
-                    }
-                }
-            }
-            if (!found_improvement && use_dont_look_bits) {
-                dont_look_bits[route[i]] = true;
+            if (improve_3opt(nh, at_i)) {
+                found_improvement = true;
+            } else if (use_dont_look_bits) {
+                nh.dont_look_bits_[at_i] = true;
             }
         }
     } while(found_improvement);
 
-    // It may happen that depot is moved to another position
-    auto depot_pos = find(begin(route), end(route), 0);
-    if (depot_pos != route.begin()) {
-        rotate(begin(route), depot_pos, end(route));
-    }
-    const auto new_travel_cost = instance.calc_travel_cost(route);
-    const auto delta = new_travel_cost - old_travel_cost;
-    CHECK_F(delta <= 0, "Travel cost should not be grater after 3-opt");
-    sol.cost_ += delta;
+    const auto delta = nh.apply_to(sol, old_travel_cost);
+    DEBUG_CHECK_F(delta <= 0, "Travel cost should not be grater after 3-opt");
     LOG_F(INFO, "3-opt improvement: %d", -delta);
     return delta;
 }
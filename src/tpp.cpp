@@ -2,6 +2,9 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <sys/stat.h>
 
 #include "tpp.h"
 #include "logging.h"
@@ -16,7 +19,23 @@ int TPP::Instance::get_travel_cost(size_t market_a,
                                    size_t market_b) const noexcept {
     // return edge_weights_.at(market_a).at(market_b);
     // return edge_weights_[market_a][market_b];
-    return edge_weights_1d_.at(market_a * dimension_ + market_b);
+    return DEBUG_AT(edge_weights_1d_, market_a * dimension_ + market_b);
+}
+
+
+/*
+ * Thrown by the readers of an instance file if the data are malformed, it is
+ * caught by try_load_from_file.
+ */
+struct InstanceFormatError : runtime_error {
+    using runtime_error::runtime_error;
+};
+
+
+void check_format(bool condition, const string &message) {
+    if (!condition) {
+        throw InstanceFormatError(message);
+    }
 }
 
 
@@ -29,19 +48,19 @@ pair<size_t, vector<int>> read_demand_section(ifstream &file) {
     string line;
     if (getline(file, line, '\n')) {
         auto n = stoi(line);
-        assert(n > 0);
+        check_format(n > 0 && n <= numeric_limits<uint16_t>::max(),
+                     "Invalid number of products");
         product_count = static_cast<size_t>(n);
 
         for (auto i = 0u; i < product_count; ++i) {
-            if (!getline(file, line, '\n')) {
-                LOG_F(ERROR, "Lines missing in DEMAND_SECTION");
-                abort();
-            }
+            check_format(static_cast<bool>(getline(file, line, '\n')),
+                         "Lines missing in DEMAND_SECTION");
             auto iss = istringstream(line);
             size_t id{ 0 };
-            size_t demand{ 0 };
+            int demand{ 0 };
             iss >> id >> demand;
-            assert(id == i+1);
+            check_format(!iss.fail() && id == i + 1 && demand >= 0,
+                         "Invalid demand of product " + to_string(i + 1));
             demands.push_back(demand);
         }
     }
@@ -62,27 +81,27 @@ read_offer_section(ifstream &file, size_t market_count) {
 
     for (auto i = 0u; i < market_count; ++i) {
         string line;
-        if (!getline(file, line, '\n')) {
-            LOG_F(ERROR, "Too few lines in offer section");
-            abort();
-        }
+        check_format(static_cast<bool>(getline(file, line, '\n')),
+                     "Too few lines in offer section");
         auto iss = istringstream(line);
         int market_id{ 0 };
         size_t offer_count{ 0 };
 
         iss >> market_id >> offer_count;
-        assert(market_id == static_cast<int>(i + 1));
+        check_format(!iss.fail() && market_id == static_cast<int>(i + 1),
+                     "Invalid offers of market " + to_string(i + 1));
 
         auto &offers = market_offers.at(i);
 
         for (auto j = 0u; j < offer_count; ++j) {
             ProductOffer offer;
             iss >> offer.product_id_ >> offer.price_ >> offer.quantity_;
+            check_format(!iss.fail(), "Too few offers of market " + to_string(i + 1));
             --offer.product_id_;  // Keep product ids in range [0..dimension-1]
             offer.market_id_ = i;
             offers.emplace_back(offer);
-            CHECK_F(offer.price_ >= 0, "Price should be >= 0");
-            CHECK_F(offer.quantity_ > 0, "Quantity should be > 0");
+            check_format(offer.price_ >= 0, "Price should be >= 0");
+            check_format(offer.quantity_ > 0, "Quantity should be > 0");
         }
     }
 
@@ -114,18 +133,14 @@ vector<vector<int>> read_edge_weights(ifstream &file, size_t dimension,
 
     edge_weights.resize(dimension);
 
-    if (edge_weight_format != EdgeWeightFormat::UPPER_ROW) {
-        LOG_F(ERROR, "Unsupported edge weight format");
-        abort();
-    }
+    check_format(edge_weight_format == EdgeWeightFormat::UPPER_ROW,
+                 "Unsupported edge weight format");
 
     // Read upper half of the weights section
     for (auto i = 1u; i < dimension; ++i) {
         string line;
-        if (!getline(file, line, '\n')) {
-            LOG_F(ERROR, "Too few lines in offer section");
-            abort();
-        }
+        check_format(static_cast<bool>(getline(file, line, '\n')),
+                     "Too few lines in edge weight section");
 
         auto &weights = edge_weights.at(i - 1u);
         weights.resize(dimension);
@@ -133,6 +148,7 @@ vector<vector<int>> read_edge_weights(ifstream &file, size_t dimension,
         for (auto j = i; j < dimension; ++j) {
             iss >> weights.at(j);
         }
+        check_format(!iss.fail(), "Too few edge weights in row " + to_string(i));
     }
     edge_weights.at(dimension-1).resize(dimension);
 
@@ -153,16 +169,15 @@ vector<pair<int, int>> read_node_coords_section(ifstream &file,
 
     for (auto i = 0u; i < dimension; i++) {
         string line;
-        if (!getline(file, line, '\n')) {
-            LOG_F(ERROR, "Too few lines in offer section");
-            abort();
-        }
+        check_format(static_cast<bool>(getline(file, line, '\n')),
+                     "Too few lines in node coord section");
         istringstream iss{line};
         size_t node_id;
         int x, y;
         iss >> node_id >> x >> y;
 
-        assert(node_id == i+1);
+        check_format(!iss.fail() && node_id == i + 1,
+                     "Invalid coords of node " + to_string(i + 1));
 
         coords.push_back(make_pair(x, y));
     }
@@ -240,123 +255,185 @@ vector<vector<uint32_t>> calc_nearest_neighbors(const TPP::Instance &instance) {
 
 
 /*
- * Loads TPP instance from the file in the format specifed in:
- * http://jriera.webs.ull.es/TPPLIB/TPPLIBFormat.htm
+ * Computes the data derived from the edge weights matrix, i.e. its flat copy
+ * and the nearest neighbor lists.
  */
-Instance TPP::load_from_file(const string path) {
-    Instance instance;
-    LOG_SCOPE_F(INFO, "Loading TPP instance: %s", path.c_str());
+void init_travel_data(Instance &instance) {
+    instance.edge_weights_1d_.resize(instance.dimension_ * instance.dimension_);
+    for (auto i = 0u; i < instance.dimension_; ++i) {
+        for (auto j = 0u; j < instance.dimension_; ++j) {
+            instance.edge_weights_1d_.at(i * instance.dimension_ + j) = instance.edge_weights_.at(i).at(j);
+        }
+    }
 
-    EdgeWeightFormat edge_weight_format;
-    EdgeWeightType edge_weight_type{ EdgeWeightType::EUC_2D };
+    instance.nn_lists_ = calc_nearest_neighbors(instance);
+}
 
-    ifstream file{ path };
 
-    if (file.is_open()) {
-        LOG_F(INFO, "File opened");
+/*
+ * Reads the sections of the instance file, throws InstanceFormatError (or
+ * e.g. invalid_argument from stoi) if the data are malformed.
+ */
+void read_instance(ifstream &file, Instance &instance) {
+    EdgeWeightFormat edge_weight_format{ EdgeWeightFormat::UPPER_ROW };
+    EdgeWeightType edge_weight_type{ EdgeWeightType::EUC_2D };
 
-        string line;
+    string line;
 
-        while (getline(file, line, '\n')) {
-            //LOG_F(INFO, "%s", line.c_str());
+    while (getline(file, line, '\n')) {
+        //LOG_F(INFO, "%s", line.c_str());
 
-            auto prefix = string(line);
-            auto suffix = string();
+        auto prefix = string(line);
+        auto suffix = string();
 
-            const auto pos = line.find(':');
-            const bool has_colon = pos != string::npos;
-            if (has_colon) {
-                prefix = line.substr(0, pos);
-                suffix = line.substr(pos + 1);
-            }
+        const auto pos = line.find(':');
+        const bool has_colon = pos != string::npos;
+        if (has_colon) {
+            prefix = line.substr(0, pos);
+            suffix = line.substr(pos + 1);
+        }
 
-            trim(prefix);
-            trim(suffix);
-
-            //LOG_F(INFO, "[%s] : [%s]", prefix.c_str(), suffix.c_str());
-
-            if (starts_with(prefix, "NAME")) {
-                instance.name_ = suffix;
-            } else if (starts_with(prefix, "TYPE")) {
-                assert(suffix == "TPP");
-            } else if (starts_with(prefix, "COMMENT")) {
-                /* ignore */
-                LOG_F(INFO, "Instance comment: %s", suffix.c_str());
-            } else if (starts_with(prefix, "DIMENSION")) {
-                auto n = stoi(suffix);
-                assert(n >= 2);
-
-                instance.dimension_ = static_cast<size_t>(n);
-            } else if (starts_with(prefix, "EDGE_WEIGHT_TYPE")) {
-                if (suffix == "EXPLICIT") {
-                    edge_weight_type = EdgeWeightType::EXPLICIT;
-                } else if (suffix == "EUC_2D") {
-                    edge_weight_type = EdgeWeightType::EUC_2D;
-                } else {
-                    LOG_F(ERROR, "Unknown edge weight type: %s", suffix.c_str());
-                    abort();
+        trim(prefix);
+        trim(suffix);
+
+        //LOG_F(INFO, "[%s] : [%s]", prefix.c_str(), suffix.c_str());
+
+        if (starts_with(prefix, "NAME")) {
+            instance.name_ = suffix;
+        } else if (starts_with(prefix, "TYPE")) {
+            check_format(suffix == "TPP", "Unsupported type: " + suffix);
+        } else if (starts_with(prefix, "COMMENT")) {
+            /* ignore */
+            LOG_F(INFO, "Instance comment: %s", suffix.c_str());
+        } else if (starts_with(prefix, "DIMENSION")) {
+            auto n = stoi(suffix);
+            // The market ids of the offers are 16-bit
+            check_format(n >= 2 && n <= numeric_limits<uint16_t>::max(),
+                         "Invalid dimension: " + suffix);
+
+            instance.dimension_ = static_cast<size_t>(n);
+        } else if (starts_with(prefix, "EDGE_WEIGHT_TYPE")) {
+            if (suffix == "EXPLICIT") {
+                edge_weight_type = EdgeWeightType::EXPLICIT;
+            } else if (suffix == "EUC_2D") {
+                edge_weight_type = EdgeWeightType::EUC_2D;
+            } else {
+                check_format(false, "Unknown edge weight type: " + suffix);
+            }
+        } else if (starts_with(prefix, "EDGE_WEIGHT_FORMAT")) {
+            edge_weight_format = EdgeWeightFormat::UPPER_ROW;
+            instance.is_symmetric_ = true;
+        } else if (starts_with(prefix, "DISPLAY_DATA_TYPE")) {
+            // ignore
+        } else if (starts_with(prefix, "DEMAND_SECTION")) {
+            auto res = read_demand_section(file);
+            instance.product_count_ = res.first;
+            instance.demands_ = res.second;
+            for (auto p = 0u; p < instance.product_count_; ++p) {
+                auto demand = instance.demands_.at(p);
+                if (demand > 0) {
+                    instance.needed_products_.push_back(p);
                 }
-            } else if (starts_with(prefix, "EDGE_WEIGHT_FORMAT")) {
-                edge_weight_format = EdgeWeightFormat::UPPER_ROW;
-                instance.is_symmetric_ = true;
-            } else if (starts_with(prefix, "DISPLAY_DATA_TYPE")) {
-                // ignore
-            } else if (starts_with(prefix, "DEMAND_SECTION")) {
-                auto res = read_demand_section(file);
-                instance.product_count_ = res.first;
-                instance.demands_ = res.second;
-                for (auto p = 0u; p < instance.product_count_; ++p) {
-                    auto demand = instance.demands_.at(p);
-                    if (demand > 0) {
-                        instance.needed_products_.push_back(p);
-                    }
-                    // We assume that if there is at least one product for
-                    // which demand is > 1 then the TPP instance is capacitated
-                    if (demand > 1) {
-                        instance.is_capacitated_ = true;
-                    }
+                // We assume that if there is at least one product for
+                // which demand is > 1 then the TPP instance is capacitated
+                if (demand > 1) {
+                    instance.is_capacitated_ = true;
                 }
-            } else if (starts_with(prefix, "OFFER_SECTION")) {
-                auto res = read_offer_section(file, instance.dimension_);
-                // Sort offers by price, i.e. from the lowest to the highest
-                for (auto &offers : res) {
-                    sort(begin(offers), end(offers), has_lower_price);
+            }
+        } else if (starts_with(prefix, "OFFER_SECTION")) {
+            check_format(instance.dimension_ > 0 && instance.product_count_ > 0,
+                         "DIMENSION and DEMAND_SECTION should precede OFFER_SECTION");
+            auto res = read_offer_section(file, instance.dimension_);
+            // Sort offers by price, i.e. from the lowest to the highest
+            for (auto &offers : res) {
+                sort(begin(offers), end(offers), has_lower_price);
+            }
+            instance.market_offers_ = res;
+
+            auto &mpo = instance.market_product_offers_;
+            mpo.resize(instance.dimension_);
+
+            for (auto m = 0u; m < instance.dimension_; ++m) {
+                auto &mpo_row = mpo.at(m);
+                mpo_row.resize(instance.product_count_);
+                for (const auto &offer : instance.market_offers_.at(m)) {
+                    check_format(offer.product_id_ < instance.product_count_,
+                                 "Invalid product id at market " + to_string(m + 1));
+                    mpo_row.at(offer.product_id_) = offer;
                 }
-                instance.market_offers_ = res;
+            }
+        } else if (starts_with(prefix, "EDGE_WEIGHT_SECTION")) {
+            check_format(edge_weight_type == EdgeWeightType::EXPLICIT,
+                         "EDGE_WEIGHT_SECTION requires EXPLICIT edge weights");
+            check_format(instance.dimension_ > 0,
+                         "DIMENSION should precede EDGE_WEIGHT_SECTION");
+
+            auto res = read_edge_weights(file, instance.dimension_,
+                                         edge_weight_format);
+            instance.edge_weights_ = res;
+        } else if (starts_with(prefix, "EOF")) {
+            // Ignore
+        } else if (starts_with(prefix, "EDGE_DATA_FORMAT")) {
+            LOG_F(INFO, "Ignoring EDGE_DATA_FORMAT: %s", suffix.c_str());
+        } else if (starts_with(prefix, "NODE_COORD_TYPE")) {
+            check_format(suffix == "TWOD_COORDS", "Unsupported node coord type: " + suffix);
+        } else if (starts_with(prefix, "NODE_COORD_SECTION")) {
+            check_format(instance.dimension_ > 0,
+                         "DIMENSION should precede NODE_COORD_SECTION");
+            auto coords = read_node_coords_section(file, instance.dimension_);
+            instance.edge_weights_ = calc_edge_weight_matrix(coords,
+                    edge_weight_type);
+        } else {
+            LOG_F(ERROR, "Unknown section: %s", prefix.c_str());
+            break ;
+        }
+    }
 
-                auto &mpo = instance.market_product_offers_;
-                mpo.resize(instance.dimension_);
+    check_format(instance.dimension_ > 0, "DIMENSION is missing");
+    check_format(instance.edge_weights_.size() == instance.dimension_,
+                 "The edge weights are missing");
+    check_format(instance.product_count_ > 0, "DEMAND_SECTION is missing");
+    check_format(instance.market_offers_.size() == instance.dimension_,
+                 "OFFER_SECTION is missing");
 
-                for (auto m = 0u; m < instance.dimension_; ++m) {
-                    auto &mpo_row = mpo.at(m);
-                    mpo_row.resize(instance.product_count_);
-                    for (const auto &offer : instance.market_offers_.at(m)) {
-                        mpo_row.at(offer.product_id_) = offer;
-                    }
-                }
-            } else if (starts_with(prefix, "EDGE_WEIGHT_SECTION")) {
-                assert(edge_weight_type == EdgeWeightType::EXPLICIT);
-
-                auto res = read_edge_weights(file, instance.dimension_,
-                                             edge_weight_format);
-                instance.edge_weights_ = res;
-            } else if (starts_with(prefix, "EOF")) {
-                // Ignore
-            } else if (starts_with(prefix, "EDGE_DATA_FORMAT")) {
-                LOG_F(INFO, "Ignoring EDGE_DATA_FORMAT: %s", suffix.c_str());
-            } else if (starts_with(prefix, "NODE_COORD_TYPE")) {
-                assert(suffix == "TWOD_COORDS");
-            } else if (starts_with(prefix, "NODE_COORD_SECTION")) {
-                auto coords = read_node_coords_section(file, instance.dimension_);
-                instance.edge_weights_ = calc_edge_weight_matrix(coords,
-                        edge_weight_type);
-            } else {
-                LOG_F(ERROR, "Unknown section: %s", prefix.c_str());
-                break ;
-            }
+    vector<int> available(instance.product_count_, 0);
+    for (const auto &offers : instance.market_offers_) {
+        for (const auto &offer : offers) {
+            available[offer.product_id_] += offer.quantity_;
         }
-        file.close();
     }
+    for (auto p : instance.needed_products_) {
+        check_format(available[p] >= instance.demands_[p],
+                     "Demand for product " + to_string(p + 1) + " cannot be satisfied");
+    }
+}
+
+
+bool TPP::try_load_from_file(const string &path, Instance &instance, string &error) {
+    instance = Instance();
+    LOG_SCOPE_F(INFO, "Loading TPP instance: %s", path.c_str());
+
+    // An ifstream can be opened also for a directory
+    struct stat path_stat;
+    if (stat(path.c_str(), &path_stat) == 0 && !S_ISREG(path_stat.st_mode)) {
+        error = "Not a regular file: " + path;
+        return false;
+    }
+    ifstream file{ path };
+    if (!file.is_open()) {
+        error = "Cannot open file: " + path;
+        return false;
+    }
+    LOG_F(INFO, "File opened");
+    try {
+        read_instance(file, instance);
+    } catch (const exception &e) {  // Also stoi errors or bad_alloc
+        error = "Invalid TPP instance " + path + ": " + e.what();
+        instance = Instance();
+        return false;
+    }
+    file.close();
+
     if (instance.name_.empty()) {
         // A naive extraction of filename
         auto it = path.find_last_of("/");
@@ -369,15 +446,19 @@ Instance TPP::load_from_file(const string path) {
         }
     }
 
-    instance.edge_weights_1d_.resize(instance.dimension_ * instance.dimension_);
-    for (auto i = 0u; i < instance.dimension_; ++i) {
-        for (auto j = 0u; j < instance.dimension_; ++j) {
-            instance.edge_weights_1d_.at(i * instance.dimension_ + j) = instance.edge_weights_.at(i).at(j);
-        }
-    }
+    init_travel_data(instance);
+    return true;
+}
 
-    instance.nn_lists_ = calc_nearest_neighbors(instance);
 
+/*
+ * Loads TPP instance from the file in the format specifed in:
+ * http://jriera.webs.ull.es/TPPLIB/TPPLIBFormat.htm
+ */
+Instance TPP::load_from_file(const string path) {
+    Instance instance;
+    string error;
+    CHECK_F(try_load_from_file(path, instance, error), "%s", error.c_str());
     return instance;
 }
 
@@ -569,6 +650,69 @@ std::vector<int> TPP::Instance::get_max_product_prices() const noexcept {
 
 
 
+vector<uint32_t> TPP::apply_delta(Instance &instance, const InstanceDelta &delta) {
+    auto &mpo = instance.market_product_offers_;
+    vector<uint8_t> market_changed(instance.dimension_, false);
+
+    auto check_ids = [&](const ProductOffer &offer) {
+        CHECK_F(offer.market_id_ > 0 && offer.market_id_ < instance.dimension_,
+                "Invalid market id: %u", offer.market_id_);
+        CHECK_F(offer.product_id_ < instance.product_count_,
+                "Invalid product id: %u", offer.product_id_);
+    };
+
+    for (const auto &offer : delta.removed_offers_) {
+        check_ids(offer);
+        mpo[offer.market_id_][offer.product_id_] = ProductOffer{};
+        market_changed[offer.market_id_] = true;
+    }
+    for (auto market : delta.closed_markets_) {
+        CHECK_F(market > 0 && market < instance.dimension_,
+                "Invalid market id: %u", market);
+        fill(begin(mpo[market]), end(mpo[market]), ProductOffer{});
+        market_changed[market] = true;
+    }
+    for (const auto &offer : delta.updated_offers_) {
+        check_ids(offer);
+        CHECK_F(offer.quantity_ > 0 && offer.price_ >= 0,
+                "Invalid offer of product %u at market %u",
+                offer.product_id_, offer.market_id_);
+        mpo[offer.market_id_][offer.product_id_] = offer;
+        market_changed[offer.market_id_] = true;
+    }
+
+    instance.best_known_cost_ = 0;
+
+    vector<uint32_t> changed_markets;
+    for (auto m = 0u; m < instance.dimension_; ++m) {
+        if (!market_changed[m]) {
+            continue ;
+        }
+        changed_markets.push_back(m);
+        auto &offers = instance.market_offers_[m];
+        offers.clear();
+        for (const auto &offer : mpo[m]) {
+            if (offer.quantity_ > 0) {
+                offers.push_back(offer);
+            }
+        }
+        sort(begin(offers), end(offers), has_lower_price);
+    }
+
+    vector<int> available(instance.product_count_, 0);
+    for (const auto &offers : instance.market_offers_) {
+        for (const auto &offer : offers) {
+            available[offer.product_id_] += offer.quantity_;
+        }
+    }
+    for (auto p : instance.needed_products_) {
+        CHECK_F(available[p] >= instance.demands_[p],
+                "Demand for product %u cannot be satisfied", p);
+    }
+    return changed_markets;
+}
+
+
 void test_is_solution_valid() {
     LOG_SCOPE_F(INFO, "test_is_solution_valid");
     vector<int> weights{ 0, 1, 1, 1,
@@ -662,8 +806,69 @@ void test_calc_solution_cost() {
 }
 
 
+void test_apply_delta() {
+    LOG_SCOPE_F(INFO, "test_apply_delta");
+
+    const auto dimension = 4u;
+    const auto product_count = 3u;
+    Instance instance;
+    instance.dimension_ = dimension;
+    instance.is_symmetric_ = true;
+    instance.product_count_ = product_count;
+    instance.demands_.assign(product_count, 1);
+    instance.needed_products_ = { 0, 1, 2 };
+    instance.edge_weights_1d_.assign(dimension * dimension, 1);
+    for (auto m = 0u; m < dimension; ++m) {
+        instance.edge_weights_1d_[m * dimension + m] = 0;
+    }
+    instance.market_offers_.resize(dimension);
+    instance.market_product_offers_.resize(dimension);
+    for (auto m = 0u; m < dimension; ++m) {
+        instance.market_product_offers_[m].resize(product_count);
+    }
+    InstanceDelta init;
+    init.updated_offers_ = { {/*cost*/1, /*quantity*/1, /*id*/0, /*market*/1 },
+                             {/*cost*/3, /*quantity*/1, /*id*/1, /*market*/1 },
+                             {/*cost*/2, /*quantity*/1, /*id*/1, /*market*/2 },
+                             {/*cost*/1, /*quantity*/1, /*id*/2, /*market*/2 },
+                             {/*cost*/4, /*quantity*/1, /*id*/2, /*market*/3 } };
+    apply_delta(instance, init);
+
+    vector<uint32_t> route{ 0, 1, 2 };
+    CHECK_F(calc_solution_cost(instance, route) == 3 + 1 + 2 + 1,
+            "Unexpected cost");
+    CHECK_F(instance.market_offers_[1].front().product_id_ == 0,
+            "Offers should be sorted by price");
+
+    InstanceDelta delta;
+    delta.updated_offers_ = { {/*cost*/5, /*quantity*/1, /*id*/1, /*market*/2 },
+                              {/*cost*/2, /*quantity*/1, /*id*/0, /*market*/3 } };
+    delta.removed_offers_ = { {0, 0, /*id*/0, /*market*/1 } };
+    const auto changed = apply_delta(instance, delta);
+    CHECK_F((changed == vector<uint32_t>{ 1, 2, 3 }), "Unexpected changed markets");
+
+    CHECK_F(instance.market_product_offers_[1][0].quantity_ == 0,
+            "The offer should be removed");
+    CHECK_F(instance.market_offers_[2].back().price_ == 5,
+            "The price should be updated");
+    CHECK_F(!is_solution_valid(instance, route),
+            "Product 0 is no longer available at the route");
+    vector<uint32_t> route2{ 0, 1, 2, 3 };
+    CHECK_F(calc_solution_cost(instance, route2) == 4 + 2 + 3 + 1,
+            "Unexpected cost: %d", calc_solution_cost(instance, route2));
+
+    InstanceDelta close;
+    close.closed_markets_ = { 1 };
+    apply_delta(instance, close);
+    CHECK_F(instance.market_offers_[1].empty(), "The market should be closed");
+    vector<uint32_t> route3{ 0, 2, 3 };
+    CHECK_F(is_solution_valid(instance, route3), "Expected valid solution");
+}
+
+
 void TPP::run_tests() {
     LOG_F(INFO, "Running tests");
     test_is_solution_valid();
     test_calc_solution_cost();
+    test_apply_delta();
 }
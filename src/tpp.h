@@ -89,9 +89,49 @@ namespace TPP {
     };
 
 
+    /**
+     * Loads the instance from a file in the TPPLIB format, aborts if the file
+     * cannot be read or is not a valid instance.
+     */
     Instance load_from_file(const string path);
 
 
+    /**
+     * As load_from_file but returns false and sets the error message
+     * instead of aborting, e.g. for the paths sent to the server.
+     */
+    bool try_load_from_file(const string &path, Instance &instance, string &error);
+
+
+    /**
+     * A change of the offers of an instance, e.g. the prices updated during
+     * the day. The ids of markets and products are 0-based as in the
+     * solution routes.
+     */
+    struct InstanceDelta {
+        // New offers or existing ones with a changed price (or quantity)
+        vector<ProductOffer> updated_offers_;
+        // Only the market and product ids are used
+        vector<ProductOffer> removed_offers_;
+        // All offers of the markets are removed
+        vector<uint32_t> closed_markets_;
+    };
+
+
+    /**
+     * Applies the delta to the instance by patching market_offers_ and
+     * market_product_offers_ of the changed markets. The removed and closed
+     * offers are processed before the updated ones. Every required product
+     * has to remain available.
+     *
+     * Returns the ids of the changed markets in increasing order. The
+     * solutions built for the instance before the change should be rebuilt
+     * from their routes, e.g. see ACO::on_instance_changed. The
+     * best_known_cost_ no longer applies and is reset to 0.
+     */
+    vector<uint32_t> apply_delta(Instance &instance, const InstanceDelta &delta);
+
+
     /**
      * Returns true if route represents a valid TPP solution, based on the data
      * in instance.
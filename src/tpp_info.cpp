@@ -13,21 +13,20 @@ using json = nlohmann::json;
 
 /**
  * Returns the best known solution or SolutionInfo{ 0, 0 } if it is not
- * available.
+ * available. The db (JSON) file is read on each call, so this is
+ * thread-safe.
  */
-TPP::SolutionInfo TPP::get_best_known_solution(std::string instance_path) {
+TPP::SolutionInfo TPP::get_best_known_solution(std::string instance_path,
+                                               const std::string &db_path) {
     LOG_SCOPE_F(INFO, "TPP::get_best_known_solution(%s)",
                 instance_path.c_str());
 
     SolutionInfo info{ 0, 0 };
 
-    static json db;
-
-    if (db.empty()) {
-        ifstream fin("best-known.js");
-        if (fin) {
-            fin >> db;
-        }
+    json db;
+    ifstream fin(db_path);
+    if (fin) {
+        fin >> db;
     }
     // A naive extraction of filename
     auto it = instance_path.find_last_of("/");
@@ -14,9 +14,11 @@ struct SolutionInfo {
 
 /**
  * Returns the best known solution or SolutionInfo{ 0, 0 } if it is not
- * available.
+ * available. The db (JSON) file is read on each call, so this is
+ * thread-safe.
  */
-SolutionInfo get_best_known_solution(std::string tpp_instance_path);
+SolutionInfo get_best_known_solution(std::string tpp_instance_path,
+                                     const std::string &db_path = "best-known.js");
 
 }
 
@@ -3,6 +3,7 @@
 
 #include "tpp_solution.h"
 #include "logging.h"
+#include "profiler.h"
 #include "utils.h"
 
 
@@ -35,6 +36,29 @@ TPP::Solution::Solution(const Instance &instance) noexcept
 }
 
 
+/**
+ * Copies the state of another solution for the same instance.
+ */
+TPP::Solution& TPP::Solution::operator=(const Solution &other) noexcept {
+    CHECK_F(&instance_ == &other.instance_,
+            "Solutions should refer to the same instance");
+    if (this != &other) {
+        route_ = other.route_;
+        cost_ = other.cost_;
+        travel_cost_ = other.travel_cost_;
+        market_selected_ = other.market_selected_;
+        product_offers_ = other.product_offers_;
+        purchase_costs_ = other.purchase_costs_;
+        demand_remaining_ = other.demand_remaining_;
+        remaining_products_ = other.remaining_products_;
+        markets_per_product_ = other.markets_per_product_;
+        unselected_markets_ = other.unselected_markets_;
+        total_unsatisfied_demand_ = other.total_unsatisfied_demand_;
+    }
+    return *this;
+}
+
+
 void TPP::Solution::push_back_market(uint32_t market_id) noexcept {
     insert_market_at_pos(market_id, route_.size());
 }
@@ -46,9 +70,9 @@ void TPP::Solution::push_back_market(uint32_t market_id) noexcept {
  * This has complexity of O(K*M) for the uncapacitated TPP.
  */
 void TPP::Solution::insert_market_at_pos(uint32_t market_id, uint32_t index) noexcept {
-    CHECK_F(market_selected_.at(market_id) == false,
+    DEBUG_CHECK_F(DEBUG_AT(market_selected_, market_id) == false,
             "Multiple market (%u) visits are not allowed", market_id);
-    CHECK_F(index > 0, "No insertion at pos 0 is allowed");
+    DEBUG_CHECK_F(index > 0, "No insertion at pos 0 is allowed");
 
     const auto prev = route_[index - 1];
     const auto next = route_[index % route_.size()];
@@ -59,7 +83,7 @@ void TPP::Solution::insert_market_at_pos(uint32_t market_id, uint32_t index) noe
         route_.insert(route_.begin() + static_cast<int>(index), market_id);
     }
 
-    market_selected_.at(market_id) = true;
+    DEBUG_AT(market_selected_, market_id) = true;
 
     const auto travel_cost_change = instance_.get_travel_cost(prev, market_id)
                                   + instance_.get_travel_cost(market_id, next)
@@ -67,13 +91,13 @@ void TPP::Solution::insert_market_at_pos(uint32_t market_id, uint32_t index) noe
     travel_cost_ += travel_cost_change;
     cost_ += travel_cost_change;
 
-    for (const auto &offer : instance_.market_offers_.at(market_id)) {
+    for (const auto &offer : DEBUG_AT(instance_.market_offers_, market_id)) {
         cost_ += add_product_offer(offer);
     }
 
     auto it = find(begin(unselected_markets_), end(unselected_markets_),
                    market_id);
-    CHECK_F(it != end(unselected_markets_),
+    DEBUG_CHECK_F(it != end(unselected_markets_),
             "market_id should be in unselected_markets_");
     unselected_markets_.erase(it);
 }
@@ -85,8 +109,8 @@ void TPP::Solution::insert_market_at_pos(uint32_t market_id, uint32_t index) noe
  * This has O(M*K) complexity for the U-TPP
  */
 void TPP::Solution::remove_market_at_pos(uint32_t pos) noexcept {
-    CHECK_F(pos < route_.size(), "Invalid position in erase_market_at_pos");
-    CHECK_F(pos > 0, "Cannot remove depot");
+    DEBUG_CHECK_F(pos < route_.size(), "Invalid position in erase_market_at_pos");
+    DEBUG_CHECK_F(pos > 0, "Cannot remove depot");
 
     const auto prev = route_[pos - 1];
     const auto removed = route_[pos];
@@ -94,7 +118,7 @@ void TPP::Solution::remove_market_at_pos(uint32_t pos) noexcept {
 
     route_.erase(route_.begin() + static_cast<int>(pos));
 
-    market_selected_.at(removed) = false;
+    DEBUG_AT(market_selected_, removed) = false;
 
     const auto travel_cost_change = instance_.get_travel_cost(prev, next)
                                   - instance_.get_travel_cost(prev, removed)
@@ -102,7 +126,7 @@ void TPP::Solution::remove_market_at_pos(uint32_t pos) noexcept {
     travel_cost_ += travel_cost_change;
     cost_ += travel_cost_change;
 
-    for (const auto &offer : instance_.market_offers_.at(removed)) {
+    for (const auto &offer : DEBUG_AT(instance_.market_offers_, removed)) {
         cost_ += remove_product_offer(offer);
     }
     unselected_markets_.push_back(removed);
@@ -121,7 +145,7 @@ pair<int, int> TPP::Solution::calc_product_offer_add_cost(ProductOffer new_offer
             "Uncapacitated TPP instance required");
 
     const auto product_id = new_offer.product_id_;
-    const auto &offers = product_offers_.at(new_offer.product_id_);
+    const auto &offers = DEBUG_AT(product_offers_, new_offer.product_id_);
     const auto prev_cost = purchase_costs_[product_id];
     int cost = prev_cost;
     int demand_satisfied = demand_remaining_[product_id];
@@ -144,7 +168,7 @@ int TPP::Solution::add_product_offer(const ProductOffer &new_offer) noexcept {
             "Uncapacitated TPP instance required");
 
     const auto product_id = new_offer.product_id_;
-    auto &offers = product_offers_.at(product_id);
+    auto &offers = DEBUG_AT(product_offers_, product_id);
 
     // We keep the list of offers sorted according to (price, quantity)
     insert_sorted(offers, new_offer, is_better_offer);   // O(M) complexity
@@ -157,12 +181,12 @@ int TPP::Solution::add_product_offer(const ProductOffer &new_offer) noexcept {
 
     const auto &cheapest = offers.front();
     cost = cheapest.price_;
-    demand_remaining_.at(product_id) = 0;
+    DEBUG_AT(demand_remaining_, product_id) = 0;
     demand_satisfied_after = true;
     markets_per_product_[product_id] = 1;
 
     total_unsatisfied_demand_ -= demand_before;
-    CHECK_F(total_unsatisfied_demand_ >= 0, "Demand has to be >= 0");
+    DEBUG_CHECK_F(total_unsatisfied_demand_ >= 0, "Demand has to be >= 0");
 
     // Is the demand finally satisfied by the market's offer?
     if (demand_satisfied_after != demand_satisfied_before) {
@@ -184,17 +208,17 @@ int TPP::Solution::remove_product_offer(const ProductOffer &offer) noexcept {
     CHECK_F(instance_.is_capacitated_ == false,
             "Uncapacitated TPP instance required");
 
-    auto &offers = product_offers_.at(offer.product_id_);
+    auto &offers = DEBUG_AT(product_offers_, offer.product_id_);
 
     auto it = lower_bound(begin(offers), end(offers), offer, is_better_offer);
     while (*it != offer) {
         ++it;
     }
-    CHECK_F(it != offers.end(), "Offer should exist in solution");
+    DEBUG_CHECK_F(it != offers.end(), "Offer should exist in solution");
 
     offers.erase(it);
 
-    auto &cost = purchase_costs_.at(offer.product_id_);
+    auto &cost = DEBUG_AT(purchase_costs_, offer.product_id_);
     const auto prev_cost = cost;
     bool demand_unsatisfied = false;
 
@@ -211,7 +235,7 @@ int TPP::Solution::remove_product_offer(const ProductOffer &offer) noexcept {
         demand_unsatisfied = true;
         markets_per_product_[offer.product_id_] = 0;
         total_unsatisfied_demand_ += 1;
-        CHECK_F(total_unsatisfied_demand_ >= 0, "Demand has to be >= 0");
+        DEBUG_CHECK_F(total_unsatisfied_demand_ >= 0, "Demand has to be >= 0");
     }
 
     if (demand_unsatisfied) {
@@ -242,10 +266,14 @@ TPP::Solution::calc_product_offer_removal_cost(const ProductOffer &rem_offer) co
             "Uncapacitated TPP instance required");
 
     const auto product_id = rem_offer.product_id_;
-    const auto &offers = product_offers_.at(product_id);
+    const auto &offers = DEBUG_AT(product_offers_, product_id);
     int cost = 0;
     bool demand_satisfied = false;
 
+    if (!offers.empty() && offers.front() != rem_offer) {
+        // The cheapest offer remains, nothing changes
+        return make_pair(0, true);
+    }
     if (offers.size() >= 2) { // U-TPP - just use the next cheapest offer
         cost = offers[1].price_;  // use the next cheapest offer
         demand_satisfied = true;
@@ -268,12 +296,12 @@ TPP::Solution::MarketAddVerdict
 TPP::Solution::calc_market_removal_cost(uint32_t market_id,
         bool validity_required) const noexcept {
     const auto it = find(begin(route_), end(route_), market_id);
-    CHECK_F(it != end(route_), "Market should be in the sol.");
-    CHECK_F(it != begin(route_), "We cannot remove depot");
+    DEBUG_CHECK_F(it != end(route_), "Market should be in the sol.");
+    DEBUG_CHECK_F(it != begin(route_), "We cannot remove depot");
 
     bool all_demands_satisfied = (total_unsatisfied_demand_ == 0);
     int cost = 0;
-    for (const auto &offer : instance_.market_offers_.at(market_id)) {
+    for (const auto &offer : DEBUG_AT(instance_.market_offers_, market_id)) {
         const auto verdict = calc_product_offer_removal_cost(offer);
         if (validity_required && !verdict.second) {
             return MarketAddVerdict{ 0, 0, /*demand_satisfied=*/false };
@@ -282,9 +310,9 @@ TPP::Solution::calc_market_removal_cost(uint32_t market_id,
         all_demands_satisfied &= verdict.second;
     }
     const auto index = distance(begin(route_), it);
-    const auto prev = route_.at(static_cast<uint32_t>(index - 1));
+    const auto prev = DEBUG_AT(route_, static_cast<uint32_t>(index - 1));
     const auto curr = market_id;
-    const auto next = route_.at(static_cast<uint32_t>(index + 1) % route_.size());
+    const auto next = DEBUG_AT(route_, static_cast<uint32_t>(index + 1) % route_.size());
 
     // Distance (travel costs) change if we remove 'curr'
     const auto dist_decrease = instance_.get_travel_cost(prev, curr)
@@ -306,12 +334,12 @@ TPP::Solution::calc_market_removal_cost(uint32_t market_id,
  */
 TPP::Solution::MarketAddVerdict
 TPP::Solution::calc_market_add_cost(uint32_t market_id) const noexcept {
-    CHECK_F(!is_market_used(market_id),
+    DEBUG_CHECK_F(!is_market_used(market_id),
             "Market should not be in the sol.");
 
     auto unsatisfied_count = total_unsatisfied_demand_;
     int cost = 0;
-    for (const auto &offer : instance_.market_offers_.at(market_id)) {
+    for (const auto &offer : DEBUG_AT(instance_.market_offers_, market_id)) {
         const auto res = calc_product_offer_add_cost(offer);
         cost += res.first;
         unsatisfied_count -= res.second;
@@ -338,6 +366,180 @@ TPP::Solution::calc_market_add_cost(uint32_t market_id) const noexcept {
 }
 
 
+/**
+ * Calculates how the solution would change if the markets in removed were
+ * removed from it. The solution is not modified.
+ *
+ * This has O(P + M + K * R) complexity for U-TPP, where R is the number of
+ * removed markets.
+ */
+TPP::Solution::MarketsRemoval
+TPP::Solution::calc_markets_removal(const vector<uint32_t> &removed) const noexcept {
+    CHECK_F(instance_.is_capacitated_ == false,
+            "Uncapacitated TPP instance required");
+
+    auto is_removed = [&](uint32_t m) {
+        return find(begin(removed), end(removed), m) != end(removed);
+    };
+    MarketsRemoval removal;
+    removal.markets_ = removed;
+    removal.purchase_costs_ = purchase_costs_;
+    removal.product_covered_.resize(instance_.product_count_, true);
+    removal.uncovered_products_ = remaining_products_;
+    for (auto product_id : remaining_products_) {
+        removal.product_covered_[product_id] = false;
+    }
+
+    int cost = 0;
+    for (auto m : removed) {
+        DEBUG_CHECK_F(m != 0 && is_market_used(m), "Market should be in the sol.");
+
+        for (const auto &offer : DEBUG_AT(instance_.market_offers_, m)) {
+            const auto product_id = offer.product_id_;
+            // The cheapest offer among the remaining markets
+            int price = 0;
+            bool available = false;
+            for (const auto &other : product_offers_[product_id]) {
+                if (!is_removed(other.market_id_)) {
+                    price = other.price_;
+                    available = true;
+                    break ;
+                }
+            }
+            auto &new_cost = removal.purchase_costs_[product_id];
+            if (!available && removal.product_covered_[product_id]) {
+                removal.product_covered_[product_id] = false;
+                removal.uncovered_products_.push_back(product_id);
+            }
+            cost += price - new_cost;  // Is 0 if already updated
+            new_cost = price;
+        }
+    }
+
+    // Travel cost change, the depot is never removed
+    const auto len = route_.size();
+    removal.route_.reserve(len);
+    removal.route_.push_back(route_[0]);
+    auto last_kept = route_[0];
+    for (auto i = 1u; i <= len; ++i) {
+        const auto prev = route_[i - 1];
+        const auto curr = route_[i % len];
+        const auto prev_removed = is_removed(prev);
+        const auto curr_removed = (i < len) && is_removed(curr);
+
+        if (prev_removed || curr_removed) {
+            cost -= instance_.get_travel_cost(prev, curr);
+        }
+        if (!curr_removed) {
+            if (prev_removed) {
+                cost += instance_.get_travel_cost(last_kept, curr);
+            }
+            if (i < len) {
+                removal.route_.push_back(curr);
+            }
+            last_kept = curr;
+        }
+    }
+    removal.cost_change_ = cost;
+    return removal;
+}
+
+
+/**
+ * Calculates how the solution cost would change if the markets in removal
+ * were removed from the solution and market_id was inserted in their place.
+ * The solution is not modified.
+ *
+ * Returns the cost change, the position at which market_id should be
+ * inserted into the route without the removed markets and whether the
+ * solution would be feasible.
+ *
+ * If validity_required = true the calculation stops as soon as it is known
+ * that the solution would become infeasible.
+ *
+ * This has O(max(K, M)) complexity for U-TPP, i.e. the same as
+ * calc_market_add_cost.
+ */
+TPP::Solution::MarketAddVerdict
+TPP::Solution::calc_exchange_cost(const MarketsRemoval &removal,
+                                  uint32_t market_id,
+                                  bool validity_required) const noexcept {
+    DEBUG_CHECK_F(!is_market_used(market_id),
+            "Market should not be in the sol.");
+    PROFILE_COUNT("exchange_moves_evaluated", 1);
+
+    const auto &offers = DEBUG_AT(instance_.market_product_offers_, market_id);
+    bool all_demands_satisfied = true;
+    for (auto product_id : removal.uncovered_products_) {
+        if (offers[product_id].quantity_ == 0) {
+            if (validity_required) {
+                return MarketAddVerdict{ 0, 0, /*demand_satisfied=*/false };
+            }
+            all_demands_satisfied = false;
+            break ;
+        }
+    }
+    int cost = removal.cost_change_;
+    for (const auto &offer : DEBUG_AT(instance_.market_offers_, market_id)) {
+        const auto product_id = offer.product_id_;
+        const auto curr_cost = removal.purchase_costs_[product_id];
+        if (!removal.product_covered_[product_id] || offer.price_ < curr_cost) {
+            cost += offer.price_ - curr_cost;
+        }
+    }
+    // Look for the cheapest place to insert the new market
+    const auto &route = removal.route_;
+    const auto len = route.size();
+    int min_dist_increase = numeric_limits<int>::max();
+    uint32_t min_dist_index = len + 1;
+    for (auto i = 0u; i < len; ++i) {
+        const auto curr = route[i];
+        const auto next = route[(i + 1) % len];
+        const auto dist_increase = instance_.get_travel_cost(curr, market_id)
+                                 + instance_.get_travel_cost(market_id, next)
+                                 - instance_.get_travel_cost(curr, next);
+        if (dist_increase < min_dist_increase) {
+            min_dist_increase = dist_increase;
+            min_dist_index = i + 1;
+        }
+    }
+    return MarketAddVerdict{ cost + min_dist_increase,
+                             min_dist_index,
+                             all_demands_satisfied };
+}
+
+
+TPP::Solution::MarketAddVerdict
+TPP::Solution::calc_exchange_cost(const vector<uint32_t> &removed,
+                                  uint32_t market_id) const noexcept {
+    return calc_exchange_cost(calc_markets_removal(removed), market_id);
+}
+
+
+/**
+ * Removes the markets in removed from the solution and inserts market_id at
+ * the given index (see calc_exchange_cost).
+ *
+ * This has O(K*M * R) complexity for U-TPP, where R is the number of removed
+ * markets.
+ */
+void TPP::Solution::exchange_markets(const vector<uint32_t> &removed,
+                                     uint32_t market_id, uint32_t index) noexcept {
+    PROFILE_COUNT("exchange_moves_accepted", 1);
+    vector<uint32_t> positions;
+    positions.reserve(removed.size());
+    for (auto m : removed) {
+        positions.push_back(get_market_pos_in_route(m));
+    }
+    // Remove from the back so that the positions remain valid
+    sort(positions.rbegin(), positions.rend());
+    for (auto pos : positions) {
+        remove_market_at_pos(pos);
+    }
+    insert_market_at_pos(market_id, index);
+}
+
+
 /*
  * Returns true if adding market to a solution will result in a
  * feasible solution, i.e. with all demands satisfied.
@@ -348,7 +550,7 @@ bool TPP::Solution::check_market_satisfies_demand(uint32_t market_id) const noex
     if (is_market_used(market_id)) {
         return false;
     }
-    const auto &offers = instance_.market_product_offers_.at(market_id);
+    const auto &offers = DEBUG_AT(instance_.market_product_offers_, market_id);
     for (auto prod_id : remaining_products_) {
         if (offers[prod_id].quantity_ < demand_remaining_[prod_id]) {
             return false;  // market cannot satisfy demand for this product
@@ -364,7 +566,7 @@ bool TPP::Solution::check_market_satisfies_demand(uint32_t market_id) const noex
  * This has O(1) complexity.
  */
 bool TPP::Solution::is_market_used(uint32_t market) const noexcept {
-    return market_selected_.at(market);
+    return DEBUG_AT(market_selected_, market);
 }
 
 
@@ -32,6 +32,13 @@ namespace TPP {
 
         Solution(const Instance &instance) noexcept;
 
+        Solution(const Solution &other) = default;
+
+        /**
+         * Copies the state of another solution for the same instance.
+         */
+        Solution& operator=(const Solution &other) noexcept;
+
         void push_back_market(uint32_t market_id) noexcept;
 
         void insert_market_at_pos(uint32_t market_id, uint32_t index) noexcept;
@@ -59,6 +66,54 @@ namespace TPP {
 
         MarketAddVerdict calc_market_add_cost(uint32_t market_id) const noexcept;
 
+        /**
+         * The effect of removing a set of markets from the solution,
+         * calculated once and used to evaluate many exchange candidates.
+         */
+        struct MarketsRemoval {
+            vector<uint32_t> markets_;  // The removed markets
+            vector<uint32_t> route_;  // The route without the removed markets
+            vector<int> purchase_costs_;  // [i] = purchase cost of product i
+                                          // after removal
+            vector<uint8_t> product_covered_;  // [i] = true if product i
+                                               // is still offered
+            vector<uint32_t> uncovered_products_;  // The new market has to
+                                                   // offer all of these
+            int cost_change_{ 0 };  // Change of the total cost
+        };
+
+        /**
+         * Calculates how the solution would change if the markets in removed
+         * were removed from it. The solution is not modified.
+         */
+        MarketsRemoval calc_markets_removal(const vector<uint32_t> &removed) const noexcept;
+
+        /**
+         * Calculates how the solution cost would change if the markets in
+         * removal were removed from the solution and market_id was inserted
+         * in their place. The solution is not modified.
+         *
+         * The returned index_ is the position at which market_id should be
+         * inserted into the route without the removed markets, as expected
+         * by exchange_markets.
+         *
+         * If validity_required = true the calculation stops as soon as it
+         * is known that the solution would become infeasible.
+         */
+        MarketAddVerdict calc_exchange_cost(const MarketsRemoval &removal,
+                                            uint32_t market_id,
+                                            bool validity_required=false) const noexcept;
+
+        MarketAddVerdict calc_exchange_cost(const vector<uint32_t> &removed,
+                                            uint32_t market_id) const noexcept;
+
+        /**
+         * Removes the markets in removed from the solution and inserts
+         * market_id at the given index (see calc_exchange_cost).
+         */
+        void exchange_markets(const vector<uint32_t> &removed,
+                              uint32_t market_id, uint32_t index) noexcept;
+
         /*
          * Returns true if adding market to a solution will result in a
          * feasible solution, i.e. with all demands satisfied.
@@ -8,6 +8,8 @@
 #include <vector>
 #include <numeric>
 #include <cmath>
+#include <thread>
+#include <cstdint>
 
 
 /**
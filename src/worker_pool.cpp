@@ -0,0 +1,69 @@
+#include "worker_pool.h"
+
+using namespace std;
+
+
+WorkerPool::WorkerPool(uint32_t threads_count)
+    : threads_count_(max(1u, threads_count)) {
+
+    for (auto i = 1u; i < threads_count_; ++i) {
+        threads_.emplace_back(&WorkerPool::worker_loop, this, i);
+    }
+}
+
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+
+void WorkerPool::run(uint32_t tasks_count, const task_t &task) {
+    if (tasks_count <= 1) {
+        task(0);
+        return ;
+    }
+    {
+        lock_guard<mutex> lock(mutex_);
+        task_ = &task;
+        tasks_count_ = tasks_count;
+        pending_ = tasks_count - 1;
+        ++generation_;
+    }
+    start_cv_.notify_all();
+
+    task(0);
+
+    unique_lock<mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+    task_ = nullptr;
+}
+
+
+void WorkerPool::worker_loop(uint32_t index) {
+    uint64_t done_generation = 0;
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        start_cv_.wait(lock, [&] { return stop_ || generation_ != done_generation; });
+        if (stop_) {
+            return ;
+        }
+        done_generation = generation_;
+        if (index >= tasks_count_) {
+            continue ;  // Fewer chunks than threads
+        }
+        const auto &task = *task_;
+        lock.unlock();
+        task(index);
+        lock.lock();
+        if (--pending_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
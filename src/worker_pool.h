@@ -0,0 +1,79 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+ * A fixed set of threads for the fork-join parallel loops of the hot paths,
+ * e.g. the best-improvement local search which scans the neighborhood many
+ * times per iteration. The threads are created once and wait for the tasks,
+ * so a loop costs a wake-up instead of creating and joining the threads.
+ *
+ * The calling thread takes part in each loop, so a pool of size 1 has no
+ * threads. parallel_for should be called by one thread at a time.
+ */
+struct WorkerPool {
+
+    explicit WorkerPool(uint32_t threads_count);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool& operator=(const WorkerPool &) = delete;
+
+    uint32_t size() const noexcept { return threads_count_; }
+
+    /**
+     * Splits [first, last) into at most size() contiguous chunks and calls
+     * fn(chunk_first, chunk_last, chunk_index) for each of them in parallel.
+     * The calling thread processes the first chunk. Returns after all the
+     * chunks were processed.
+     */
+    template<typename Fn>
+    void parallel_for(size_t first, size_t last, Fn fn) {
+        const auto n = last > first ? last - first : 0;
+        const auto chunks = std::max<uint32_t>(1u, std::min<size_t>(threads_count_, n));
+        const auto chunk_size = (n + chunks - 1) / chunks;
+
+        run(chunks, [&](uint32_t chunk) {
+            const auto chunk_first = std::min(last, first + chunk * chunk_size);
+            const auto chunk_last = std::min(last, chunk_first + chunk_size);
+            fn(chunk_first, chunk_last, chunk);
+        });
+    }
+
+private:
+
+    using task_t = std::function<void (uint32_t)>;
+
+    /*
+     * Calls task(i) for i in [0, tasks_count), task(0) in the calling
+     * thread and the others by the workers.
+     */
+    void run(uint32_t tasks_count, const task_t &task);
+
+    void worker_loop(uint32_t index);
+
+
+    const uint32_t threads_count_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const task_t *task_ = nullptr;
+    uint32_t tasks_count_ = 0;
+    uint32_t pending_ = 0;  // Tasks not finished by the workers
+    uint64_t generation_ = 0;  // Incremented for each run
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+
+#endif
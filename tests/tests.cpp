@@ -0,0 +1,848 @@
+/*
+ * Tests of the solver, run with: make test
+ *
+ * Runs the unit tests of the modules and the property-based tests of
+ * TPP::Solution: random sequences of the insertions, removals and exchanges
+ * of markets are applied to the solutions for the generated instances, and
+ * after each step the incrementally updated cost is compared with the one
+ * computed from scratch by calc_solution_cost. The GSH solutions and the
+ * add costs kept by the CAH are checked for the same instances (see
+ * gsh_run_tests, cah_run_tests). A failed check aborts the program
+ * (CHECK_F) and prints the seed of the case, so it can be reproduced with
+ * --seed.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+#include "docopt.h"
+#include "logging.h"
+#include "tpp.h"
+#include "tpp_solution.h"
+#include "checkpoint.h"
+#include "vec.h"
+#include "two_opt.h"
+#include "three_opt.h"
+#include "or_opt.h"
+#include "lin_kernighan.h"
+#include "gsh.h"
+#include "cah.h"
+#include "drop.h"
+#include "ls_cache.h"
+#include "instance_generator.h"
+#include "server.h"
+#include "solver.h"
+#include "worker_pool.h"
+#include "best_solution_buffer.h"
+
+using namespace std;
+
+
+static const char USAGE[] =
+R"(Tests of the U-TPP solver.
+
+    Usage:
+      tpp-test [--cases=<n>] [--steps=<n>] [--seed=<n>]
+      tpp-test (-h | --help)
+
+    Options:
+      --cases=<n>        Number of the generated instances for the
+                         property-based tests [default: 1000].
+      --steps=<n>        Number of the random changes of a solution
+                         per instance [default: 200].
+      --seed=<n>         Seed of the first case [default: 1].
+      -h --help          Show this screen.
+)";
+
+
+/*
+ * Checks if each index is processed exactly once by the chunks of the
+ * WorkerPool::parallel_for, also if there are fewer indices than threads.
+ */
+void test_worker_pool() {
+    for (auto threads = 1u; threads <= 4; ++threads) {
+        WorkerPool pool(threads);
+        for (auto n = 0u; n < 20; ++n) {
+            vector<int> counts(n, 0);
+            pool.parallel_for(0, n, [&](size_t first, size_t last, uint32_t chunk) {
+                CHECK_F(chunk < threads, "Invalid chunk index");
+                for (auto i = first; i < last; ++i) {
+                    ++counts[i];
+                }
+            });
+            CHECK_F(all_of(begin(counts), end(counts), [](int c) { return c == 1; }),
+                    "Each index should be processed once");
+        }
+    }
+}
+
+
+/*
+ * Returns a symmetric instance with the markets at the given coords and no
+ * products, e.g. to test the route optimizations. The edge weights are the
+ * truncated Euclidean distances as for the EUC_2D instance files.
+ */
+TPP::Instance make_instance_from_coords(const vector<pair<int, int>> &coords) {
+    const auto n = static_cast<uint32_t>(coords.size());
+    TPP::Instance instance;
+    instance.name_ = "coords";
+    instance.dimension_ = n;
+    instance.is_symmetric_ = true;
+    instance.edge_weights_.assign(n, vector<int>(n, 0));
+    instance.edge_weights_1d_.assign(n * n, 0);
+    for (auto i = 0u; i < n; ++i) {
+        for (auto j = 0u; j < n; ++j) {
+            const double xd = coords[i].first - coords[j].first;
+            const double yd = coords[i].second - coords[j].second;
+            const auto weight = static_cast<int>(sqrt(xd * xd + yd * yd));
+            instance.edge_weights_[i][j] = weight;
+            instance.edge_weights_1d_[i * n + j] = weight;
+        }
+    }
+    instance.nn_lists_.resize(n);
+    for (auto i = 0u; i < n; ++i) {
+        auto &nn_list = instance.nn_lists_[i];
+        for (auto j = 0u; j < n; ++j) {
+            if (j != i) {
+                nn_list.push_back(j);
+            }
+        }
+        sort(begin(nn_list), end(nn_list), [&](uint32_t a, uint32_t b) {
+            return instance.get_travel_cost(i, a) < instance.get_travel_cost(i, b);
+        });
+    }
+    instance.market_offers_.resize(n);
+    instance.market_product_offers_.resize(n);
+    return instance;
+}
+
+
+/*
+ * Checks if a route optimization which returned delta updated the solution
+ * consistently: the depot is first and the cost is equal to start_cost +
+ * delta and to the route length. The instance should have no products, see
+ * make_instance_from_coords.
+ */
+void check_route_optimization(const TPP::Solution &sol, int start_cost, int delta) {
+    CHECK_F(sol.route_.front() == 0, "Depot should be first");
+    CHECK_F(sol.cost_ == start_cost + delta, "Cost should be updated");
+    CHECK_F(sol.cost_ == sol.instance_.calc_travel_cost(sol.route_),
+            "Cost should be equal to the route length");
+}
+
+
+void test_or_opt() {
+    LOG_SCOPE_F(INFO, "test_or_opt");
+
+    // Markets on the perimeter of a 20 x 10 rectangle, the shortest route has
+    // length 60
+    const vector<pair<int, int>> coords{ { 0, 0 }, { 10, 0 }, { 20, 0 },
+                                         { 20, 10 }, { 10, 10 }, { 0, 10 } };
+    const auto instance = make_instance_from_coords(coords);
+
+    for (auto fn : { two_opt_nn, or_opt_nn, two_opt_or_opt_nn }) {
+        TPP::Solution sol(instance);
+        sol.route_ = { 0, 2, 4, 1, 3, 5 };
+        sol.travel_cost_ = sol.cost_ = instance.calc_travel_cost(sol.route_);
+        const auto start_cost = sol.cost_;
+
+        const auto delta = fn(instance, sol, true, 5);
+
+        CHECK_F(delta < 0, "Improvement expected");
+        check_route_optimization(sol, start_cost, delta);
+        LOG_F(INFO, "Route after opt.: %s (%d)",
+              container_to_string(sol.route_).c_str(), sol.cost_);
+    }
+    TPP::Solution sol(instance);
+    sol.route_ = { 0, 2, 4, 1, 3, 5 };
+    sol.travel_cost_ = sol.cost_ = instance.calc_travel_cost(sol.route_);
+    two_opt_or_opt_nn(instance, sol, true, 5);
+    CHECK_F(sol.cost_ == 60, "Optimal route expected, got: %d", sol.cost_);
+}
+
+
+void test_lin_kernighan() {
+    LOG_SCOPE_F(INFO, "test_lin_kernighan");
+
+    // Markets on a circle, the optimal route visits them in the order of
+    // angles
+    const auto n = 12u;
+    vector<pair<int, int>> coords;
+    for (auto i = 0u; i < n; ++i) {
+        const auto angle = 2 * M_PI * i / n;
+        coords.emplace_back(static_cast<int>(1000 * cos(angle)),
+                            static_cast<int>(1000 * sin(angle)));
+    }
+    const auto instance = make_instance_from_coords(coords);
+    vector<uint32_t> optimal(n);
+    iota(begin(optimal), end(optimal), 0u);
+    const auto optimal_cost = instance.calc_travel_cost(optimal);
+
+    TPP::Solution sol(instance);
+    sol.route_ = { 0, 5, 2, 9, 4, 11, 6, 1, 8, 3, 10, 7 };
+    sol.travel_cost_ = sol.cost_ = instance.calc_travel_cost(sol.route_);
+    const auto start_cost = sol.cost_;
+
+    const auto delta = lin_kernighan(instance, sol, true, 6);
+
+    check_route_optimization(sol, start_cost, delta);
+    CHECK_F(sol.cost_ == optimal_cost, "Optimal route expected, got: %d (%d)",
+            sol.cost_, optimal_cost);
+}
+
+
+/*
+ * Checks if Solution::calc_exchange_cost agrees with the actual change of the
+ * solution after the exchange.
+ */
+void test_calc_exchange_cost() {
+    LOG_SCOPE_F(INFO, "test_calc_exchange_cost");
+
+    const auto dimension = 8u;
+    const auto product_count = 5u;
+    std::mt19937 rng(1234);
+
+    vector<pair<int, int>> coords;
+    for (auto i = 0u; i < dimension; ++i) {
+        coords.emplace_back(rng() % 100, rng() % 100);
+    }
+    auto instance = make_instance_from_coords(coords);
+    instance.product_count_ = product_count;
+    instance.demands_.assign(product_count, 1);
+    for (auto p = 0u; p < product_count; ++p) {
+        instance.needed_products_.push_back(p);
+    }
+    for (auto m = 1u; m < dimension; ++m) {
+        instance.market_product_offers_[m].resize(product_count);
+        for (auto p = 0u; p < product_count; ++p) {
+            if (rng() % 3 != 0) {
+                const TPP::ProductOffer offer{ static_cast<int>(1 + rng() % 50), 1,
+                                          static_cast<uint16_t>(p),
+                                          static_cast<uint16_t>(m) };
+                instance.market_offers_[m].push_back(offer);
+                instance.market_product_offers_[m][p] = offer;
+            }
+        }
+    }
+    instance.market_product_offers_[0].resize(product_count);
+
+    auto checks = 0;
+    for (auto trial = 0; trial < 10; ++trial) {
+        TPP::Solution sol(instance);
+        vector<uint32_t> markets{ 1, 2, 3, 4, 5, 6, 7 };
+        std::shuffle(begin(markets), end(markets), rng);
+        const auto len = 2 + rng() % (dimension - 2);
+        for (auto i = 0u; i < len; ++i) {
+            sol.push_back_market(markets[i]);
+        }
+        for (auto k = 1u; k <= 3; ++k) {
+            for (auto i = 1u; i + k <= sol.route_.size(); ++i) {
+                vector<uint32_t> removed(sol.route_.begin() + i,
+                                         sol.route_.begin() + i + k);
+                for (auto cand : sol.get_unselected_markets()) {
+                    const auto verdict = sol.calc_exchange_cost(removed, cand);
+                    TPP::Solution after(sol);
+                    after.exchange_markets(removed, cand, verdict.index_);
+
+                    CHECK_F(after.cost_ == sol.cost_ + verdict.cost_change_,
+                            "Expected cost: %d got: %d", after.cost_,
+                            sol.cost_ + verdict.cost_change_);
+                    CHECK_F(after.is_valid() == verdict.demand_satisfied_,
+                            "Validity should be predicted correctly");
+                    CHECK_F(after.cost_ == TPP::calc_solution_cost(instance, after.route_)
+                            || !after.is_valid(),
+                            "Cost should be equal to the calculated");
+                    ++checks;
+                }
+            }
+        }
+    }
+    LOG_F(INFO, "Checked %d exchanges", checks);
+}
+
+
+/*
+ * Checks if the solutions read from BestSolutionBuffer while another thread
+ * publishes them are never torn, i.e. the route and the cost of a read
+ * solution belong to the same version, and the versions do not decrease.
+ */
+void test_best_solution_buffer() {
+    const uint32_t versions = 100000;
+    // The cost, iteration and route contents are derived from the version
+    auto make_route = [](uint32_t version) {
+        vector<uint32_t> route(1 + version % 17);
+        iota(begin(route), end(route), version);
+        return route;
+    };
+
+    BestSolutionBuffer buffer;
+    CHECK_F(buffer.read().version_ == 0, "Nothing should be published yet");
+
+    atomic<bool> writer_done{ false };
+    thread writer([&] {
+        for (auto version = 1u; version <= versions; ++version) {
+            buffer.publish(static_cast<int>(version), make_route(version),
+                           static_cast<int>(version), 0);
+        }
+        writer_done = true;
+    });
+    uint64_t prev_version = 0;
+    uint32_t reads = 0;
+    auto done = false;
+    while (!done) {
+        done = writer_done;  // The last read happens after all the writes
+        const auto &solution = buffer.read();
+        CHECK_F(solution.version_ >= prev_version, "Version decreased: %lu -> %lu",
+                static_cast<unsigned long>(prev_version),
+                static_cast<unsigned long>(solution.version_));
+        if (solution.version_ > 0) {
+            const auto version = static_cast<uint32_t>(solution.version_);
+            CHECK_F(solution.cost_ == static_cast<int>(version)
+                    && solution.iteration_ == static_cast<int>(version)
+                    && solution.route_ == make_route(version),
+                    "Inconsistent solution of version %u", version);
+        }
+        prev_version = solution.version_;
+        ++reads;
+    }
+    writer.join();
+    CHECK_F(prev_version == versions, "The last version should be read, got: %lu",
+            static_cast<unsigned long>(prev_version));
+    LOG_F(INFO, "Best solution buffer reads: %u", reads);
+}
+
+
+void run_unit_tests() {
+    TPP::run_tests();
+    test_calc_exchange_cost();
+    Vec::run_tests();
+    test_two_opt();
+    three_opt_run_tests();
+    test_or_opt();
+    test_lin_kernighan();
+    test_worker_pool();
+    test_best_solution_buffer();
+    server_run_tests();
+}
+
+
+/*
+ * Writes the instance generated with the config to a temporary file and
+ * loads it.
+ */
+TPP::Instance make_generated_instance(const TPP::GeneratorConfig &config) {
+    const auto path = "/tmp/tpp-test-" + to_string(getpid()) + ".tpp";
+    {
+        ofstream out(path);
+        CHECK_F(out.is_open(), "Cannot create instance file: %s", path.c_str());
+        TPP::write_random_instance(out, config);
+    }
+    auto instance = TPP::load_from_file(path);
+    remove(path.c_str());
+    return instance;
+}
+
+
+/*
+ * Returns a random instance, the parameters are drawn using the seed.
+ */
+TPP::Instance make_random_instance(uint32_t seed) {
+    std::mt19937 rng(seed);
+
+    TPP::GeneratorConfig config;
+    config.seed_ = seed;
+    config.markets_ = 4 + rng() % 60;
+    config.products_ = 1 + rng() % 30;
+    config.explicit_weights_ = (rng() % 2 == 0);
+    config.clusters_ = rng() % 3;
+    config.offer_density_ = (rng() % 2 == 0) ? 0 : 0.1 + (rng() % 8) / 10.0;
+    config.max_price_ = 1 + rng() % 500;
+    return make_generated_instance(config);
+}
+
+
+/*
+ * Checks the hits and misses of the LocalSearchCache: a result is found for
+ * the input route in any rotation (and direction if the instance is
+ * symmetric) and for its own route, the least recently used entries are
+ * evicted.
+ */
+void test_ls_cache(const TPP::Instance &instance) {
+    CHECK_F(instance.dimension_ >= 5, "Too few markets");
+    auto make_solution = [&](const vector<uint32_t> &route) {
+        TPP::Solution sol(instance);
+        for (auto m : route) {
+            if (m != 0) {
+                sol.push_back_market(m);
+            }
+        }
+        return sol;
+    };
+    LocalSearchCache cache(3);
+
+    const vector<uint32_t> before{ 0, 1, 2, 3 };
+    const vector<uint32_t> after{ 0, 2, 1 };
+    CHECK_F(cache.find(instance, before) == nullptr, "Empty cache should miss");
+    cache.insert(instance, before, make_solution(after));
+    CHECK_F(cache.size() == 2, "The input and the result should be stored");
+
+    const auto *found = cache.find(instance, { 2, 3, 0, 1 });
+    CHECK_F(found != nullptr && found->route_ == after, "A rotated route should hit");
+    if (instance.is_symmetric_) {
+        found = cache.find(instance, { 0, 3, 2, 1 });
+        CHECK_F(found != nullptr && found->route_ == after, "A reversed route should hit");
+    }
+    found = cache.find(instance, after);
+    CHECK_F(found != nullptr && found->route_ == after, "The result should hit");
+    CHECK_F(cache.find(instance, { 0, 1, 3, 2 }) == nullptr, "Another route should miss");
+    CHECK_F(cache.find(instance, { 0, 1, 4 }) == nullptr, "Another set should miss");
+
+    const auto hits = instance.is_symmetric_ ? 3u : 2u;
+    CHECK_F(cache.hits_ == hits && cache.lookups_ == hits + 3,
+            "Unexpected hits: %llu, lookups: %llu",
+            static_cast<unsigned long long>(cache.hits_),
+            static_cast<unsigned long long>(cache.lookups_));
+
+    // The result was used last, so the input route is evicted first
+    cache.insert(instance, { 0, 4 }, make_solution({ 0, 4 }));
+    CHECK_F(cache.size() == 3, "The size should not change");
+    cache.insert(instance, { 0, 3, 4 }, make_solution({ 0, 4, 3 }));
+    CHECK_F(cache.size() == 3, "The size should be limited by the capacity");
+    CHECK_F(cache.find(instance, before) == nullptr, "The LRU entry should be evicted");
+    CHECK_F(cache.find(instance, { 0, 3, 4 }) != nullptr, "The last entry should hit");
+
+    cache.clear();
+    CHECK_F(cache.size() == 0 && cache.find(instance, { 0, 3, 4 }) == nullptr,
+            "The cleared cache should miss");
+}
+
+
+/*
+ * Checks if the --stagnation limit stops the ACO after it converged, also if
+ * the limit is longer than the period of the pheromone resets (which find new
+ * restart best solutions but not better global ones).
+ */
+void test_stagnation_stop(const TPP::Instance &instance) {
+    const uint32_t max_idle = 1000;
+    const uint32_t max_iterations = 5000;
+
+    SolverConfig config;
+    config.seed_ = 1;
+    config.max_iterations_ = max_iterations;
+    config.stagnation_iterations_ = max_idle;
+    Solver solver(instance, config);
+    const auto verbosity = loguru::g_stderr_verbosity;
+    loguru::g_stderr_verbosity = loguru::Verbosity_ERROR;
+    const auto &result = solver.run();
+    loguru::g_stderr_verbosity = verbosity;
+
+    CHECK_F(!result.improvements_.empty(), "A solution should be found");
+    const auto last_improvement = result.improvements_.back().iteration_;
+    CHECK_F(result.iterations_ < max_iterations,
+            "The run should stop before the iterations limit, iterations: %u",
+            result.iterations_);
+    CHECK_F(result.iterations_ - last_improvement == max_idle,
+            "The run should stop %u iterations after the last improvement, "
+            "iterations: %u, last improvement: %u",
+            max_idle, result.iterations_, last_improvement);
+}
+
+
+/*
+ * Checks if cancelling a solver does not stop the others.
+ */
+void test_solver_cancel(const TPP::Instance &instance) {
+    SolverConfig config;
+    config.seed_ = 1;
+    config.max_iterations_ = 20;
+    Solver cancelled(instance, config);
+    Solver other(instance, config);
+
+    cancelled.cancel();
+    CHECK_F(cancelled.run().iterations_ == 0, "The cancelled solver should not run");
+    CHECK_F(other.run().iterations_ == config.max_iterations_,
+            "The other solver should run all the iterations");
+}
+
+
+/*
+ * Checks if a market which becomes the cheapest one after an instance
+ * change gets the heuristic info and is used by the continued ACO run.
+ */
+void test_instance_change_heuristic(TPP::Instance instance) {
+    // The market closest to the depot whose products are also offered
+    // elsewhere, so it can be closed at the start
+    vector<int> offers_count(instance.product_count_, 0);
+    for (const auto &offers : instance.market_offers_) {
+        for (const auto &offer : offers) {
+            ++offers_count[offer.product_id_];
+        }
+    }
+    uint32_t market = 0;
+    for (auto m : instance.nn_lists_[0]) {
+        const auto &offers = instance.market_offers_[m];
+        if (m != 0 && all_of(begin(offers), end(offers), [&](const TPP::ProductOffer &o) {
+                                 return offers_count[o.product_id_] > 1; })) {
+            market = m;
+            break ;
+        }
+    }
+    CHECK_F(market != 0, "No market can be closed");
+
+    TPP::InstanceDelta close;
+    close.closed_markets_ = { market };
+    TPP::apply_delta(instance, close);
+
+    SolverConfig config;
+    config.seed_ = 1;
+    config.max_iterations_ = 100;
+    Solver solver(instance, config);
+    const auto verbosity = loguru::g_stderr_verbosity;
+    loguru::g_stderr_verbosity = loguru::Verbosity_ERROR;
+    solver.run();
+
+    TPP::InstanceDelta cheap;
+    for (auto p : instance.needed_products_) {
+        TPP::ProductOffer offer;
+        offer.price_ = 1;
+        offer.quantity_ = max(1, instance.demands_[p]);
+        offer.product_id_ = static_cast<uint16_t>(p);
+        offer.market_id_ = static_cast<uint16_t>(market);
+        cheap.updated_offers_.push_back(offer);
+    }
+    const auto changed_markets = TPP::apply_delta(instance, cheap);
+    CHECK_F((changed_markets == vector<uint32_t>{ market }), "Only the market should change");
+    solver.on_instance_changed(changed_markets);
+
+    const auto &row = solver.aco_->heuristic_[market];
+    CHECK_F(row[instance.product_count_] > 0,
+            "The heuristic info of market %u should be recomputed", market);
+
+    const auto &result = solver.run(make_unique<FixedIterationsStopCondition>(200));
+    loguru::g_stderr_verbosity = verbosity;
+    CHECK_F(find(begin(result.route_), end(result.route_), market) != end(result.route_),
+            "The cheapest market %u should be in the best route", market);
+}
+
+
+/*
+ * Checks if the local search is still applied, and the search improves the
+ * repaired solution, after the prices were raised so that the costs found
+ * for the old data are lower than any new one.
+ */
+void test_instance_change_local_search(TPP::Instance instance) {
+    SolverConfig config;
+    config.seed_ = 1;
+    config.max_iterations_ = 300;  // The local search starts at 200
+    Solver solver(instance, config);
+    const auto verbosity = loguru::g_stderr_verbosity;
+    loguru::g_stderr_verbosity = loguru::Verbosity_ERROR;
+    solver.run();
+
+    TPP::InstanceDelta raise;
+    for (const auto &offers : instance.market_offers_) {
+        for (auto offer : offers) {
+            offer.price_ += 20;
+            raise.updated_offers_.push_back(offer);
+        }
+    }
+    const auto changed_markets = TPP::apply_delta(instance, raise);
+    const auto repaired_cost = solver.on_instance_changed(changed_markets);
+
+    auto count_ls_calls = [&] {
+        uint64_t calls = 0;
+        for (const auto &stats : solver.aco_->ls_scheduler_.stats_) {
+            calls += stats.calls_;
+        }
+        return calls;
+    };
+    const auto calls_before = count_ls_calls();
+    const auto &result = solver.run(make_unique<FixedIterationsStopCondition>(200));
+    loguru::g_stderr_verbosity = verbosity;
+
+    CHECK_F(count_ls_calls() > calls_before,
+            "The local search should be applied after the change");
+    CHECK_F(result.cost_ < repaired_cost,
+            "The repaired solution should be improved: %d, repaired: %d",
+            result.cost_, repaired_cost);
+}
+
+
+/*
+ * Checks if a run resumed from a checkpoint saved during the local search
+ * phase gives the same result as the run which was not interrupted.
+ */
+void test_checkpoint_resume(const TPP::Instance &instance) {
+    const auto path = "/tmp/tpp-test-" + to_string(getpid()) + ".ckpt";
+    const int checkpoint_iteration = 250;  // The local search starts at 200
+
+    SolverConfig config;
+    config.seed_ = 1;
+    config.max_iterations_ = 300;
+    Solver straight(instance, config);
+    straight.iteration_done_callback_ = [&](const Solver &solver) {
+        const auto &aco = *solver.aco_;
+        if (aco.current_iteration_ == checkpoint_iteration) {
+            Checkpoint checkpoint;
+            checkpoint.dimension_ = instance.dimension_;
+            checkpoint.products_count_ = instance.product_count_;
+            checkpoint.state_ = aco.get_state();
+            save_checkpoint(path, checkpoint);
+        }
+    };
+    const auto verbosity = loguru::g_stderr_verbosity;
+    loguru::g_stderr_verbosity = loguru::Verbosity_ERROR;
+    const auto expected = straight.run();
+
+    auto checkpoint = load_checkpoint(path);
+    remove(path.c_str());
+    CHECK_F(checkpoint.state_.current_iteration_ == checkpoint_iteration,
+            "Loaded iteration: %d", checkpoint.state_.current_iteration_);
+    Solver resumed(instance, config);
+    resumed.aco_->resume_from(move(checkpoint.state_));
+    const auto &result = resumed.run();
+    loguru::g_stderr_verbosity = verbosity;
+
+    CHECK_F(result.iterations_ == expected.iterations_, "Iterations: %u, expected: %u",
+            result.iterations_, expected.iterations_);
+    CHECK_F(result.cost_ == expected.cost_, "Cost: %d, expected: %d",
+            result.cost_, expected.cost_);
+    CHECK_F(result.route_ == expected.route_, "The resumed run should find the same route");
+}
+
+
+/*
+ * Checks if the incrementally updated data of the solution agree with the
+ * data computed from scratch.
+ */
+void check_solution_consistency(const TPP::Solution &sol) {
+    const auto &instance = sol.instance_;
+    const auto &route = sol.route_;
+
+    CHECK_F(!route.empty() && route[0] == 0, "The route should start at the depot");
+
+    int travel_cost = 0;
+    for (auto i = 0u; i < route.size(); ++i) {
+        travel_cost += instance.get_travel_cost(route[i], route[(i + 1) % route.size()]);
+    }
+    CHECK_F(sol.travel_cost_ == travel_cost, "Travel cost: %d, expected: %d",
+            sol.travel_cost_, travel_cost);
+
+    const auto is_valid = TPP::is_solution_valid(instance, route);
+    CHECK_F(sol.is_valid() == is_valid, "Validity should agree with is_solution_valid");
+    if (is_valid) {
+        const auto cost = TPP::calc_solution_cost(instance, route);
+        CHECK_F(sol.cost_ == cost, "Cost: %d, expected: %d", sol.cost_, cost);
+    }
+
+    CHECK_F(route.size() + sol.unselected_markets_.size() == instance.dimension_,
+            "Each market should be either selected or not");
+    for (auto m : route) {
+        CHECK_F(sol.is_market_used(m), "Market %u should be marked as used", m);
+    }
+    for (auto m : sol.unselected_markets_) {
+        CHECK_F(!sol.is_market_used(m), "Market %u should not be marked as used", m);
+    }
+}
+
+
+/*
+ * Applies random changes to a solution and checks if MarketDontLookBits
+ * keeps the bit of a market only if its neighbors in the route are the same
+ * and none of the added or removed markets offers its products.
+ */
+void test_dont_look_bits(const TPP::Instance &instance, uint32_t seed, uint32_t steps) {
+    std::mt19937 rng(seed);
+    TPP::Solution sol(instance);
+    MarketDontLookBits dlb(instance);
+    dlb.update(sol);
+
+    auto get_neighbors = [](const vector<uint32_t> &route, uint32_t pos) {
+        const auto len = route.size();
+        return make_pair(route[(pos + len - 1) % len], route[(pos + 1) % len]);
+    };
+    auto have_common_products = [&](uint32_t a, uint32_t b) {
+        for (const auto &offer : instance.market_offers_[a]) {
+            if (instance.market_product_offers_[b][offer.product_id_].quantity_ > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (auto step = 0u; step < steps; ++step) {
+        for (auto m : sol.route_) {
+            if (rng() % 2 == 0) {
+                dlb.set(m);
+            }
+        }
+        const auto old_route = sol.route_;
+        vector<uint8_t> old_bits(instance.dimension_, false);
+        for (auto m : old_route) {
+            old_bits[m] = dlb.is_set(m);
+        }
+
+        const auto unselected = sol.get_unselected_markets();
+        const auto route_len = static_cast<uint32_t>(sol.route_.size());
+        const auto action = rng() % 4;
+        if (action == 0 && !unselected.empty()) {
+            const auto market = unselected[rng() % unselected.size()];
+            sol.insert_market_at_pos(market, 1 + rng() % route_len);
+        } else if (action == 1 && route_len > 1) {
+            sol.remove_market_at_pos(1 + rng() % (route_len - 1));
+        } else if (action == 2 && route_len > 2) {
+            // Swap of two consecutive markets, the same markets are selected
+            const auto pos = 1 + rng() % (route_len - 2);
+            const auto market = sol.route_[pos + 1];
+            sol.remove_market_at_pos(pos + 1);
+            sol.insert_market_at_pos(market, pos);
+        }  // Otherwise no change
+        dlb.update(sol);
+
+        vector<uint32_t> changed;
+        for (auto m : sol.route_) {
+            if (find(begin(old_route), end(old_route), m) == end(old_route)) {
+                changed.push_back(m);
+            }
+        }
+        for (auto m : old_route) {
+            if (!sol.is_market_used(m)) {
+                changed.push_back(m);
+            }
+        }
+        for (auto pos = 0u; pos < sol.route_.size(); ++pos) {
+            const auto m = sol.route_[pos];
+            const auto old_it = find(begin(old_route), end(old_route), m);
+            auto expected = old_it != end(old_route) && old_bits[m];
+            if (expected) {
+                const auto old_neighbors = get_neighbors(
+                    old_route, static_cast<uint32_t>(distance(begin(old_route), old_it)));
+                const auto neighbors = get_neighbors(sol.route_, pos);
+                expected = old_neighbors == neighbors
+                        || (instance.is_symmetric_ && old_neighbors.first == neighbors.second
+                            && old_neighbors.second == neighbors.first);
+            }
+            for (auto c : changed) {
+                expected = expected && !have_common_products(c, m);
+            }
+            CHECK_F(dlb.is_set(m) == expected, "Step %u, market %u bit: %d, expected: %d",
+                    step, m, dlb.is_set(m), expected);
+        }
+    }
+}
+
+
+/*
+ * Applies random changes to a solution, the predicted cost changes are
+ * compared with the actual ones and the solution with the one computed from
+ * scratch.
+ */
+void test_solution_incremental_cost(const TPP::Instance &instance,
+                                    uint32_t seed, uint32_t steps) {
+    std::mt19937 rng(seed);
+    TPP::Solution sol(instance);
+
+    auto random_element = [&](const vector<uint32_t> &vec) {
+        return vec.at(rng() % vec.size());
+    };
+
+    for (auto step = 0u; step < steps; ++step) {
+        const auto unselected = sol.get_unselected_markets();
+        const auto route_len = sol.route_.size();
+        const auto cost_before = sol.cost_;
+        const auto action = rng() % 4;
+
+        if (action == 0 && !unselected.empty()) {
+            // Cheapest insertion
+            const auto market = random_element(unselected);
+            const auto verdict = sol.calc_market_add_cost(market);
+            sol.insert_market_at_pos(market, verdict.index_);
+            CHECK_F(sol.cost_ == cost_before + verdict.cost_change_,
+                    "Insertion cost change: %d, predicted: %d",
+                    sol.cost_ - cost_before, verdict.cost_change_);
+            CHECK_F(sol.is_valid() == verdict.demand_satisfied_,
+                    "Validity after insertion should be predicted correctly");
+        } else if (action == 1 && !unselected.empty()) {
+            // Insertion at a random position
+            const auto market = random_element(unselected);
+            const auto pos = 1 + static_cast<uint32_t>(rng() % route_len);
+            sol.insert_market_at_pos(market, pos);
+        } else if (action == 2 && route_len > 1) {
+            const auto pos = 1 + static_cast<uint32_t>(rng() % (route_len - 1));
+            const auto market = sol.route_[pos];
+            const auto verdict = sol.calc_market_removal_cost(market);
+            sol.remove_market_at_pos(pos);
+            CHECK_F(sol.cost_ == cost_before + verdict.cost_change_,
+                    "Removal cost change: %d, predicted: %d",
+                    sol.cost_ - cost_before, verdict.cost_change_);
+            CHECK_F(sol.is_valid() == verdict.demand_satisfied_,
+                    "Validity after removal should be predicted correctly");
+        } else if (action == 3 && route_len > 1 && !unselected.empty()) {
+            // Exchange of up to 3 consecutive markets with an unselected one
+            const auto k = 1 + rng() % min<size_t>(3, route_len - 1);
+            const auto first = 1 + rng() % (route_len - k);
+            const vector<uint32_t> removed(sol.route_.begin() + first,
+                                           sol.route_.begin() + first + k);
+            const auto market = random_element(unselected);
+            const auto verdict = sol.calc_exchange_cost(removed, market);
+            sol.exchange_markets(removed, market, verdict.index_);
+            CHECK_F(sol.cost_ == cost_before + verdict.cost_change_,
+                    "Exchange cost change: %d, predicted: %d",
+                    sol.cost_ - cost_before, verdict.cost_change_);
+            CHECK_F(sol.is_valid() == verdict.demand_satisfied_,
+                    "Validity after exchange should be predicted correctly");
+        }
+        check_solution_consistency(sol);
+
+        if (step % 50 == 0) {
+            TPP::Solution copy(instance);
+            copy = sol;
+            CHECK_F(copy.cost_ == sol.cost_ && copy.route_ == sol.route_,
+                    "The copy should be equal to the solution");
+            check_solution_consistency(copy);
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    auto args = docopt::docopt(USAGE, { argv + 1, argv + argc }, true);
+
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+
+    run_unit_tests();
+    test_ls_cache(make_random_instance(1));
+    test_stagnation_stop(make_random_instance(1));
+    test_solver_cancel(make_random_instance(1));
+    test_instance_change_heuristic(make_random_instance(2));
+    {
+        TPP::GeneratorConfig config;
+        config.seed_ = 3;
+        config.markets_ = 150;
+        config.products_ = 50;
+        test_instance_change_local_search(make_generated_instance(config));
+        test_checkpoint_resume(make_generated_instance(config));
+    }
+    LOG_F(WARNING, "Unit tests passed");
+
+    const auto cases = static_cast<uint32_t>(args["--cases"].asLong());
+    const auto steps = static_cast<uint32_t>(args["--steps"].asLong());
+    const auto first_seed = static_cast<uint32_t>(args["--seed"].asLong());
+    for (auto seed = first_seed; seed < first_seed + cases; ++seed) {
+        ERROR_CONTEXT("case seed", seed);
+        const auto instance = make_random_instance(seed);
+        test_solution_incremental_cost(instance, seed, steps);
+        test_dont_look_bits(instance, seed, steps);
+        gsh_run_tests(instance);
+        cah_run_tests(instance, seed);
+    }
+    LOG_F(WARNING, "Property-based tests passed: %u cases, %u steps each",
+          cases, steps);
+    return EXIT_SUCCESS;
+}
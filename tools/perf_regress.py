@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+End-to-end performance regression harness for ants-tpp.
+
+Runs the given configurations of ants-tpp over a set of instances with fixed
+seeds and collects for each run:
+
+  - iterations per second,
+  - time to reach a solution within x% of the best known cost (the
+    best_solutions_time_log / best_solutions_error_log of the results file),
+  - peak RSS of the process,
+  - startup time (self-tests, instance loading and preprocessing).
+
+The medians over the seeds can be saved as a baseline (--save-baseline) and
+compared against a previously saved one (--baseline). The script exits with
+status 1 if any metric got worse by more than --threshold.
+
+Example:
+
+    tools/perf_regress.py --instances=EEuclideo.350.150.1.tpp \\
+        --seeds=1,2,3 --args="--iterations=500" --save-baseline=perf.json
+    # ... change the code, rebuild ...
+    tools/perf_regress.py --instances=EEuclideo.350.150.1.tpp \\
+        --seeds=1,2,3 --args="--iterations=500" --baseline=perf.json
+"""
+
+import argparse
+import glob
+import json
+import os
+import shlex
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+# For each metric: True if a higher value is better
+METRICS = {
+    'iterations_per_sec': True,
+    'peak_rss_mb': False,
+    'startup_time': False,
+}
+
+# Differences below these values are treated as noise, regardless of the
+# relative change (times in seconds)
+MIN_ABS_DIFF = {
+    'peak_rss_mb': 1.0,
+    'startup_time': 0.05,
+    'time_to_': 0.05,
+}
+
+
+def time_to_target(trial, error_pct):
+    """
+    Returns the time after which the best solution was within error_pct % of
+    the best known cost or None if it was not reached.
+    """
+    times = trial.get('best_solutions_time_log', [])
+    errors = trial.get('best_solutions_error_log', [])
+    for t, err in zip(times, errors):
+        if err <= error_pct:
+            return t
+    return None
+
+
+def run_once(binary, instance, seed, extra_args, targets):
+    with tempfile.TemporaryDirectory(prefix='perf-') as outdir:
+        cmd = [binary, '--instance=' + instance, '--seed=%d' % seed,
+               '--outdir=' + outdir] + extra_args
+        start = time.monotonic()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                                stderr=subprocess.DEVNULL)
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall_time = time.monotonic() - start
+        if status != 0:
+            raise RuntimeError('Command failed (%d): %s' % (status, ' '.join(cmd)))
+
+        result_files = glob.glob(os.path.join(outdir, 'results_*.js'))
+        if len(result_files) != 1:
+            raise RuntimeError('Expected a single results file in ' + outdir)
+        with open(result_files[0]) as f:
+            record = json.load(f)
+
+    trial = record['trials'][0]
+    duration = trial['duration']
+    run = {
+        'seed': seed,
+        'wall_time': wall_time,
+        'iterations_per_sec': trial['total_iterations'] / max(duration, 1e-9),
+        # ru_maxrss is in kilobytes on Linux
+        'peak_rss_mb': rusage.ru_maxrss / 1024.0,
+        'startup_time': record.get('startup_time', 0.0),
+        'best_cost': trial.get('best_solutions_cost_log', [None])[-1],
+    }
+    if record.get('best_known_cost', 0) > 0:
+        for pct in targets:
+            run['time_to_%g%%' % pct] = time_to_target(trial, pct)
+    return run
+
+
+def summarize(runs):
+    """Returns the medians of the metrics over the runs (seeds)."""
+    summary = {}
+    keys = set(k for run in runs for k in run if k != 'seed')
+    for key in sorted(keys):
+        values = [run.get(key) for run in runs]
+        if key.startswith('time_to_'):
+            # A target not reached in some run counts as a failure
+            if any(v is None for v in values):
+                summary[key] = None
+                continue
+        values = [v for v in values if v is not None]
+        summary[key] = statistics.median(values) if values else None
+    return summary
+
+
+def compare(baseline, current, threshold):
+    """
+    Returns a list of regressions, i.e. metrics which got worse by more than
+    threshold (relative change).
+    """
+    regressions = []
+    for name, metrics in current.items():
+        if name not in baseline:
+            print('WARNING no baseline for: %s' % name, file=sys.stderr)
+            continue
+        base = baseline[name]
+        for key, value in metrics.items():
+            if key not in base or base[key] is None:
+                continue
+            if key in METRICS:
+                higher_is_better = METRICS[key]
+            elif key.startswith('time_to_'):
+                higher_is_better = False
+                if value is None:
+                    regressions.append((name, key, base[key], value, float('inf')))
+                    continue
+            else:
+                continue
+            floor = MIN_ABS_DIFF.get('time_to_' if key.startswith('time_to_') else key, 0)
+            if base[key] == 0 or abs(value - base[key]) < floor:
+                continue
+            change = (value - base[key]) / base[key]
+            slowdown = -change if higher_is_better else change
+            if slowdown > threshold:
+                regressions.append((name, key, base[key], value, slowdown))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='End-to-end performance regression harness for ants-tpp')
+    parser.add_argument('--binary', default='./ants-tpp')
+    parser.add_argument('--instances', required=True,
+                        help='Comma separated list of instance paths')
+    parser.add_argument('--seeds', default='1,2,3')
+    parser.add_argument('--args', action='append', default=None,
+                        help='Arguments of a configuration to run, can be '
+                             'given multiple times [default: --iterations=500]')
+    parser.add_argument('--targets', default='1,0.5,0',
+                        help='Comma separated list of errors (in %%) for the '
+                             'time-to-target metric')
+    parser.add_argument('--baseline', help='Baseline to compare against')
+    parser.add_argument('--save-baseline', help='Where to save the results')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='Max. allowed relative slowdown [default: 0.1]')
+    opts = parser.parse_args()
+
+    configs = opts.args or ['--iterations=500']
+    seeds = [int(s) for s in opts.seeds.split(',')]
+    targets = [float(t) for t in opts.targets.split(',')]
+
+    results = {}
+    for instance in opts.instances.split(','):
+        for config in configs:
+            name = '%s %s' % (os.path.basename(instance), config)
+            runs = [run_once(opts.binary, instance, seed,
+                             shlex.split(config), targets)
+                    for seed in seeds]
+            results[name] = summarize(runs)
+            print('%s: %s' % (name, json.dumps(results[name], sort_keys=True)),
+                  file=sys.stderr)
+
+    record = {'seeds': seeds, 'targets': targets, 'results': results}
+    print(json.dumps(record, indent=2, sort_keys=True))
+
+    if opts.save_baseline:
+        with open(opts.save_baseline, 'w') as f:
+            json.dump(record, f, indent=2, sort_keys=True)
+
+    if opts.baseline:
+        with open(opts.baseline) as f:
+            baseline = json.load(f)['results']
+        regressions = compare(baseline, results, opts.threshold)
+        for name, key, base, value, slowdown in regressions:
+            print('REGRESSION %s %s: %s -> %s (%+.1f%%)'
+                  % (name, key, base, value, 100 * slowdown), file=sys.stderr)
+        if regressions:
+            return 1
+        print('No regressions above %.1f%%' % (100 * opts.threshold),
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
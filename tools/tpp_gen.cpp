@@ -0,0 +1,71 @@
+/*
+ * Generates random U-TPP instances in the TPPLIB format.
+ */
+#include <fstream>
+#include <iostream>
+
+#include "docopt.h"
+#include "logging.h"
+#include "instance_generator.h"
+
+using namespace std;
+
+
+static const char USAGE[] =
+R"(Generator of random U-TPP instances.
+
+    Usage:
+      tpp-gen --markets=<n> --products=<n> [--seed=<n>] [--weights=<s>]
+              [--clusters=<n>] [--density=<f>] [--max-price=<n>] [--out=<path>]
+      tpp-gen (-h | --help)
+
+    Options:
+      --markets=<n>      Number of markets including the depot (up to 10000,
+                         the solver keeps two dense n x n distance
+                         matrices, i.e. about 8 * n^2 bytes).
+      --products=<n>     Number of products.
+      --seed=<n>         Seed of the pseudo-random num. gen. [default: 1].
+      --weights=<s>      How the distances are given euc2d|explicit [default: euc2d].
+      --clusters=<n>     Number of clusters of markets, 0 means uniform
+                         distribution [default: 0].
+      --density=<f>      Probability that a market offers a product, if 0 the
+                         number of markets offering a product is drawn
+                         from [1, markets-1] [default: 0].
+      --max-price=<n>    Prices are drawn from [1, max-price] [default: 500].
+      --out=<path>       Where to save the instance, stdout if not given.
+      -h --help          Show this screen.
+)";
+
+
+int main(int argc, char *argv[]) {
+    auto args = docopt::docopt(USAGE, { argv + 1, argv + argc }, true);
+
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+
+    TPP::GeneratorConfig config;
+    config.markets_ = static_cast<uint32_t>(args["--markets"].asLong());
+    config.products_ = static_cast<uint32_t>(args["--products"].asLong());
+    config.seed_ = static_cast<uint32_t>(args["--seed"].asLong());
+    config.clusters_ = static_cast<uint32_t>(args["--clusters"].asLong());
+    config.offer_density_ = stod(args["--density"].asString());
+    config.max_price_ = static_cast<int>(args["--max-price"].asLong());
+
+    const auto weights = args["--weights"].asString();
+    CHECK_F(weights == "euc2d" || weights == "explicit",
+            "Unknown weights type: %s", weights.c_str());
+    config.explicit_weights_ = (weights == "explicit");
+
+    CHECK_F(config.markets_ <= 10000, "At most 10000 markets are supported");
+    CHECK_F(config.offer_density_ >= 0 && config.offer_density_ <= 1,
+            "Density should be in [0, 1]");
+
+    if (args["--out"]) {
+        const auto path = args["--out"].asString();
+        ofstream out(path);
+        CHECK_F(out.is_open(), "Cannot create file: %s", path.c_str());
+        TPP::write_random_instance(out, config);
+    } else {
+        TPP::write_random_instance(cout, config);
+    }
+    return EXIT_SUCCESS;
+}